@@ -32,10 +32,10 @@
 
 #include "array.h"
 
-PUBLIC u16
-array_append(Array *arr, const u8 *data, u16 bytes)
+PUBLIC u32
+array_append(Array *arr, const u8 *data, u32 bytes)
 {
-	u16 cpy = MIN(bytes, array_bytes_left(arr));
+	u32 cpy = MIN(bytes, array_bytes_left(arr));
 
 	memcpy(array_end(arr), data, cpy);
 
@@ -64,7 +64,7 @@ array_clean(Array *arr)
 PUBLIC void
 array_copy(const struct array *from, struct array *to)
 {
-	u16 bytes = MIN(from->len, to->max);
+	u32 bytes = MIN(from->len, to->max);
 
 	array_clean(to);
 
@@ -78,10 +78,10 @@ array_copy(const struct array *from, struct array *to)
  *
  * @return Number of bytes that have been filled.
  */
-PUBLIC u16
+PUBLIC u32
 array_fill(array *a, u8 v)
 {
-	u16 bytes = array_bytes_left(a);
+	u32 bytes = array_bytes_left(a);
 
 	memset(array_end(a), v, bytes);
 
@@ -91,7 +91,7 @@ array_fill(array *a, u8 v)
 }
 
 PUBLIC struct array *
-array_alloc(u16 bytes)
+array_alloc(u32 bytes)
 {
 	struct array *new = malloc(sizeof(*new) + bytes);
 	new->length = 0;
@@ -33,13 +33,13 @@
  */
 struct array {
 	union {
-		u16   length;           /* current used length */
-		u16   len;
+		u32   length;           /* current used length */
+		u32   len;
 	};
 	union {
-		u16 __max;
-		u16 const max;
-		u16 const size __deprecated;
+		u32 __max;
+		u32 const max;
+		u32 const size __deprecated;
 	};
 	union {
 		u8    *const val;       /* provide a more readable(?) alias */
@@ -51,7 +51,7 @@ struct array {
 
 struct array_iterator {
 	const struct array *const arr;
-	u8           pos;
+	u32          pos;
 };
 
 typedef struct array Array;
@@ -86,19 +86,19 @@ array_map(struct array *arr, u8 (*map)(u8))
 //	}
 
 
-PUBLIC u16  array_append(array *, const u8 *, u16);
+PUBLIC u32  array_append(array *, const u8 *, u32);
 PUBLIC u8   array_put(array *, u8);
-PUBLIC u16  array_fill(array *, u8);
+PUBLIC u32  array_fill(array *, u8);
 PUBLIC void array_clean(array *);
 PUBLIC void array_copy(const struct array *, struct array *);
 PUBLIC u8   array_shift(array *);
-PUBLIC u16  array_shift_out(array *, u16);
+PUBLIC u32  array_shift_out(array *, u32);
 
 PUBLIC void          array_free(struct array *);
-PUBLIC struct array *array_alloc(u16);
+PUBLIC struct array *array_alloc(u32);
 
 static inline void
-array_init(array *arr, u8 *buff, u16 size)
+array_init(array *arr, u8 *buff, u32 size)
 {
 	arr->__val = buff;
 	arr->__max = size;
@@ -119,7 +119,7 @@ array_push(array *arr, u8 v)
 /**
  *  @return Number of unused bytes.
  */
-static inline u16
+static inline u32
 array_bytes_left(Array *arr)
 {
 	return arr->max - arr->length;
@@ -32,6 +32,7 @@
  */
 #include <flxlib.h>
 #include <io/stream.h>
+#include <io/iovec.h>
 
 #include <string.h>
 #include <stdlib.h>
@@ -44,39 +45,181 @@
 unsigned char apdu_input_buffer[256*16];
 unsigned char apdu_output_buffer[256*16];
 
+/* Number of distinct sources a response may be assembled from. The last
+ * segment is reserved for bytes copied into '__rapdu'. */
+#define RAPDU_SEGMENTS 8
+
 PRIVATE Array __capdu_data = Array(apdu_input_buffer, sizeof(apdu_input_buffer));
 PRIVATE Array __rapdu_data = Array(apdu_output_buffer, sizeof(apdu_output_buffer));
 
+PRIVATE struct iov_seg __rapdu_segs[RAPDU_SEGMENTS];
+PRIVATE struct iovec   __rvec_data = IOVEC(__rapdu_segs);
+
 PUBLIC Array *const __capdu = &__capdu_data;
 PUBLIC Array *const __rapdu = &__rapdu_data;
 
+/**
+ *  The response is described by a list of segments. Bytes written to the
+ *  response stream are kept in '__rapdu' and referenced from here, spliced
+ *  segments are referenced directly.
+ */
+PUBLIC struct iovec *const __rvec = &__rvec_data;
+
+/**
+ *  Register the last 'bytes' of '__rapdu' as part of the response.
+ *
+ *  Spliced segments never take the last segment of '__rvec'. Once it is used,
+ *  it describes the tail of '__rapdu' and any further bytes are merged into
+ *  it, so committing does not run out of segments.
+ *
+ *  @return Number of bytes that are part of the response now. Bytes which
+ *          could not be registered are taken back from '__rapdu'.
+ */
+PRIVATE u32
+apdu_response_commit(u32 bytes)
+{
+	u8 *start = __rapdu_data.val + __rapdu_data.length - bytes;
+
+	if (iov_add_ram(__rvec, start, bytes)) {
+		__rapdu_data.length -= bytes;
+		return 0;
+	}
+
+	return bytes;
+}
+
+/**
+ *  Reference a segment from the response without copying its bytes.
+ *
+ *  @return E_NOMEM if only the segment reserved for '__rapdu' is left.
+ */
+PRIVATE err_t
+apdu_response_link(const struct iov_seg *seg)
+{
+	if (__rvec->count + 1 >= __rvec->max)
+		return E_NOMEM;
+
+	return iov_append(__rvec, seg);
+}
+
 /**
  * @Implements .put of 'struct stream_out'
  */
 PRIVATE u32
 apdu_response_put(struct stream_out *ctx, u8 c)
 {
-	return array_put(&__rapdu_data, c);
+	PARAM_UNUSED(ctx);
+
+	if (!array_put(&__rapdu_data, c))
+		return 0;
+
+	return apdu_response_commit(1);
+}
+
+/**
+ * @Implements .write of 'struct stream_out'
+ */
+PRIVATE u32
+apdu_response_write(struct stream_out *os, u8 *data, u32 bytes)
+{
+	u32 written;
+
+	PARAM_UNUSED(os);
+
+	written = array_append(&__rapdu_data, data, MIN(bytes, array_bytes_left(&__rapdu_data)));
+
+	return apdu_response_commit(written);
 }
 
 PRIVATE u32
 apdu_response_fetch(struct stream_out *os, struct stream_in *is, u32 bytes)
 {
 	u32 max_bytes = MIN(bytes, array_bytes_left(&__rapdu_data));
+	u32 written;
 
-	u32 written = stream_read(is, array_end(&__rapdu_data), max_bytes);
+	PARAM_UNUSED(os);
 
+	written = stream_read(is, array_end(&__rapdu_data), max_bytes);
 	__rapdu_data.length += written;
 
-	return written;
+	return apdu_response_commit(written);
+}
+
+/**
+ *  Reference memory and device ranges instead of copying them into the
+ *  response buffer.
+ *
+ *  Inline segments and segments which do not fit into the segment list any
+ *  more are copied into '__rapdu'.
+ *
+ * @Implements .splice of 'struct stream_out'
+ */
+PRIVATE u32
+apdu_response_splice(struct stream_out *os, const struct iov_seg *seg)
+{
+	if ((seg->type == IOV_INLINE)
+	||  apdu_response_link(seg))
+	{
+		return stream_splice_native(os, seg);
+	}
+
+	return seg->len;
 }
 
 PRIVATE struct stream_out_ops _apdu_response_ops = {
 	.put = apdu_response_put,
-	.fetch_from = apdu_response_fetch
+	.write = apdu_response_write,
+	.fetch_from = apdu_response_fetch,
+	.splice = apdu_response_splice
 };
 PRIVATE struct stream_out _apdu_response = {
 	.ops = &_apdu_response_ops
 };
 
 struct stream_out *const apdu_response = &_apdu_response;
+
+/**
+ *  Discard the current response.
+ */
+PUBLIC void
+apdu_response_reset(void)
+{
+	array_reset(&__rapdu_data);
+	iov_reset(__rvec);
+}
+
+/**
+ *  Copy all response segments into '__rapdu'.
+ *
+ *  This is meant for transport layers which are not aware of scatter-gather
+ *  responses. Afterwards the response consists of a single segment.
+ *
+ *  Segments are placed from the back, so bytes already residing in '__rapdu'
+ *  are moved towards the end before any preceding segment overwrites them.
+ *
+ *  @return Length of the linear response, zero if it does not fit into
+ *          '__rapdu'. The response is left untouched then, it may still be
+ *          sent in chunks by iov_gather(). As a response ends with a status
+ *          word, it is never empty otherwise.
+ */
+PUBLIC u32
+apdu_response_flatten(void)
+{
+	struct iov_seg *seg;
+	u32 end = __rvec->length;
+	u32 start;
+
+	if (__rvec->length > __rapdu_data.max) return 0;
+
+	for (seg = __rvec->seg + __rvec->count; seg-- > __rvec->seg; end = start) {
+		start = end - seg->len;
+		iov_seg_read(seg, 0, __rapdu_data.val + start, seg->len);
+	}
+
+	__rapdu_data.length = __rvec->length;
+
+	iov_reset(__rvec);
+	iov_add_ram(__rvec, __rapdu_data.val, __rapdu_data.length);
+
+	return __rapdu_data.length;
+}
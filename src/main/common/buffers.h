@@ -36,11 +36,16 @@
 
 struct stream_out;
 struct array;
+struct iovec;
 
 // FIXME export into core module
 extern struct stream_out * const apdu_response;
 
 extern struct array *const __capdu;
 extern struct array *const __rapdu;
+extern struct iovec *const __rvec;
+
+void apdu_response_reset(void);
+u32  apdu_response_flatten(void);
 
 #endif /* APDU_BUFFERS_H_ */
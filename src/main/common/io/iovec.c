@@ -0,0 +1,235 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#include <const.h>
+#include <types.h>
+#include <string.h>
+
+#include <io/dev.h>
+
+#include "stream.h"
+#include "iovec.h"
+
+/* Device extents are passed to output streams in chunks of this size. */
+#define IOV_BOUNCE_SIZE 32
+
+/**
+ *  Try to extend segment 'last' by 'seg', if both describe adjacent bytes of
+ *  the same source.
+ *
+ *  @return True if 'seg' has been merged.
+ */
+PRIVATE bool
+iov_merge(struct iov_seg *last, const struct iov_seg *seg)
+{
+	if (last->type != seg->type) return false;
+
+	switch (seg->type) {
+	case IOV_INLINE:
+		if (last->len + seg->len > IOV_INLINE_SIZE) return false;
+		memcpy(last->bytes + last->len, seg->bytes, seg->len);
+		break;
+	case IOV_RAM:
+		if (last->ram + last->len != seg->ram) return false;
+		break;
+	case IOV_EXTENT:
+		if ((last->ext.dev != seg->ext.dev)
+		||  (last->ext.addr + last->len != seg->ext.addr))
+			return false;
+		break;
+	default:
+		return false;
+	}
+
+	last->len += seg->len;
+
+	return true;
+}
+
+/**
+ *  Append a segment to an I/O vector.
+ *
+ *  Adjacent segments of the same source are merged into one.
+ *
+ *  @return E_NOMEM if there is no free segment left.
+ */
+PUBLIC err_t
+iov_append(struct iovec *iov, const struct iov_seg *seg)
+{
+	CHECK_PARAM__NOT_NULL (iov);
+	CHECK_PARAM__NOT_NULL (seg);
+
+	if (!seg->len) return E_GOOD;
+
+	if (!iov->count || !iov_merge(&iov->seg[iov->count - 1], seg)) {
+		if (iov->count >= iov->max)
+			return E_NOMEM;
+
+		iov->seg[iov->count++] = *seg;
+	}
+
+	iov->length += seg->len;
+
+	return E_GOOD;
+}
+
+PUBLIC err_t
+iov_add_inline(struct iovec *iov, const u8 *data, u8 bytes)
+{
+	struct iov_seg seg = { .type = IOV_INLINE, .len = bytes };
+
+	if (bytes > IOV_INLINE_SIZE) return E_BAD_PARAM;
+
+	memcpy(seg.bytes, data, bytes);
+
+	return iov_append(iov, &seg);
+}
+
+PUBLIC err_t
+iov_add_ram(struct iovec *iov, const u8 *data, u32 bytes)
+{
+	struct iov_seg seg = { .type = IOV_RAM, .len = bytes, .ram = data };
+
+	return iov_append(iov, &seg);
+}
+
+PUBLIC err_t
+iov_add_extent(struct iovec *iov, struct mem_dev *dev, u32 addr, u32 bytes)
+{
+	struct iov_seg seg = { .type = IOV_EXTENT, .len = bytes };
+
+	CHECK_PARAM__NOT_NULL (dev);
+
+	seg.ext.dev  = dev;
+	seg.ext.addr = addr;
+
+	return iov_append(iov, &seg);
+}
+
+/**
+ *  Copy some bytes of a single segment from its source.
+ *
+ *  Source and destination may overlap.
+ *
+ *  @return Number of bytes copied to 'dest'.
+ */
+PUBLIC u32
+iov_seg_read(const struct iov_seg *seg, u32 off, u8 *dest, u32 bytes)
+{
+	if (off >= seg->len) return 0;
+
+	bytes = MIN(bytes, seg->len - off);
+
+	switch (seg->type) {
+	case IOV_INLINE:
+		memmove(dest, seg->bytes + off, bytes);
+		break;
+	case IOV_RAM:
+		memmove(dest, seg->ram + off, bytes);
+		break;
+	case IOV_EXTENT:
+		if (mdev_read(seg->ext.dev, seg->ext.addr + off, bytes, dest))
+			return 0;
+		break;
+	default:
+		return 0;
+	}
+
+	return bytes;
+}
+
+/**
+ *  Pass all bytes of a segment to an output stream.
+ *
+ *  Memory segments are written in one block, device extents are read in
+ *  chunks of IOV_BOUNCE_SIZE.
+ *
+ *  @return Number of bytes written to the stream.
+ */
+PUBLIC u32
+iov_seg_write_to(const struct iov_seg *seg, struct stream_out *os)
+{
+	u8  bounce[IOV_BOUNCE_SIZE];
+	u32 passed = 0;
+	u32 got, written;
+
+	switch (seg->type) {
+	case IOV_INLINE:
+		return stream_write(os, (u8 *) seg->bytes, seg->len);
+	case IOV_RAM:
+		return stream_write(os, (u8 *) seg->ram, seg->len);
+	case IOV_EXTENT:
+		while (passed < seg->len) {
+			got = iov_seg_read(seg, passed, bounce, sizeof(bounce));
+			if (!got) break;
+
+			written = stream_write(os, bounce, got);
+			passed += written;
+
+			if (written < got) break;
+		}
+		return passed;
+	default:
+		return 0;
+	}
+}
+
+/**
+ *  Copy a window of an I/O vector into a linear buffer.
+ *
+ *  @param off    Byte offset relative to the beginning of the vector.
+ *  @return Number of bytes copied to 'dest'.
+ */
+PUBLIC u32
+iov_gather(const struct iovec *iov, u32 off, u8 *dest, u32 bytes)
+{
+	const struct iov_seg *seg;
+	u32 got;
+	u32 passed = 0;
+
+	for_each(seg, iov->seg, iov->count) {
+		if (passed >= bytes) break;
+
+		if (off >= seg->len) {
+			off -= seg->len;
+			continue;
+		}
+
+		got = iov_seg_read(seg, off, dest + passed, bytes - passed);
+		if (!got) break;
+
+		passed += got;
+		off     = 0;
+	}
+
+	return passed;
+}
+
+u32
+stream_splice_native(struct stream_out *os, const struct iov_seg *seg)
+{
+	return iov_seg_write_to(seg, os);
+}
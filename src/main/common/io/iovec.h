@@ -0,0 +1,94 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#pragma once
+
+struct mem_dev;
+struct stream_out;
+
+#define IOV_INLINE_SIZE 4
+
+/**
+ *  Initialize an empty I/O vector on top of a static segment array.
+ */
+#define IOVEC(segs) {                      \
+	.seg    = (segs),                  \
+	.max    = LENGTH(segs),            \
+	.count  = 0,                       \
+	.length = 0 }
+
+enum Iov_Type {
+	IOV_INLINE = 0x01,   /* a few bytes carried by the segment itself */
+	IOV_RAM    = 0x02,   /* reference to some memory buffer */
+	IOV_EXTENT = 0x03    /* reference to a range of a memory device */
+};
+
+/**
+ *  One segment of an I/O vector describes where to fetch its bytes from.
+ *
+ *  Referenced memory (RAM buffers, device ranges) is not copied. It has to stay
+ *  valid and unchanged until all vector bytes have been consumed.
+ */
+struct iov_seg {
+	u8  type;
+	u32 len;
+	union {
+		u8       bytes[IOV_INLINE_SIZE];
+		const u8 *ram;
+		struct {
+			struct mem_dev *dev;
+			u32            addr;
+		} ext;
+	};
+};
+
+/**
+ *  Scatter-gather list of byte segments.
+ */
+struct iovec {
+	struct iov_seg *const seg;
+	const u8 max;
+	/* number of used segments */
+	u8       count;
+	/* total number of bytes described by all segments */
+	u32      length;
+};
+
+PUBLIC err_t iov_append(struct iovec *, const struct iov_seg *);
+PUBLIC err_t iov_add_inline(struct iovec *, const u8 *, u8);
+PUBLIC err_t iov_add_ram(struct iovec *, const u8 *, u32);
+PUBLIC err_t iov_add_extent(struct iovec *, struct mem_dev *, u32, u32);
+
+PUBLIC u32   iov_seg_read(const struct iov_seg *, u32, u8 *, u32);
+PUBLIC u32   iov_seg_write_to(const struct iov_seg *, struct stream_out *);
+PUBLIC u32   iov_gather(const struct iovec *, u32, u8 *, u32);
+
+static inline void
+iov_reset(struct iovec *iov)
+{
+	iov->count  = 0;
+	iov->length = 0;
+}
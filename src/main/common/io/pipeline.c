@@ -0,0 +1,188 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#include <const.h>
+#include <types.h>
+#include <string.h>
+
+#include "stream.h"
+#include "pipeline.h"
+
+PRIVATE u32  pipeline_write(struct stream_out *, u8 *, u32);
+PRIVATE void pipeline_close(struct stream_out *);
+
+PRIVATE const struct stream_out_ops __pipeline_ops = {
+	.put        = NULL,
+	.write      = pipeline_write,
+	.fetch_from = NULL,
+	.close      = pipeline_close
+};
+
+static inline struct pipeline *
+__to_pipeline(struct stream_out *os)
+{
+	return stream_type(os, struct pipeline, impl);
+}
+
+/**
+ *  Update the number of bytes collected before running all stages.
+ *
+ *  The scratch buffer keeps space for all trailers and holds complete
+ *  blocks of the largest stage block size only.
+ */
+PRIVATE err_t
+pipeline_update_chunk(struct pipeline *p)
+{
+	if (p->size <= p->trailer) return E_NOMEM;
+
+	p->chunk = p->size - p->trailer;
+	p->chunk -= p->chunk % p->blksz;
+
+	return p->chunk ? E_GOOD : E_NOMEM;
+}
+
+/**
+ *  Run all stages over the collected bytes and pass the result on.
+ */
+PRIVATE void
+pipeline_flush(struct pipeline *p)
+{
+	struct transform **t;
+	u32 n = p->level;
+
+	for_each(t, p->stage, p->count)
+		n = (*t)->ops->process(*t, p->scratch, p->scratch, n);
+
+	stream_write(p->target, p->scratch, n);
+
+	p->level = 0;
+}
+
+/**
+ *  Set up an empty pipeline.
+ *
+ *  @param scratch   Buffer shared by all stages, it has to outlive the stream.
+ */
+PUBLIC err_t
+pipeline_init(struct pipeline *p, u8 *scratch, u32 size, struct stream_out *target)
+{
+	CHECK_PARAM__NOT_NULL (p);
+	CHECK_PARAM__NOT_NULL (scratch);
+	CHECK_PARAM__NOT_NULL (target);
+	CHECK_PARAM__NOT_ZERO (size);
+
+	p->impl.ops    = &__pipeline_ops;
+	p->impl.status = STREAM_OPEN;
+
+	p->count   = 0;
+	p->target  = target;
+	p->scratch = scratch;
+	p->size    = size;
+	p->level   = 0;
+	p->blksz   = 1;
+	p->trailer = 0;
+
+	return pipeline_update_chunk(p);
+}
+
+/**
+ *  Append a stage to the pipeline.
+ *
+ *  Stages are applied in order of appending. Block sizes need to be multiples
+ *  of each other, so a chunk of the largest block size suits all stages.
+ */
+PUBLIC err_t
+pipeline_add(struct pipeline *p, struct transform *t)
+{
+	u16 blksz, old;
+
+	CHECK_PARAM__NOT_NULL (p);
+	CHECK_PARAM__NOT_NULL (t);
+	CHECK_PARAM__NOT_ZERO (t->blksz);
+
+	if (p->count >= PIPELINE_MAX_STAGES) return E_NOMEM;
+
+	/* stages can't be added once bytes have been collected */
+	if (p->level) return E_BUSY;
+
+	blksz = MAX(p->blksz, t->blksz);
+
+	if ((blksz % p->blksz) || (blksz % t->blksz))
+		return E_BAD_PARAM;
+
+	old = p->blksz;
+
+	p->blksz    = blksz;
+	p->trailer += t->trailer;
+
+	if (pipeline_update_chunk(p)) {
+		p->blksz    = old;
+		p->trailer -= t->trailer;
+		pipeline_update_chunk(p);
+		return E_NOMEM;
+	}
+
+	p->stage[p->count++] = t;
+
+	return E_GOOD;
+}
+
+PRIVATE u32
+pipeline_write(struct stream_out *os, u8 *data, u32 bytes)
+{
+	struct pipeline *p = __to_pipeline(os);
+	u32 cpy;
+	u32 passed = 0;
+
+	while (passed < bytes) {
+		cpy = MIN(p->chunk - p->level, bytes - passed);
+
+		memcpy(p->scratch + p->level, data + passed, cpy);
+		p->level += cpy;
+		passed   += cpy;
+
+		if (p->level == p->chunk)
+			pipeline_flush(p);
+	}
+
+	return passed;
+}
+
+PRIVATE void
+pipeline_close(struct stream_out *os)
+{
+	struct pipeline *p = __to_pipeline(os);
+	struct transform **t;
+	u32 n = p->level;
+
+	for_each(t, p->stage, p->count)
+		n = (*t)->ops->finalize(*t, p->scratch, n);
+
+	stream_write(p->target, p->scratch, n);
+
+	p->level = 0;
+	os->status = STREAM_CLOSED;
+}
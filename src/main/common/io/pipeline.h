@@ -0,0 +1,98 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#pragma once
+
+struct stream_out;
+struct transform;
+
+#define PIPELINE_MAX_STAGES 4
+
+/**
+ *  Operations of a single transformation stage.
+ *
+ *  'process' transforms a number of bytes that is a multiple of the stage block
+ *  size. Input and output buffer may be the same, i.e. stages have to support
+ *  in place transformation. It returns the number of bytes put into the
+ *  output buffer.
+ *
+ *  'finalize' is called once on closing the pipeline with all remaining bytes,
+ *  which might be any number. The stage transforms them in place and may append
+ *  up to 'trailer' bytes, e.g. a MAC. It returns the resulting number of bytes.
+ */
+struct transform_ops {
+	u32 (*process) (struct transform *, const u8 *, u8 *, u32);
+	u32 (*finalize)(struct transform *, u8 *, u32);
+};
+
+/**
+ *  Base of any transformation stage, embed it into the stage context.
+ */
+struct transform {
+	const struct transform_ops *ops;
+	/* number of bytes the stage wants to process at once */
+	u16 blksz;
+	/* maximum number of bytes appended on finalization */
+	u16 trailer;
+};
+
+/**
+ *  An output stream running its bytes through a chain of stages.
+ *
+ *  All stages work block by block in place on one scratch buffer. Bytes are
+ *  collected until the scratch buffer holds as many complete blocks as
+ *  possible, then all stages process them in turn and the result is written
+ *  to the target stream.
+ *
+ *  Closing the pipeline finalizes all stages, but leaves the target open.
+ */
+struct pipeline {
+	struct stream_out impl;
+
+	/* instance data */
+	struct transform  *stage[PIPELINE_MAX_STAGES];
+	u8                count;
+	struct stream_out *target;
+	u8                *scratch;
+	u32               size;
+	/* number of bytes collected before stages are run */
+	u32               chunk;
+	u32               level;
+	u16               blksz;
+	u16               trailer;
+};
+
+static inline void
+transform_init(struct transform *t, const struct transform_ops *ops,
+               u16 blksz, u16 trailer)
+{
+	t->ops     = ops;
+	t->blksz   = blksz;
+	t->trailer = trailer;
+}
+
+PUBLIC err_t pipeline_init(struct pipeline *, u8 *, u32, struct stream_out *);
+PUBLIC err_t pipeline_add(struct pipeline *, struct transform *);
@@ -82,15 +82,14 @@ stream_write_native(struct stream_out *os, u8 *buff, u32 bytes)
 PUBLIC u32
 stream_transfer_native(struct stream_in *is, struct stream_out *os, u32 bytes)
 {
-	u8 c;
+	u8  c;
+	u32 i;
 
-	while (bytes
-	&&     stream_get(is, &c)
-	&&     stream_put(os, c))
-	{
-		bytes--;
-	}
-	return bytes;
+	for (i = 0;
+	     i < bytes && stream_get(is, &c) && stream_put(os, c);
+	     i++);
+
+	return i;
 }
 
 PUBLIC u32
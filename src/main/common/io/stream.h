@@ -39,6 +39,7 @@ struct stream_out;
 struct stream_out_ops;
 struct stream_in;
 struct stream_in_ops;
+struct iov_seg;
 
 enum Stream_Status {
 	STREAM_CLOSED = 0x00,
@@ -52,12 +53,16 @@ enum Stream_Status {
  *  Providing a dedicated 'close' operation or abitility to fetch bytes from
  *  other input streams is optional.
  *
+ *  Streams which are able to defer copying, may implement 'splice' to accept
+ *  references to memory or device ranges (see io/iovec.h) instead of bytes.
+ *
  *  Do not call these methods directly. Use stream_* accesors instead.
  */
 struct stream_out_ops {
 	u32 (*put)(struct stream_out *, u8);
 	u32 (*write)(struct stream_out *, u8 *, u32);
 	u32 (*fetch_from)(struct stream_out *, struct stream_in *, u32);
+	u32 (*splice)(struct stream_out *, const struct iov_seg *);
 	void (*close)(struct stream_out *);
 };
 
@@ -98,6 +103,7 @@ u32 stream_skip_native(struct stream_in *, u32);
 u32 stream_read_native(struct stream_in *, u8 *, u32);
 u32 stream_write_native(struct stream_out *, u8 *, u32);
 u32 stream_transfer_native(struct stream_in *, struct stream_out *, u32);
+u32 stream_splice_native(struct stream_out *, const struct iov_seg *);
 
 u32 array_stream__get(struct stream_in *, u8 *);
 
@@ -116,7 +122,9 @@ stream_get(struct stream_in *is, u8 *c)
  *  Directly transfer some bytes from an input stream to an output stream.
  *
  *  If any of both streams does supports streaming transfer we are going to use
- *  it, otherwise fall back to native transfer method.
+ *  it, otherwise fall back to native transfer method. The input stream is asked
+ *  first, as it knows about its backing storage and may splice it into the
+ *  output stream without copying.
  *
  *  @return Number of bytes, that have been written to output stream.
  *  
@@ -130,10 +138,10 @@ stream_get(struct stream_in *is, u8 *c)
 static inline u32
 stream_transfer(struct stream_in *is, struct stream_out *os, u32 bytes)
 {
-	if (os->ops->fetch_from)
-		return os->ops->fetch_from(os, is, bytes);
-	else if (is->ops->push_to)
+	if (is->ops->push_to)
 		return is->ops->push_to(is, os, bytes);
+	else if (os->ops->fetch_from)
+		return os->ops->fetch_from(os, is, bytes);
 	else
 		return stream_transfer_native(is, os, bytes);
 }
@@ -196,6 +204,24 @@ stream_write(struct stream_out *os, u8 *data, u32 bytes)
 		return stream_write_native(os, data, bytes);
 }
 
+/**
+ *  Pass the bytes described by an I/O vector segment to a stream.
+ *
+ *  Streams that support splicing may keep a reference to the segment source
+ *  instead of copying its bytes. Otherwise the segment is copied through
+ *  'write'.
+ *
+ *  @return Number of bytes that have been accepted.
+ */
+static inline u32
+stream_splice(struct stream_out *os, const struct iov_seg *seg)
+{
+	if (os->ops->splice)
+		return os->ops->splice(os, seg);
+	else
+		return stream_splice_native(os, seg);
+}
+
 /**
  *  Write a two byte value onto a stream in big endianess format.
  *
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <array.h>
 #include <modules.h>
+#include <io/iovec.h>
 #include "buffers.h"
 
 // XXX
@@ -48,29 +49,25 @@ local_capdu_send(const u8 *data, u16 bytes)
 	return array_append(__capdu, data, bytes);
 }
 
+/* number of response bytes the terminal has already received */
+PRIVATE u32 rapdu_received;
+
 /**
  *  @return number of bytes that have been received from card OS.
  */
 PUBLIC u16
 local_rapdu_recv(u8 *buff, u16 max)
 {
-	u16 bytes = MIN(max, __rapdu->length);
+	u16 bytes;
 	u16 i;
 
 	for_each(i, 0, 3)
-		if (!__rapdu->length) wait_a_moment;
-
-	memcpy(buff, __rapdu->val, bytes);
-
-	/* remove copied bytes, but move remaining bytes to 
-	 * beginning of __rapdu: similar to left-shift operation
-	 * ...or right-shift depending on your view point. */
-	for_each(i, 0, (__rapdu->length - bytes))
-		__rapdu->val[i] = __rapdu->val[bytes+i];
+		if (!__rvec->length) wait_a_moment;
 
-	memset(__rapdu->val + bytes, 0x00, __rapdu->max - bytes);
+	/* gather response segments from their sources, e.g. device extents */
+	bytes = iov_gather(__rvec, rapdu_received, buff, max);
 
-	__rapdu->length -= bytes;
+	rapdu_received += bytes;
 
 	return bytes;
 }
@@ -84,7 +81,8 @@ local_capdu_recv(void)
 	/* XXX improve waiting */
 	while (!__capdu->length) wait_a_moment;
 
-	array_reset(__rapdu);
+	apdu_response_reset();
+	rapdu_received = 0;
 
 	return __capdu;
 }
@@ -107,6 +105,8 @@ local_io(void)
 
 	array_clean(__capdu);
 	array_clean(__rapdu);
+	apdu_response_reset();
+	rapdu_received = 0;
 
 	return module_hal_io_set(&io);
 }
@@ -103,6 +103,7 @@ enum Err_Code {
 	E_FS_EXIST  = 34,
 	E_BADFD     = 35,                /**< an invalid file descriptor */
 	E_FS_BUSY   = 36, 
+	E_FS_TERM   = 37,                /**< file in termination state */
 	/* TLV encoding errors */
 	E_TLV       = 64,                /**< TLV inconsistency. */
 	E_TLV_TAG   = 65,                /**< bad tag field encoding */
@@ -188,6 +189,28 @@ ecode(err_t err)
 
 #define SOMEFS_MAX_DIR_ENTRIES     16
 
+/**
+ * Number of blocks of SOMEFS_MAX_DIR_ENTRIES children a somefs DF may chain.
+ */
+#define SOMEFS_DF_MAX_BLOCKS       32
+
+/**
+ * Number of file system objects a somefs tree snapshot may hold.
+ */
+#define SOMEFS_SNAP_ENTRIES        64
+
+/**
+ * Number of files somefs creates, before it commits its superblock. Changes
+ * not committed are recovered on the next mount.
+ */
+#define SOMEFS_COMMIT_FILES        8
+
+/**
+ * Number of free extents a somefs superblock records. Freed space, that does
+ * not fit, is not reused.
+ */
+#define SOMEFS_FREE_EXTENTS        8
+
 /**
  * Configure how much struct objects of each type should be
  * preallocated in programm memory.
@@ -196,4 +219,46 @@ ecode(err_t err)
 #define FS_MAX_ACTIVE_DENTRIES     8
 #define FS_MAX_ACTIVE_FILES        8
 
+/**
+ * Number of file system types, which may be registered, and number of file
+ * systems mounted besides the root one.
+ */
+#define FS_MAX_TYPES               2
+#define FS_MAX_MOUNTS              2
+
+/**
+ * Number of hash chains of the dentry and the inode cache.
+ */
+#define FS_DCACHE_BUCKETS          8
+#define FS_ICACHE_BUCKETS          8
+
+/**
+ * Number of resolved paths smartfs_path_lookup() remembers.
+ */
+#define FS_PATH_CACHE_SIZE         8
+
+/**
+ * Number of section map entries an inode keeps in memory. Files with more
+ * sections load the window holding the section accessed.
+ */
+#define FS_SMAP_WINDOW             4
+
+/**
+ * Number of BER-TLV indexes of EF contents kept in memory and the number of
+ * objects each one may record.
+ */
+#define FS_MAX_TLV_INDEXES         2
+#define FS_TLV_INDEX_ENTRIES       16
+
+/**
+ * Maximum nesting of constructed BER-TLV objects tlv_parse_ber() steps into.
+ */
+#define TLV_MAX_NESTING            8
+
+/**
+ * Size of the memory arena each command may use for its temporary objects.
+ * It is reset on every new command APDU.
+ */
+#define CHANNEL_ARENA_SIZE         1024
+
 #endif /* _CONST_H_ */
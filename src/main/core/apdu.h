@@ -85,6 +85,10 @@ enum Status_Word {
 	SW__NOT_ALLOWED              = 0x6986,
 	SW__NO_EF                    = SW__NOT_ALLOWED,
 	SW__RECORD_NOT_FOUND         = 0x6A83,
+	SW__DATA_NOT_FOUND           = 0x6A88,
+	SW__INCOMPATIBLE_FILE        = 0x6981,
+	SW__CONDITIONS_NOT_SATISFIED = 0x6985,
+	SW__MEMORY_FAILURE           = 0x6581,
 
 	// legacy sosse stuff
 	SW_ACCESS_DENIED=0x6982,
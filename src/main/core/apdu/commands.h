@@ -51,10 +51,17 @@ PUBLIC sw_t cmd_read_record__with_sfi(const CmdAPDU *);
 PUBLIC sw_t cmd_write_record__current_ef(const CmdAPDU *);
 PUBLIC sw_t cmd_write_record__with_sfi(const CmdAPDU *);
 
+PUBLIC sw_t cmd_activate_file__current_df(const CmdAPDU *);
+
 PUBLIC sw_t cmd_get_challenge(const CmdAPDU *);
 
+PUBLIC sw_t cmd_get_data__from_current_ef(const CmdAPDU *);
+
 PUBLIC sw_t cmd_file_create__with_sfi(const CmdAPDU *);
 PUBLIC sw_t cmd_file_create__from_fcp(const CmdAPDU *);
 
+PUBLIC sw_t cmd_delete_file__by_fid(const CmdAPDU *);
+PUBLIC sw_t cmd_terminate_ef__by_fid(const CmdAPDU *);
+
 PUBLIC sw_t cmd_ec2ps_start(const CmdAPDU *);
 PUBLIC sw_t cmd_ec2ps_finish(const CmdAPDU *);
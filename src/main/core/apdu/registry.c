@@ -107,6 +107,18 @@ static FilterP1 _chosen_select[] = {
 	PATTERN_P1(_match_mask,           0x09, __chosen_select_by_path)
 };
 /* -------------------------------------------------------------------------- */
+/* ----- File - Activate ---------------------------------------------------- */
+/* -------------------------------------------------------------------------- */
+
+/* Only the current DF is activated, which has no selection in P1-P2. */
+static FilterP2 __chosen_activate_file[] = {
+	PATTERN_P2(_match_equal, 0x00, cmd_activate_file__current_df),
+};
+
+static FilterP1 _chosen_activate_file[] = {
+	PATTERN_P1(_match_equal, 0x00, __chosen_activate_file)
+};
+/* -------------------------------------------------------------------------- */
 /* ----- Get Challange -------------------------------------------------------*/
 /* -------------------------------------------------------------------------- */
 static FilterP2 __chosen_get_challenge__common[] = {
@@ -196,6 +208,19 @@ static FilterP1 _chosen_read_record[] = {
 	PATTERN_P1(_match_all, 0x00, __chosen_read_record)
 };
 
+/* -------------------------------------------------------------------------- */
+/* ----- Get Data ----------------------------------------------------------- */
+/* -------------------------------------------------------------------------- */
+
+/* P1-P2 is the tag of a data object within the current EF. */
+static FilterP2 __chosen_get_data[] = {
+	PATTERN_P2(_match_all, 0x00, cmd_get_data__from_current_ef)
+};
+
+static FilterP1 _chosen_get_data[] = {
+	PATTERN_P1(_match_all, 0x00, __chosen_get_data)
+};
+
 /* -------------------------------------------------------------------------- */
 /* ----- File - Create ------------------------------------------------------ */
 /* -------------------------------------------------------------------------- */
@@ -214,6 +239,28 @@ static FilterP1 _chosen_file_create[] = {
 	PATTERN_P1(_match_equal, 0x00, __chosen_file_create_no_fdb)
 };
 
+/* -------------------------------------------------------------------------- */
+/* ----- File - Delete and Terminate ---------------------------------------- */
+/* -------------------------------------------------------------------------- */
+
+/* P1 '00' selects the file by its FID in the command data or the current EF
+ * without any. Other selection methods are not supported. */
+static FilterP2 __chosen_delete_file[] = {
+	PATTERN_P2(_match_equal, 0x00, cmd_delete_file__by_fid),
+};
+
+static FilterP1 _chosen_delete_file[] = {
+	PATTERN_P1(_match_equal, 0x00, __chosen_delete_file)
+};
+
+static FilterP2 __chosen_terminate_ef[] = {
+	PATTERN_P2(_match_equal, 0x00, cmd_terminate_ef__by_fid),
+};
+
+static FilterP1 _chosen_terminate_ef[] = {
+	PATTERN_P1(_match_equal, 0x00, __chosen_terminate_ef)
+};
+
 /* ========================================================================== */
 /*        Proprietary FlexCOS Commands                                        */
 /* ========================================================================== */
@@ -228,13 +275,17 @@ static FilterP1 _chosen_ec2ps_start[] = {
 /* Finally: Set up an Instruction (handler) Lookup Table */
 const FilterIns i7816_instructions[] = {
 	INSTRUCTION( 0x22, _chosen_mse ),
+	INSTRUCTION( 0x44, _chosen_activate_file ),
 	INSTRUCTION( 0x84, _chosen_get_challenge ),
 	INSTRUCTION( 0xA4, _chosen_select ),
 	INSTRUCTION( 0xB0, _chosen_read_binary_b0 ),
 	INSTRUCTION( 0xB1, _chosen_read_binary_b1 ),
 	INSTRUCTION( 0xB2, _chosen_read_record ),
+	INSTRUCTION( 0xCA, _chosen_get_data ),
 	INSTRUCTION( 0xD2, _chosen_write_record ),
 	INSTRUCTION( 0xE0, _chosen_file_create ),
+	INSTRUCTION( 0xE4, _chosen_delete_file ),
+	INSTRUCTION( 0xE8, _chosen_terminate_ef ),
 };
 const FilterIns flxcos_instructions[] = {
 	INSTRUCTION( 0xC2, _chosen_ec2ps_start )
@@ -261,8 +312,8 @@ apdu_get_cmd_handler(const CmdAPDU *capdu)
 	const FilterP2  *filter_p2;
 	const FilterIns *ins_set;
 	u8 i, n;
-	/* variables for binary search */
-	u8 bs_first, bs_middle, bs_last;
+	/* variables for binary search over [bs_first, bs_end) */
+	u8 bs_first, bs_middle, bs_end;
 
 	/* return default function, that returns a
 	 * 'Not Supported' status word */
@@ -271,15 +322,16 @@ apdu_get_cmd_handler(const CmdAPDU *capdu)
 	bs_first = 0;
 	if (capdu->header->CLA & 0x80) {
 		ins_set = flxcos_instructions;
-		bs_last = LENGTH(flxcos_instructions) - 1;
+		bs_end  = LENGTH(flxcos_instructions);
 
 	} else {
 		ins_set = i7816_instructions;
-		bs_last = LENGTH(i7816_instructions) - 1;
+		bs_end  = LENGTH(i7816_instructions);
 	}
-	bs_middle = (bs_last - bs_first) / 2;
 
-	while (bs_first <= bs_last) {
+	while (bs_first < bs_end) {
+		bs_middle = (bs_first + bs_end) / 2;
+
 		/* we have found the instruction in our registry.
 		 * Now it is matching time for P1 and P2... */
 		if (ins_set[bs_middle].ins == capdu->header->INS) {
@@ -305,13 +357,11 @@ apdu_get_cmd_handler(const CmdAPDU *capdu)
 		}
 		/* expect a sorted registry: we can do some binary search */
 		else if (capdu->header->INS < ins_set[bs_middle].ins) {
-			bs_last = bs_middle - 1;
+			bs_end = bs_middle;
 		}
 		else {
 			bs_first = bs_middle + 1;
 		}
-
-		bs_middle = (bs_first + bs_last) / 2;
 	}
 
 	return handler;
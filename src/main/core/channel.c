@@ -35,6 +35,7 @@
 #include <io/stream.h>
 #include <common/list.h>
 #include <mm/pstore.h>
+#include <mm/arena.h>
 
 #include "channel.h"
 
@@ -42,10 +43,15 @@ struct channel_intern {
 	struct channel pub;
 	struct pstore  session;
 	struct pstore  request;
+	struct arena   arena;
 };
 
+PRIVATE u8 __arena_mem[CHANNEL_ARENA_SIZE];
+
 /* TODO there is no channel management right now */
-PRIVATE struct channel_intern _chan = {{0}};
+PRIVATE struct channel_intern _chan = {
+	.arena = CArena(__arena_mem)
+};
 
 struct object {
 	struct list_head list;
@@ -80,3 +86,9 @@ __request(void)
 {
 	return &_chan.request;
 }
+
+PUBLIC struct arena *
+__arena(void)
+{
+	return &_chan.arena;
+}
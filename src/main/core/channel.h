@@ -36,13 +36,14 @@ struct channel {
 	void             *security;
 
 	void             *df;
-	void             *ef;
+	u32              ef;             /**< FILE handle of the current EF */
 	/* memory scopes */
 	struct stream_out   *response;
 };
 
 #define chan_session (__session())
 #define chan_request (__request())
+#define chan_arena   (__arena())
 
 /* TODO refactor remove or rename */
 #define current (__current())
@@ -50,6 +51,7 @@ struct channel {
 struct channel *__current(void);
 struct pstore  *__session(void);
 struct pstore  *__request(void);
+struct arena   *__arena(void);
 
 err_t channel_setup(void);
 
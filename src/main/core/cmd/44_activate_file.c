@@ -0,0 +1,49 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#include <flxlib.h>
+#include <i7816.h>
+#include <flxio.h>
+#include <apdu.h>
+#include <apdu/commands.h>
+
+/**
+ *  P1 and P2 are zero and there is no command data. The current DF is
+ *  activated, which ends its personalization.
+ */
+PUBLIC sw_t
+cmd_activate_file__current_df(const CmdAPDU *capdu)
+{
+	err_t err;
+
+	if (capdu->Lc) return SW__WRONG_LENGTH;
+	if (capdu->Le) return SW__WRONG_LE;
+
+	err = df_activate();
+	if (err == E_NOENT) return SW__FILE_NOT_FOUND;
+
+	return err ? SW__MEMORY_FAILURE : SW__OK;
+}
@@ -25,15 +25,118 @@
 */
 
 #include <flxlib.h>
+#include <common/list.h>
+#include <i7816.h>
+#include <flxio.h>
 #include <apdu.h>
+#include <channel.h>
+#include <io/stream.h>
+#include <tlv.h>
+
+/**
+ *  P2 bits 4 and 3 tell which file control information to return.
+ */
+enum Select_Response {
+	SELECT_FCI  = 0x00,
+	SELECT_FCP  = 0x04,
+	SELECT_FMD  = 0x08,
+	SELECT_NONE = 0x0C
+};
+
+/**
+ *  Encode the control parameters of a file into a FCP or FCI template. The
+ *  file descriptor of a record oriented file is followed by data coding
+ *  byte, record size and number of records.
+ *
+ *  @return number of written bytes, zero on failure
+ */
+PRIVATE u32
+fcp_write(struct stream_out *os, u32 tag, const struct i7_fcp *fcp)
+{
+	u8     buff[32];
+	struct tlv_builder b = TLV_BUILDER(buff);
+	u8     fd[6] = {
+		fcp->fdb, fcp->dcb, fcp->rsize >> 8, fcp->rsize,
+		fcp->rcount >> 8, fcp->rcount
+	};
+
+	tlv_begin(&b, tag);
+
+	if (fcp->rcount) {
+		tlv_put_uint(&b, TAG_80, fcp->rsize * fcp->rcount, 2);
+		/* one or two bytes for the number of records */
+		if (fcp->rcount > 0xFF)
+			tlv_put(&b, FCP_FD_PLUS, fd, 6);
+		else {
+			fd[4] = fd[5];
+			tlv_put(&b, FCP_FD_PLUS, fd, 5);
+		}
+	} else {
+		tlv_put_uint(&b, TAG_80, fcp->size, 2);
+		tlv_put(&b, FCP_FD_PLUS, fd, 1);
+	}
+
+	tlv_put_uint(&b, FCP_FID, fcp->fid, 2);
+	tlv_put_uint(&b, FCP_LCS, fcp->lcs, 1);
+	tlv_end(&b);
+
+	return tlv_builder_flush(&b, os);
+}
 
 /* ========================================================================== *
  *  Select commands
  * ========================================================================== */
+/**
+ *  Select an EF of the current DF by its FID. The former current EF is
+ *  closed. Only the first occurrence is supported, P2 selects the returned
+ *  template.
+ */
 PUBLIC sw_t
-cmd_select__by_fid(const CmdAPDU *apdu)
+cmd_select__by_fid(const CmdAPDU *capdu)
 {
-	return 0x6A00;
+	fid_t  path[] = { 0, EOP };
+	struct i7_fcp fcp;
+	u8     resp = capdu->header->P2 & 0x0C;
+	sw_t   sw;
+	FILE   fh;
+
+	/* DFs are not selected by FID yet */
+	if ((capdu->header->P1 != 0x00) && (capdu->header->P1 != 0x02))
+		return SW__FUNCTION_NOT_SUPPORTED;
+
+	if ((capdu->header->P2 & ~0x0C) || (resp == SELECT_FMD))
+		return SW__INCORRECT_P1_P2;
+
+	if (capdu->Lc != 2) return SW__WRONG_LENGTH;
+
+	path[0] = (capdu->data[0] << 8) | capdu->data[1];
+
+	fh = f_info(path, &fcp);
+	if (!fh) return SW__FILE_NOT_FOUND;
+
+	if (i7_ftype(fcp.fdb) == DF) {
+		f_close(fh);
+		return SW__FUNCTION_NOT_SUPPORTED;
+	}
+
+	if (current->ef)
+		f_close(current->ef);
+
+	current->ef = fh;
+
+	/* a terminated EF is selected, but its content is out of reach */
+	sw = (fcp.lcs == TERMINATION) ? SW__FILE_TERMINATED : SW__OK;
+
+	if (resp == SELECT_NONE)
+		return sw;
+
+	if (!fcp_write(current->response, resp == SELECT_FCP ? TAG_FCP : TAG_FCI,
+	               &fcp))
+	{
+		return SW__MEMORY_FAILURE;
+	}
+
+	return sw;
 }
 PUBLIC sw_t
 cmd_select__by_path(const CmdAPDU *apdu)
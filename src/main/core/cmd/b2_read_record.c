@@ -36,7 +36,7 @@ PUBLIC sw_t
 cmd_read_record__current_ef(const CmdAPDU *capdu)
 {
 	struct file_stream_in ef_stream;
-	FILE  *ef = current->ef;
+	FILE  ef = current->ef;
 	u32   transfered;
 	err_t err;
 
@@ -44,6 +44,8 @@ cmd_read_record__current_ef(const CmdAPDU *capdu)
 
 	if (!ef) return SW__NOT_ALLOWED;
 
+	if (f_is_terminated(ef)) return SW__CONDITIONS_NOT_SATISFIED;
+
 	/* TODO check Bit3 of P2 first */
 	if (capdu->header->P1) {
 		err = f_seeks(ef, capdu->header->P1, SEEK_SET);
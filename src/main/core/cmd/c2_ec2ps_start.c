@@ -25,103 +25,142 @@
 */
 
 #include <flxlib.h>
+#include <string.h>
 #include <array.h>
+#include <buffers.h>
 #include <apdu.h>
 #include <common/list.h>
 #include <channel.h>
-#include <mm/pstore.h>
+#include <mm/arena.h>
 #include <io/stream.h>
+#include <io/pipeline.h>
 #include <tlv.h>
 
 #include <miracl.h>
 #include <ecc.h>
 #include <cryptools.h>
 
+#define EC2P_PIN_MAX  16
+
 enum EC2PTlvFoo {
-	EC2P_MSG = 0x01,
-	EC2P_PIN = 0x02
+	EC2P_REQUEST = 0x21,
+	EC2P_MSG     = 0x01,
+	EC2P_PIN     = 0x02
 };
 
+/**
+ *  Message and PIN are mandatory within the request template. The message is
+ *  passed on to the HMAC stream as it arrives, only the PIN is kept.
+ */
 struct ec2p_request {
-	struct array *msg;
-	struct array *pin;
+	struct hmac_stream_out *hmac;
+	u8     seen;
+	u8     pin_len;
+	u8     pin[EC2P_PIN_MAX];
+};
+
+enum EC2P_Seen {
+	SEEN_REQUEST = BIT_1,
+	SEEN_MSG     = BIT_2,
+	SEEN_PIN     = BIT_3,
+	SEEN_ALL     = SEEN_REQUEST | SEEN_MSG | SEEN_PIN
 };
 
-/* I think think tlv parsing is a good reason to introduce exceptions. */
 PRIVATE enum Tlv_Parse_Cmd
-require_msg_and_pin(const struct tlv_parse_ctx *tlv, void *opaque)
+ec2p__visit(const struct tlv_parse_ctx *tlv, void *opaque)
 {
-	struct array        *tlv_data;
 	struct ec2p_request *req = opaque;
-	enum ChannelObjectID id;
+	u8     bit;
 
 	if (list_empty(&tlv->nesting)) {
-		if (tlv->tag == 0x21)
-			return STEP_INTO;
-		else
+		if ((tlv->tag != EC2P_REQUEST) || (req->seen & SEEN_REQUEST))
 			return STOP;
-	}
 
-	tlv_data = array_alloc(tlv->length);
-	if (!tlv_data) return STOP;
+		req->seen |= SEEN_REQUEST;
+		return STEP_INTO;
+	}
 
 	switch (tlv->tag) {
-	case EC2P_MSG:
-		id = OID_EC2P_MSG;
-		req->msg = tlv_data;
-		break;
-	case EC2P_PIN:
-		id = OID_EC2P_PIN;
-		req->pin = tlv_data;
-		break;
+	case EC2P_MSG: bit = SEEN_MSG; break;
+	case EC2P_PIN: bit = SEEN_PIN; break;
 	default:
-		array_free(tlv_data);
 		return STOP;
 	}
 
-	array_append(tlv_data, tlv->value, tlv->length);
+	if (req->seen & bit) return STOP;
+	req->seen |= bit;
 
-	/* Adding fails if either there is already an object of 'id' or pstore 
-	 * fails to allocate memory for internal structure. */
-	if (pstore_add(chan_session, id, tlv_data, (fp_free) array_free)) {
-		array_free(tlv_data);
-		return STOP;
+	if (bit == SEEN_PIN) {
+		if (tlv->length > sizeof(req->pin)) return STOP;
+
+		memcpy(req->pin, tlv->value, tlv->length);
+		req->pin_len = tlv->length;
+	}
+	/* a message too large for the reassembly buffer went to the sink */
+	else if (tlv->value) {
+		stream_write(&req->hmac->pipe.impl, (u8 *) tlv->value, tlv->length);
 	}
 
 	return NEXT;
 }
 
+/**
+ *  Messages of any size are written to the HMAC stream without buffering.
+ */
+PRIVATE struct stream_out *
+ec2p__sink(const struct tlv_parse_ctx *tlv, void *opaque)
+{
+	struct ec2p_request *req = opaque;
+
+	if ((tlv->tag != EC2P_MSG) || (req->seen & SEEN_MSG))
+		return NULL;
+
+	return &req->hmac->pipe.impl;
+}
+
+/**
+ *  The command data is fed to a resumable parser, so the request may span
+ *  several chained commands later on.
+ */
 PUBLIC sw_t
 cmd_ec2ps_start(const CmdAPDU *capdu)
 {
-	struct ec2p_request req;
+	struct ec2p_request req = { .seen = 0 };
 	struct ecc_dom *dom;
 	struct ecc_pk  *pk_srv;
 
-	struct stream_out *hmac_stream;
+	struct tlv_stream_parser parser;
+	struct tlv_parse_scope   scope[1];
+	u8     vbuf[EC2P_PIN_MAX];
+
 	struct stream_out *ecies_stream;
 	u8     __key[0] = {};
-	u8     *c;
 	struct array      key = CArray(__key);
 
 	err_t err;
 
-	err = tlv_parse_ber(capdu->data, capdu->Lc, require_msg_and_pin, &req);
-	if (err)
-		return SW__LC_TLV_CONFLICT;
+	/* the stream is a temporary object of this command */
+	req.hmac = arena_alloc(chan_arena, sizeof(*req.hmac));
+	if (!req.hmac || hmac_stream_out_init(req.hmac, &key, current->response))
+		return SW__MEMORY_FAILURE;
 
-	/* Message and PIN are mandatory for this command */
-	if ((req.pin == NULL)
-	||  (req.msg == NULL))
-	{
-		return SW__WRONG_DATA;
-	}
+	tlv_stream_parser_init(&parser, ec2p__visit, &req, scope, LENGTH(scope),
+	                       vbuf, sizeof(vbuf), ec2p__sink);
 
-	hmac_stream = hmac_stream_out_create(&key, current->response);
+	err = tlv_stream_parser_feed(&parser, capdu->data, capdu->Lc);
+	if (!err)
+		err = tlv_stream_parser_finish(&parser);
 
-	array_each(req.msg, c) stream_put(hmac_stream, *c);
+	if (err || (req.seen != SEEN_ALL)) {
+		hmac_stream_out_clean(req.hmac);
+		/* drop the part of the message already passed on */
+		apdu_response_reset();
+
+		return err ? SW__LC_TLV_CONFLICT : SW__WRONG_DATA;
+	}
 
-	stream_close(hmac_stream);
+	stream_close(&req.hmac->pipe.impl);
+	hmac_stream_out_clean(req.hmac);
 
 	// load EC-Dom from default file
 	// load app file 
@@ -0,0 +1,83 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+
+#include <flxlib.h>
+#include <i7816.h>
+#include <flxio.h>
+#include <apdu.h>
+#include <apdu/commands.h>
+#include <channel.h>
+#include <io/stream.h>
+#include <io/file_stream.h>
+
+/**
+ *  P1-P2 is the tag of a top level BER-TLV object within the current EF,
+ *  '00xx' for a one byte tag. Its value is returned. The index of the file
+ *  content is built on first use, afterwards only the value is read.
+ */
+PUBLIC sw_t
+cmd_get_data__from_current_ef(const CmdAPDU *capdu)
+{
+	struct file_stream_in fis;
+	u32   tag = (capdu->header->P1 << 8) | capdu->header->P2;
+	u32   length;
+
+	if (capdu->Lc) return SW__WRONG_LENGTH;
+
+	if (!current->ef) return SW__NO_EF;
+
+	/* '00' and 'FF' are padding bytes */
+	if ((!tag) || (tag == 0xFF)) return SW__INCORRECT_P1_P2;
+
+	switch (f_tlv_find(current->ef, &tag, 1, &length)) {
+	case E_GOOD:
+		break;
+	/* no such object, or no BER-TLV content at all */
+	case E_NOENT:
+	case E_TLV:
+	case E_TLV_TAG:
+	case E_TLV_LEN:
+	case E_TLV_FIT:
+	case E_TLV_DEPTH:
+		return SW__DATA_NOT_FOUND;
+	case E_FS:
+		return SW__INCOMPATIBLE_FILE;
+	case E_FS_TERM:
+		return SW__CONDITIONS_NOT_SATISFIED;
+	default:
+		return SW__MEMORY_FAILURE;
+	}
+
+	if (file_stream_in_init(&fis, current->ef))
+		return SW__MEMORY_FAILURE;
+
+	/* file contents are spliced into the response where possible */
+	if (stream_transfer(&fis.stream, current->response, length) != length)
+		return SW__MEMORY_FAILURE;
+
+	return SW__OK;
+}
@@ -35,12 +35,14 @@ cmd_write_record__current_ef(const CmdAPDU *capdu)
 {
 	err_t  err;
 	size_t written;
-	FILE   *ef = current->ef;
+	FILE   ef = current->ef;
 
 	if (capdu->Le) return SW__WRONG_LE;
 
 	if (!ef) return SW__NO_EF;
 
+	if (f_is_terminated(ef)) return SW__CONDITIONS_NOT_SATISFIED;
+
 	/* jump to section */
 	if (capdu->header->P2 & 0x04) {
 		err = f_seeks(ef, capdu->header->P1, SEEK_SET);
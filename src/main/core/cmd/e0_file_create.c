@@ -53,101 +53,58 @@ cmd_file_create__with_sfi(const CmdAPDU *capdu)
  *
  *  FIXME if else if else if else o.O
  */
-PRIVATE enum Tlv_Parse_Cmd
-__fcp_parse__fd_plus(const u8 *data, u8 length, struct i7_fcp *fcp)
+PRIVATE err_t
+__fcp_decode__fd_plus(const u8 *data, u32 length, void *dest)
 {
-	if (!length || length > 6) return STOP;
+	struct i7_fcp *fcp = container_of((u8 *) dest, struct i7_fcp, fdb);
 
 	fcp->fdb = data[0];
 	if (length > 1)
 		fcp->dcb = data[1];
 	else
-		return NEXT;
+		return E_GOOD;
 
 	if (length > 2)
 		fcp->rsize = data[2];
 	else
-		return NEXT;
+		return E_GOOD;
 
 	if (length > 3) {
 		fcp->rsize <<= 8;
 		fcp->rsize  |= data[3];
 	}
 	else
-		return NEXT;
+		return E_GOOD;
 
 	if (length > 4)
 		fcp->rcount = data[4];
 	else
-		return NEXT;
+		return E_GOOD;
 
 	if (length > 5) {
 		fcp->rcount <<= 8;
 		fcp->rcount  |= data[5];
 	}
 
-	return NEXT;
+	return E_GOOD;
 }
 
-PRIVATE inline enum Tlv_Parse_Cmd
-__fcp_parse__fid(const u8 *data, u8 length, struct i7_fcp *fcp)
-{
-	if (length != 2 || fcp->fid) return STOP;
-
-	fcp->fid  = data[0] << 8;
-	fcp->fid |= data[1];
-
-	return NEXT;
-}
-
-PRIVATE inline enum Tlv_Parse_Cmd
-__fcp_parse__life_cycle_status(const u8 *data, u8 length, struct i7_fcp *fcp)
-{
-	if (length != 1 || fcp->lcs) return STOP;
-
-	fcp->lcs = data[0];
-
-	return NEXT;
-}
-
-PRIVATE enum Tlv_Parse_Cmd
-accept_fcp_only(const struct tlv_parse_ctx *tlv, void *opaque)
-{
-	struct i7_fcp      *fcp = opaque;
-
-	/*
-	 * FCP-Tag is mandatory be top level tag.
-	 */
-	if (list_empty(&tlv->nesting)) {
-		if (tlv->tag == 0x62)
-			return STEP_INTO;
-		else
-			return STOP;
-	}
-
-	switch (tlv->tag) {
-	/*
-	 * File IDentifier
-	 */
-	case FCP_FID:
-		return __fcp_parse__fid(tlv->value, tlv->length, fcp);
-	/*
-	 * Life Cycle Status Byte
-	 */
-	case FCP_LCS:
-		return __fcp_parse__life_cycle_status(tlv->value, tlv->length, fcp);
-	/*
-	 * File Descriptor Byte plus optional fields
-	 */
-	case FCP_FD_PLUS:
-		return __fcp_parse__fd_plus(tlv->value, tlv->length, fcp);
-	/*
-	 * Any other fields are not supported yet
-	 */
-	default:
-		return STOP;
-	}
-}
+/**
+ *  FCP-Tag is mandatory be top level tag. Any other fields are not
+ *  supported yet.
+ */
+PRIVATE const struct tlv_field fcp_fields[] = {
+	TLV_NESTED(0x00, TAG_FCP, TLV_MANDATORY),
+	/* File IDentifier */
+	TLV_FIELD(TAG_FCP, FCP_FID, TLV_FIELD_U16, struct i7_fcp, fid, 2, 2, 0),
+	/* Life Cycle Status Byte */
+	TLV_FIELD(TAG_FCP, FCP_LCS, TLV_FIELD_U8,  struct i7_fcp, lcs, 1, 1, 0),
+	/* File Descriptor Byte plus optional fields */
+	TLV_FIELD_FN(TAG_FCP, FCP_FD_PLUS, __fcp_decode__fd_plus,
+	             struct i7_fcp, fdb, 1, 6, 0)
+};
+
+PRIVATE const struct tlv_schema fcp_schema = TLV_SCHEMA(fcp_fields);
 
 /**
  *  This Command APDU handler should be called, if P1 and P2 have been set to
@@ -156,17 +113,20 @@ accept_fcp_only(const struct tlv_parse_ctx *tlv, void *opaque)
 PUBLIC sw_t
 cmd_file_create__from_fcp(const CmdAPDU *capdu)
 {
-	FILE *fh;
+	FILE fh;
 	struct i7_fcp fcp = {0};
 	extern Channel *current;
 
 	err_t err;
 
-	if (current->ef) f_close(current->ef);
+	if (current->ef) {
+		f_close(current->ef);
+		current->ef = 0;
+	}
 
 	if (!capdu->Lc) return SW__WRONG_LENGTH;
 
-	err = tlv_parse_ber(capdu->data, capdu->Lc, accept_fcp_only, &fcp);
+	err = tlv_decode_schema(capdu->data, capdu->Lc, &fcp_schema, &fcp);
 
 	if (err) return SW__WRONG_FCI;
 
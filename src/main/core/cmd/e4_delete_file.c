@@ -0,0 +1,84 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#include <flxlib.h>
+#include <i7816.h>
+#include <flxio.h>
+#include <apdu.h>
+#include <apdu/commands.h>
+#include <channel.h>
+
+PRIVATE sw_t
+delete_sw(err_t err)
+{
+	switch (err) {
+	case E_GOOD:
+		return SW__OK;
+	case E_NOENT:
+		return SW__FILE_NOT_FOUND;
+	/* open, not empty or the root of a file system */
+	case E_BUSY:
+	case E_FS_BUSY:
+		return SW__CONDITIONS_NOT_SATISFIED;
+	default:
+		return SW__MEMORY_FAILURE;
+	}
+}
+
+/**
+ *  P1 and P2 are zero. Without command data the current EF is deleted,
+ *  otherwise the file of the given FID within the current DF. A DF must be
+ *  empty. The space of the file is reused by files created later on.
+ */
+PUBLIC sw_t
+cmd_delete_file__by_fid(const CmdAPDU *capdu)
+{
+	fid_t path[] = { 0, EOP };
+	err_t err;
+
+	if (capdu->Le) return SW__WRONG_LE;
+
+	if (!capdu->Lc) {
+		if (!current->ef) return SW__NO_EF;
+
+		err = f_unlink(current->ef);
+		current->ef = 0;
+
+		return delete_sw(err);
+	}
+
+	if (capdu->Lc != 2) return SW__WRONG_LENGTH;
+
+	path[0] = (capdu->data[0] << 8) | capdu->data[1];
+
+	/* the current EF might be the one to delete */
+	if (current->ef && f_is(current->ef, path)) {
+		f_close(current->ef);
+		current->ef = 0;
+	}
+
+	return delete_sw(f_remove(path));
+}
@@ -0,0 +1,70 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#include <flxlib.h>
+#include <i7816.h>
+#include <flxio.h>
+#include <apdu.h>
+#include <apdu/commands.h>
+#include <channel.h>
+
+/**
+ *  P1 and P2 are zero. Without command data the current EF is terminated,
+ *  otherwise the file of the given FID within the current DF. A terminated
+ *  file may still be deleted.
+ */
+PUBLIC sw_t
+cmd_terminate_ef__by_fid(const CmdAPDU *capdu)
+{
+	fid_t path[] = { 0, EOP };
+	struct i7_fcp fcp;
+	FILE  ef;
+	err_t err;
+
+	if (capdu->Le) return SW__WRONG_LE;
+
+	if (!capdu->Lc) {
+		if (!current->ef) return SW__NO_EF;
+
+		err = f_terminate(current->ef);
+
+		return err ? SW__MEMORY_FAILURE : SW__OK;
+	}
+
+	if (capdu->Lc != 2) return SW__WRONG_LENGTH;
+
+	path[0] = (capdu->data[0] << 8) | capdu->data[1];
+
+	/* f_open() refuses a file terminated before */
+	ef = f_info(path, &fcp);
+	if (!ef) return SW__FILE_NOT_FOUND;
+
+	err = f_terminate(ef);
+	if (f_close(ef) && !err)
+		err = E_FAILED;
+
+	return err ? SW__MEMORY_FAILURE : SW__OK;
+}
@@ -41,6 +41,7 @@
 #include "channel.h"
 
 #include "io/stream.h"
+#include "mm/arena.h"
 
 
 /**
@@ -65,6 +66,8 @@ flexcos_process(const struct array *arr, struct stream_out *os)
 	};
 	/* XXX static channel */
 	current->response = apdu_response;
+	/* drop temporary objects of the previous command */
+	arena_reset(chan_arena);
 
 	/* check command for length fields */
 	if (apdu_validate_cmd(&capdu)) {
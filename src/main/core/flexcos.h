@@ -27,8 +27,9 @@
 #pragma once
 
 struct array;
+struct stream_out;
 
 PUBLIC void flexcos_run(void);
 PUBLIC void flexcos_one_shot(void);
 
-PUBLIC void flexcos_process(const struct array *);
+PUBLIC void flexcos_process(const struct array *, struct stream_out *);
@@ -32,9 +32,12 @@
  */
 
 #include <flxlib.h>
+#include <string.h>
 #include <i7816.h>
 #include <flxio.h>
 #include <channel.h>
+#include <common/list.h>
+#include <tlv.h>
 
 #include <fs/path.h>
 #include <fs/smartfs.h>
@@ -99,27 +102,54 @@ is_fcp_sound(struct i7_fcp *fcp)
 }
 
 
+/**
+ * Bind a free file object to an already referenced dentry.
+ *
+ * The dentry reference is handed over to the file object, or dropped if the
+ * file could not be opened.
+ *
+ * @return a file handle or 0 on failure
+ */
+PRIVATE FILE
+file_open(Dentry *dentry)
+{
+	File  *file = fget();
+	err_t err;
+
+	if (!file) {
+		dput(dentry);
+		return 0;
+	}
+
+	err = do_open(dentry, file);
+
+	if (err) {
+		fput(file);
+		dput(dentry);
+		return 0;
+	}
+
+	return fd_get(file);
+}
+
 /**
  *  Create a new file object within working directory.
  *
  *  On successful creation the new file is directly opened.
  *
- *  @return Pointer to internal file descriptor or NULL on failure.
+ *  @return Handle of the opened file or 0 on failure.
  */
-PUBLIC FILE *
+PUBLIC FILE
 f_create(struct i7_fcp *fcp)
 {
 	Dentry *new;
-	File   *file;
-	FILE   *fd;
-	err_t  err;
 	Attr   attr = {{0}, 0};
 
-	if (i7_ftype(fcp->fdb) != EF) return NULL;
+	if (i7_ftype(fcp->fdb) != EF) return 0;
 
-	if (!is_fcp_supported(fcp)) return NULL;
+	if (!is_fcp_supported(fcp)) return 0;
 	/* check soundness of function parameter 'fcp' */
-	if (!is_fcp_sound(fcp)) return NULL;
+	if (!is_fcp_sound(fcp)) return 0;
 
 	attr.iso7816.fdb = fcp->fdb;
 	attr.iso7816.lcs = fcp->lcs;
@@ -134,78 +164,121 @@ f_create(struct i7_fcp *fcp)
 	new = dentry_lookup(current->df, fcp->fid);
 	if (new) {
 		dput(new);
-		return NULL;
+		return 0;
 	}
 
 	new = dentry_create(current->df, fcp->fid, &attr);
 
-	if (!new) return NULL;
+	if (!new) return 0;
 
-	file = fget();
-	fd   = malloc(sizeof(FILE));
-	*fd   = fd_get(file);
+	return file_open(new);
+}
 
-	/* memory allocation error */
-	if (!file || !fd) return NULL;
+PRIVATE bool
+is_terminated(const Dentry *dentry)
+{
+	return inode_lcs_get(dentry->d_inode) == TERMINATION;
+}
 
-	err = do_open(new, file);
+/**
+ * Look up the file of a handle to access its content, which a terminated file
+ * does not grant any longer.
+ */
+PRIVATE File *
+fd_lookup_content(FILE fd)
+{
+	File *file = fd_lookup(fd);
 
-	if (err) {
-		free(fd);
-		fput(file);
-		dput(new);
+	if (file && is_terminated(file->f_dentry))
 		return NULL;
-	}
 
-	return fd;
+	return file;
 }
 
-PUBLIC FILE *
-f_open(const path_t p)
+/**
+ * Open a file by its path. Terminated files are opened only on request.
+ */
+PRIVATE FILE
+path_open(const path_t p, bool terminated)
 {
 	err_t  err;
 	Dentry *dentry;
-	FILE   *fd;
-	File   *file;
 
 	if (path_length(p) > 4)
-		return NULL;
+		return 0;
 
 	err = smartfs_path_lookup(p, &dentry);
 
 	if (err) {
 		dput(dentry);
-		return NULL;
+		return 0;
 	}
 
-	/*  FIXME !!!
-	 *  This is duplicate code (see: f_create). Provide some common file
-	 *  pointer instantiation.  */
-	file = fget();
-	fd   = malloc(sizeof(FILE));
-	*fd   = fd_get(file);
+	if (!terminated && is_terminated(dentry)) {
+		dput(dentry);
+		return 0;
+	}
 
-	if (!file || !fd) return NULL;
+	return file_open(dentry);
+}
 
-	err = do_open(dentry, file);
-	if (err) {
-		free(fd);
-		fput(file);
-		dput(dentry);
-		return NULL;
+PUBLIC FILE
+f_open(const path_t p)
+{
+	return path_open(p, false);
+}
+
+/**
+ *  Open a file and describe it by its file control parameters. Record
+ *  oriented files are described by record size and number of records. A
+ *  terminated file is opened as well, its content stays out of reach.
+ *
+ *  @return Handle of the opened file or 0 on failure.
+ */
+PUBLIC FILE
+f_info(const path_t p, struct i7_fcp *fcp)
+{
+	FILE  fd;
+	File  *file;
+	Inode *i;
+
+	if (!fcp) return 0;
+
+	fd = path_open(p, true);
+	if (!fd) return 0;
+
+	file = fd_lookup(fd);
+	i    = file->f_dentry->d_inode;
+
+	memset(fcp, 0, sizeof(*fcp));
+	fcp->fid = file->f_dentry->d_name;
+	fcp->fdb = i->i_fdb;
+	fcp->lcs = inode_lcs_get(i);
+
+	if (i7_stype(i->i_fdb) != TRANSPARENT) {
+		fcp->rsize  = i->i_size / i->i_sections;
+		fcp->rcount = i->i_sections;
+	} else {
+		fcp->size   = i->i_size;
 	}
 
 	return fd;
 }
 
 PUBLIC err_t
-f_close(FILE *fh)
+f_close(FILE fd)
 {
-	File  *f = fd_lookup(*fh);
-	Inode *i = f->f_dentry->d_inode;
+	File  *f = fd_lookup(fd);
+	Inode *i;
 	err_t err;
+	err_t push;
 
-	if (fh == NULL || f == NULL) return E_BADFD;
+	if (f == NULL) return E_BADFD;
+
+	i = f->f_dentry->d_inode;
+
+	/* the inode may stay cached, but changes must reach the device */
+	push = inode_push(i);
 
 	if (f->f_do->release) {
 		err = f->f_do->release(i, f);
@@ -216,10 +289,129 @@ f_close(FILE *fh)
 	dput(f->f_dentry);
 	fput(f);
 
-	/* this was allocated through f_create or f_open */
-	free(fh);
+	/* the handle is gone in any case */
+	return push;
+}
 
-	return E_GOOD;
+PUBLIC bool
+f_is_terminated(FILE fd)
+{
+	File *f = fd_lookup(fd);
+
+	return f && is_terminated(f->f_dentry);
+}
+
+/**
+ *  Compare the dentry of an open file with the one a path resolves to.
+ */
+PUBLIC bool
+f_is(FILE fd, const path_t p)
+{
+	File   *f = fd_lookup(fd);
+	Dentry *dentry;
+	bool   same;
+
+	if (f == NULL) return false;
+
+	if (smartfs_path_lookup(p, &dentry))
+		return false;
+
+	same = (dentry == f->f_dentry);
+	dput(dentry);
+
+	return same;
+}
+
+/**
+ *  Remove an EF or an empty DF. Open files can not be removed.
+ */
+PUBLIC err_t
+f_remove(const path_t p)
+{
+	Dentry *dentry;
+	err_t  err;
+
+	err = smartfs_path_lookup(p, &dentry);
+	if (err) return err;
+
+	err = dentry_unlink(dentry);
+	dput(dentry);
+
+	return err;
+}
+
+/**
+ *  Remove the file of an open handle. The handle is closed in any case.
+ */
+PUBLIC err_t
+f_unlink(FILE fd)
+{
+	File   *f = fd_lookup(fd);
+	Dentry *dentry;
+	err_t  err;
+
+	if (f == NULL) return E_BADFD;
+
+	dentry = f->f_dentry;
+
+	if (f->f_do->release)
+		f->f_do->release(dentry->d_inode, f);
+
+	/* the reference of the file goes over to the removal */
+	fput(f);
+
+	err = dentry_unlink(dentry);
+	if (err)
+		inode_push(dentry->d_inode);
+
+	dput(dentry);
+
+	return err;
+}
+
+/**
+ *  Set the life cycle status of an open file to terminated. The status is
+ *  written back at once, the file stays open.
+ */
+PUBLIC err_t
+f_terminate(FILE fd)
+{
+	File  *f = fd_lookup(fd);
+	Inode *i;
+
+	if (f == NULL) return E_BADFD;
+
+	i = f->f_dentry->d_inode;
+
+	inode_lcs_set(i, TERMINATION);
+	inode_mark_dirty(i);
+
+	return inode_push(i);
+}
+
+/**
+ *  Set the life cycle status of the current DF to activated. Personalization
+ *  of its tree is over, so its file system may summarize the tree for faster
+ *  lookups in later sessions.
+ */
+PUBLIC err_t
+df_activate(void)
+{
+	Dentry *d = current->df;
+	Inode  *i;
+	err_t  err;
+
+	if (d == NULL) return E_NOENT;
+
+	i = d->d_inode;
+
+	inode_lcs_set(i, OP_ACTIVED);
+	inode_mark_dirty(i);
+
+	err = inode_push(i);
+	if (err) return err;
+
+	return smartfs_snapshot(d->d_sb);
 }
 
 /**
@@ -228,9 +420,9 @@ f_close(FILE *fh)
  * @return size_t number of read bytes, or EOF
  */
 PUBLIC size_t
-f_read(void *dest, size_t mbytes, size_t nmemb, FILE *fd)
+f_read(void *dest, size_t mbytes, size_t nmemb, FILE fd)
 {
-	File *file = fd_lookup(*fd);
+	File *file = fd_lookup_content(fd);
 	size_t rbytes = 0;
 
 	if (file) {
@@ -240,56 +432,160 @@ f_read(void *dest, size_t mbytes, size_t nmemb, FILE *fd)
 	return rbytes;
 }
 
+/**
+ * Map some bytes to their location on a memory device.
+ *
+ * Only file systems with a direct device mapping support this operation.
+ *
+ * @return size_t number of contiguous bytes at '*addr', or EOF
+ */
+PUBLIC size_t
+f_map(FILE fd, size_t bytes, struct mem_dev **dev, u32 *addr)
+{
+	File *file;
+
+	file = fd_lookup_content(fd);
+
+	if (!file || !file->f_do->map) return EOF;
+
+	return file->f_do->map(file, bytes, dev, addr);
+}
+
 /**
  * Write some bytes :)
  *
  * @return size_t number of written bytes, or EOF ...
  */
 PUBLIC size_t
-f_write(const void *src, size_t mbytes, size_t nmemb, FILE *fd)
+f_write(const void *src, size_t mbytes, size_t nmemb, FILE fd)
 {
 	File *file;
 	size_t written = 0;
 
-	if (!fd) return 0;
-
-	file = fd_lookup(*fd);
+	file = fd_lookup_content(fd);
 
 	if (file) {
+		inode_tlv_drop(file->f_dentry->d_inode);
 		written = file->f_do->write(file, SRC(src), nmemb * mbytes);
 	}
 
 	return written;
 }
 
-PUBLIC err_t
-f_seek(FILE *fd, s32 offset, enum Seek_Whence whence)
+/**
+ * Transfer segments one by one through the plain read and write operations.
+ */
+PRIVATE size_t
+file_xferv(File *file, const struct f_seg *seg, u8 n, bool write)
 {
-	File *file;
+	size_t done = 0;
+	size_t bytes;
+
+	for ( ; n; n--, seg++) {
+		file->section = seg->section;
+		file->pos     = seg->offset;
 
-	CHECK_PARAM__NOT_NULL(fd);
+		if (write)
+			bytes = file->f_do->write(file, SRC(seg->buff), seg->len);
+		else
+			bytes = file->f_do->read(file, DEST(seg->buff), seg->len);
 
-	file = fd_lookup(*fd);
+		done += bytes;
+
+		if (bytes < seg->len)
+			break;
+	}
+
+	return done;
+}
+
+PUBLIC size_t
+f_readv(FILE fd, const struct f_seg *seg, u8 n)
+{
+	File *file = fd_lookup_content(fd);
+
+	if (!file || !seg) return 0;
+
+	if (file->f_do->readv)
+		return file->f_do->readv(file, seg, n);
+
+	return file_xferv(file, seg, n, false);
+}
+
+PUBLIC size_t
+f_writev(FILE fd, const struct f_seg *seg, u8 n)
+{
+	File *file = fd_lookup_content(fd);
+
+	if (!file || !seg) return 0;
+
+	inode_tlv_drop(file->f_dentry->d_inode);
+
+	if (file->f_do->writev)
+		return file->f_do->writev(file, seg, n);
+
+	return file_xferv(file, seg, n, true);
+}
+
+/**
+ * Move the byte offset within the current section.
+ *
+ * Offsets relative to SEEK_END refer to the bytes in use of a section. Any new
+ * position has to stay within the section capacity.
+ */
+PUBLIC err_t
+f_seek(FILE fd, s32 offset, enum Seek_Whence whence)
+{
+	File  *file;
+	Inode *i;
+	struct section_map *smap;
+	s32   pos;
+	u16   max;
+
+	file = fd_lookup(fd);
 
 	if (!file) return E_BADF;
 
-	// FIXME!!
-#	warning fseek offset parameter has not been validated!
-	file->pos = offset;
+	i = file->f_dentry->d_inode;
+
+	if (file->section >= i->i_sections)
+		return E_RANGE;
+
+	/* all sections of a file share the same size */
+	max = i->i_size / i->i_sections;
+
+	switch (whence) {
+	case SEEK_SET:
+		pos = offset;
+		break;
+	case SEEK_CUR:
+		pos = file->pos + offset;
+		break;
+	case SEEK_END:
+		smap = inode_smap(i, file->section);
+		if (!smap) return E_FS;
+		pos = smap->length + offset;
+		break;
+	default:
+		return E_BAD_PARAM;
+	}
+
+	if (pos < 0 || pos > max)
+		return E_RANGE;
+
+	file->pos = pos;
 
 	return E_GOOD;
 }
 
 PUBLIC err_t
-f_seeks(FILE *fd, s16 sjump, enum Seek_Whence whence)
+f_seeks(FILE fd, s16 sjump, enum Seek_Whence whence)
 {
 	File *file;
 	s32  sec;
 	u16  max;
 
-	CHECK_PARAM__NOT_NULL(fd);
-
-	file = fd_lookup(*fd);
+	file = fd_lookup(fd);
 
 	if (!file) return E_BADF;
 
@@ -302,6 +598,7 @@ f_seeks(FILE *fd, s16 sjump, enum Seek_Whence whence)
 		break;
 	case SEEK_END:
 		sec = max + sjump;
+		break;
 	case SEEK_SET:
 		sec = sjump;
 		break;
@@ -316,3 +613,92 @@ f_seeks(FILE *fd, s16 sjump, enum Seek_Whence whence)
 
 	return E_GOOD;
 }
+
+PUBLIC u8
+f_tells(FILE fd)
+{
+	File *file;
+
+	file = fd_lookup(fd);
+
+	return file ? file->section : 0;
+}
+
+PUBLIC u16
+f_tell(FILE fd)
+{
+	File *file;
+
+	file = fd_lookup(fd);
+
+	return file ? file->pos : 0;
+}
+
+PRIVATE u32
+file_tlv_read(void *src, u32 offset, u8 *buff, u32 n)
+{
+	File *file = src;
+
+	file->pos = offset;
+
+	return file->f_do->read(file, DEST(buff), n);
+}
+
+/**
+ * Position the file at the value of the object found.
+ *
+ * @return E_NOENT if there is no such object, E_FS_TERM for a terminated file,
+ *         any index error otherwise.
+ */
+PUBLIC err_t
+f_tlv_find(FILE fd, const u32 *path, u8 depth, u32 *length)
+{
+	const struct tlv_index_entry *e;
+	File  *file;
+	Inode *i;
+	struct section_map *smap;
+	u16   pos;
+	u8    section;
+	err_t err;
+
+	CHECK_PARAM__NOT_NULL(path);
+
+	file = fd_lookup(fd);
+
+	if (!file) return E_BADF;
+
+	if (is_terminated(file->f_dentry)) return E_FS_TERM;
+
+	i = file->f_dentry->d_inode;
+
+	/* a record structure holds no single TLV structure */
+	if (i->i_sections != 1) return E_FS;
+
+	if (!i->i_tlv) {
+		smap = inode_smap(i, 0);
+		if (!smap) return E_FS;
+
+		pos     = file->pos;
+		section = file->section;
+
+		file->section = 0;
+		err = inode_tlv_index(i, file_tlv_read, file,
+		                      smap->length);
+
+		file->pos     = pos;
+		file->section = section;
+
+		if (err) return err;
+	}
+
+	e = tlv_index_find(i->i_tlv, path, depth);
+
+	if (!e) return E_NOENT;
+
+	file->section = 0;
+	file->pos     = e->offset;
+
+	if (length) *length = e->length;
+
+	return E_GOOD;
+}
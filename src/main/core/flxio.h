@@ -26,8 +26,25 @@
 
 #pragma once
 
+/**
+ * A file handle is a plain value naming an open file object. Zero is never a
+ * valid handle, and a handle turns invalid as soon as its file is closed.
+ */
 typedef u32 FILE;
 
+struct mem_dev;
+
+/**
+ * A part of a file transferred by f_readv or f_writev: 'len' bytes at byte
+ * 'offset' of a section, to or from 'buff'.
+ */
+struct f_seg {
+	u8     section;
+	u16    offset;
+	u16    len;
+	u8     *buff;
+};
+
 
 /**
  *  Structural representation of ISO 7816-4 File Control Parameters.
@@ -54,39 +71,89 @@ enum Seek_Whence {
 	SEEK_END = 0x02
 };
 
-FILE * f_open(const path_t);
+/**
+ *  Open a file, which must not be terminated. Reading and writing the content
+ *  of a file terminated later on fails.
+ */
+FILE  f_open(const path_t);
 
-FILE * k_open(const path_t);
+FILE  k_open(const path_t);
 
-FILE * f_info(const path_t, struct i7_fcp *);
+/**
+ *  Open a file and fill its file control parameters.
+ */
+FILE  f_info(const path_t, struct i7_fcp *);
 
-FILE * f_create(struct i7_fcp *);
+FILE  f_create(struct i7_fcp *);
 
-err_t f_close(FILE *);
+/**
+ *  Close a file and write back pending changes of it. The handle is invalid
+ *  afterwards, even if writing back failed.
+ */
+err_t f_close(FILE);
+/**
+ *  Tell if an open handle refers to the file at a path.
+ */
+bool  f_is(FILE, const path_t);
+/**
+ *  Tell if the life cycle of an open file is terminated.
+ */
+bool  f_is_terminated(FILE);
 
 err_t f_remove(const path_t);
+/**
+ *  Remove the file of an open handle, which is closed.
+ */
+err_t f_unlink(FILE);
+/**
+ *  Terminate the life cycle of an open file.
+ */
+err_t f_terminate(FILE);
+/**
+ *  Activate the current DF at the end of its personalization.
+ */
+err_t df_activate(void);
 
-size_t f_write(const void *, size_t, size_t, FILE *);
+size_t f_write(const void *, size_t, size_t, FILE);
 /**
  *  Seek position within current record.
  */
-err_t f_seek(FILE *, s32, enum Seek_Whence);
+err_t f_seek(FILE, s32, enum Seek_Whence);
 /**
  *  Seek to start of a specific section within file.
  */
-err_t f_seeks(FILE *, s16, enum Seek_Whence);
+err_t f_seeks(FILE, s16, enum Seek_Whence);
 /**
  *  Tell active section ID
  */
-u8    f_tells(FILE *);
+u8    f_tells(FILE);
 /**
  *  Tell byte offset within active record
  */
-u16   f_tell(FILE *);
+u16   f_tell(FILE);
 /**
  *  Generic read for any file type.
  */
-size_t f_read(void *, size_t, size_t, FILE *);
+size_t f_read(void *, size_t, size_t, FILE);
+/**
+ *  Locate bytes at current position on their memory device instead of reading
+ *  them.
+ */
+size_t f_map(FILE, size_t, struct mem_dev **, u32 *);
+/**
+ *  Read or write a list of segments with a single handle lookup. The transfer
+ *  ends with the first segment, that could not be transferred completely. The
+ *  file is positioned behind the last byte transferred.
+ *
+ *  @return number of bytes transferred
+ */
+size_t f_readv(FILE, const struct f_seg *, u8);
+size_t f_writev(FILE, const struct f_seg *, u8);
+/**
+ *  Seek to the value of a BER-TLV object of a transparent EF by its tag path.
+ *  An index of the file content is built on first access.
+ */
+err_t f_tlv_find(FILE, const u32 *path, u8 depth, u32 *length);
 
 err_t ch_df_by_path(const path_t);
 
@@ -51,9 +51,25 @@ file_free(File *f)
 	return fpool_put(f);
 }
 
+/**
+ * Descriptors carry the pool index of their file object in the low byte and
+ * the generation of that slot above it. The generation advances on every
+ * fput(), so a descriptor kept beyond its f_close() does not resolve to the
+ * next file opened in the same slot.
+ */
+#define FD_SLOT_BITS  8
+#define FD_SLOT_MASK  ((1 << FD_SLOT_BITS) - 1)
+
+PRIVATE u16 fgen[FPOOL_SIZE];
+
 PUBLIC err_t
 fput(File *f)
 {
+	u32 id = fpool_id(f);
+
+	if (id && fpool_lookup(id))
+		fgen[id - 1]++;
+
 	return file_free(f);
 }
 
@@ -63,8 +79,27 @@ fget()
 	return file_alloc();
 }
 
-File * fd_lookup(u32 id) { return fpool_lookup(id); }
-u32    fd_get(File *f)   { return fpool_id(f); }
+PUBLIC File *
+fd_lookup(u32 fd)
+{
+	u32 id = fd & FD_SLOT_MASK;
+
+	if (!id || id > LENGTH(fgen)) return NULL;
+
+	if ((fd >> FD_SLOT_BITS) != fgen[id - 1]) return NULL;
+
+	return fpool_lookup(id);
+}
+
+PUBLIC u32
+fd_get(File *f)
+{
+	u32 id = fpool_id(f);
+
+	if (!id) return 0;
+
+	return ((u32) fgen[id - 1] << FD_SLOT_BITS) | id;
+}
 
 /** Default shortcut: redirect to super operations */
 PUBLIC err_t
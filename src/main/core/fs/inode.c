@@ -27,11 +27,37 @@
 #include <flxlib.h>
 #include <io/dev.h>
 #include <mm/pool.h>
+#include <common/list.h>
+#include <tlv.h>
 
 #include "pools.h"
 #include "smartfs.h"
 
 
+/* ===== Local Variables ==================================================== */
+
+/**
+ *  BER-TLV indexes are shared by all inodes. If all of them are in use, the
+ *  least recently built one is taken over.
+ */
+PRIVATE struct tlv_slot {
+	struct tlv_index       index;
+	struct tlv_index_entry entry[FS_TLV_INDEX_ENTRIES];
+	Inode                  *owner;
+} tlv_slots[FS_MAX_TLV_INDEXES];
+
+PRIVATE u8 tlv_victim;
+
+/**
+ *  Inodes are cached by (super, ino) as long as they are in memory. Unused
+ *  ones, which have been read before, are queued on inode_lru, the least
+ *  recently used one first.
+ */
+PRIVATE struct list_head inode_hashtable[FS_ICACHE_BUCKETS];
+PRIVATE struct list_head inode_lru;
+
+PRIVATE bool inode_prune(void);
+
 /* ===== Local Functions ==================================================== */
 PRIVATE err_t
 inode_init_always(Super *s, Inode *inode)
@@ -45,6 +71,11 @@ inode_init_always(Super *s, Inode *inode)
 	inode->i_fdo = &empty_f_do;
 	inode->i_flags = 0;
 	inode->i_count = 1;
+	inode->i_tlv   = NULL;
+	inode->i_smap_first = 0;
+	inode->i_smap_count = 0;
+	INIT_LIST_HEAD(&inode->i_hash);
+	INIT_LIST_HEAD(&inode->i_lru);
 
 	inode->__i_nlink = 1;
 
@@ -63,10 +94,13 @@ inode_alloc(Super *s)
 {
 	Inode *inew;
 
-	if (s->s_do->alloc_inode)
-		inew = s->s_do->alloc_inode(s);
-	else
-		inew = ipool_get();
+	/* unused cached inodes or dentries may hold the last inodes */
+	do {
+		if (s->s_do->alloc_inode)
+			inew = s->s_do->alloc_inode(s);
+		else
+			inew = ipool_get();
+	} while (!inew && (inode_prune() || dcache_prune()));
 
 	if (!inew)
 		return NULL;
@@ -95,7 +129,7 @@ inc_count(Inode *i)
 	++i->i_count;
 }
 
-PRIVATE inline u8
+PUBLIC u8
 drop_nlink(Inode *i)
 {
 	return --(i->__i_nlink);
@@ -108,11 +142,104 @@ inc_nlink(Inode *i)
 }
 
 /**
- * There is no inode cache right now.
+ * Inode numbers are unique per super object only. Supers are array elements,
+ * so their address divided by their size tells mounted file systems apart.
+ */
+PRIVATE inline struct list_head *
+i_hash(const Super *super, u32 ino)
+{
+	u32 h = ino + 31 * (u32) ((size_t) super / sizeof(*super));
+
+	return &inode_hashtable[(h ^ (h >> 8)) % FS_ICACHE_BUCKETS];
+}
+
+/**
+ * Inodes not taken from inode_alloc() have never been linked.
+ */
+PRIVATE inline void
+i_unlink(Inode *i)
+{
+	if (i->i_hash.next)
+		list_del_init(&i->i_hash);
+	if (i->i_lru.next)
+		list_del_init(&i->i_lru);
+}
+
+/**
+ * Release the least recently used inode of the cache.
+ */
+PRIVATE bool
+inode_prune(void)
+{
+	if (list_empty(&inode_lru))
+		return false;
+
+	destroy_inode(list_first_entry(&inode_lru, Inode, i_lru));
+
+	return true;
+}
+
+/**
+ * Set up an empty inode cache.
+ *
+ * Inodes still cached from a former mount are destroyed, so that file systems
+ * release their resources. Their super objects have to be valid yet.
+ */
+PUBLIC void
+icache_init(void)
+{
+	struct list_head *bucket;
+	Inode *i, *next;
+
+	for_each(bucket, inode_hashtable, LENGTH(inode_hashtable)) {
+		/* the cache has never been initialized */
+		if (!bucket->next) break;
+
+		list_for_each_entry_safe(i, next, bucket, i_hash)
+			destroy_inode(i);
+	}
+
+	for_each(bucket, inode_hashtable, LENGTH(inode_hashtable))
+		INIT_LIST_HEAD(bucket);
+
+	INIT_LIST_HEAD(&inode_lru);
+}
+
+/**
+ * Destroy the cached inodes of a super, which is going to be released. None
+ * of them may be in use.
+ */
+PUBLIC void
+icache_forget(const Super *super)
+{
+	struct list_head *bucket;
+	Inode *i, *next;
+
+	for_each(bucket, inode_hashtable, LENGTH(inode_hashtable)) {
+		list_for_each_entry_safe(i, next, bucket, i_hash) {
+			if (i->i_super == super)
+				destroy_inode(i);
+		}
+	}
+}
+
+/**
+ * Look for an inode in memory. An unused inode is taken from the LRU list.
+ * The caller has to increment usage count.
  */
 PUBLIC Inode *
 inode_find(Super *super, u32 ino)
 {
+	Inode *i;
+
+	list_for_each_entry(i, i_hash(super, ino), i_hash) {
+		if (i->i_super != super || i->i_ino != ino)
+			continue;
+
+		list_del_init(&i->i_lru);
+		return i;
+	}
+
 	return NULL;
 }
 
@@ -147,6 +274,9 @@ destroy_inode(Inode *i)
 {
 	const struct super_does *super_do = i->i_super->s_do;
 
+	i_unlink(i);
+	inode_tlv_drop(i);
+
 	if (super_do->destroy_inode)
 		super_do->destroy_inode(i);
 	else
@@ -158,8 +288,8 @@ destroy_inode(Inode *i)
  * Drop an inode usage.
  *
  * If it becomes unused, call the file system drop method. If it wants the inode
- * to be deleted from disk, just do so. Alternatively we only delete the inode
- * structure itself. There is no caching of unused inodes, yet.
+ * to be deleted from disk, just do so. An inode that has never been read is
+ * deleted from memory. Any other is written back and stays cached.
  */
 PUBLIC void
 iput(Inode *i)
@@ -177,8 +307,12 @@ iput(Inode *i)
 
 	if (drop)
 		evict(i);
-	else
+	else if (i->i_state & I_NEW)
 		destroy_inode(i);
+	else {
+		inode_push(i);
+		list_add_tail(&i->i_lru, &inode_lru);
+	}
 }
 
 /**
@@ -206,7 +340,7 @@ iget(Super *super, u32 ino)
 	if (inode) {
 		inode->i_state = I_NEW;
 		inode->i_ino   = ino;
-		// XXX put it into a cache
+		list_add(&inode->i_hash, i_hash(super, ino));
 	}
 
 	return inode;
@@ -214,6 +348,9 @@ iget(Super *super, u32 ino)
 
 
 
+/**
+ * Read the header of an inode. Its section map is left to inode_smap().
+ */
 PUBLIC err_t
 inode_pull(Inode *inode)
 {
@@ -221,6 +358,10 @@ inode_pull(Inode *inode)
 	const struct super_does *super_do = inode->i_super->s_do;
 	const struct inode_does *inode_do = inode->i_do;
 
+	/* a cached inode is up to date */
+	if (!(inode->i_state & I_NEW))
+		return E_GOOD;
+
 	if (inode_do->read)
 		err = inode_do->read(inode);
 	else
@@ -228,20 +369,140 @@ inode_pull(Inode *inode)
 
 	if (err) return err;
 
-	/* well we have pulled basic file information. now lets do some ugly
-	 * stuff and allocate an array and read complete 'section map'
-	 * For each section there should exist one section_map upon file
-	 * creation that holds section utilization and the data location. */
-	inode->i_smap = malloc(inode_smap_size(inode));
+	inode->i_smap_count = 0;
+	inode->i_state &= ~I_NEW;
 
-	if (!inode->i_smap)
-		return E_NOMEM;
+	return E_GOOD;
+}
 
-	err = mdev_read(inode->i_mdev,
-	                inode->i_smap_loc,
-		        inode_smap_size(inode),
-		        DEST(inode->i_smap));
+PRIVATE inline laddr_t
+smap_addr(const Inode *inode, u8 sec)
+{
+	return inode->i_smap_loc + sec * sizeof(struct section_map);
+}
+
+PRIVATE err_t
+smap_flush(Inode *inode)
+{
+	err_t err;
+
+	if (!(inode->i_state & I_SMAP_DIRTY))
+		return E_GOOD;
+
+	err = mdev_write(inode->i_mdev,
+	                 smap_addr(inode, inode->i_smap_first),
+	                 inode->i_smap_count * sizeof(struct section_map),
+	                 SRC(inode->i_smap));
+	if (err) return err;
+
+	inode->i_state &= ~I_SMAP_DIRTY;
+
+	return E_GOOD;
+}
+
+PUBLIC struct section_map *
+inode_smap(Inode *inode, u8 sec)
+{
+	u8 first;
+	u8 count;
+
+	if (sec >= inode->i_sections)
+		return NULL;
+
+	if (sec >= inode->i_smap_first
+	&&  sec <  inode->i_smap_first + inode->i_smap_count)
+		return &inode->i_smap[sec - inode->i_smap_first];
+
+	/* changes of the current window must not get lost */
+	if (smap_flush(inode))
+		return NULL;
+
+	first = sec - (sec % FS_SMAP_WINDOW);
+	count = MIN(FS_SMAP_WINDOW, inode->i_sections - first);
+
+	inode->i_smap_count = 0;
+
+	if (mdev_read(inode->i_mdev,
+	              smap_addr(inode, first),
+	              count * sizeof(struct section_map),
+	              DEST(inode->i_smap)))
+		return NULL;
+
+	inode->i_smap_first = first;
+	inode->i_smap_count = count;
+
+	return &inode->i_smap[sec - first];
+}
+
+PUBLIC err_t
+inode_push(Inode *inode)
+{
+	err_t err;
+	const struct super_does *super_do = inode->i_super->s_do;
+	const struct inode_does *inode_do = inode->i_do;
+
+	if (inode->i_state & I_DIRTY) {
+		if (inode_do->write)
+			err = inode_do->write(inode);
+		else if (super_do->write_inode)
+			err = super_do->write_inode(inode);
+		else
+			err = E_GOOD;
+
+		if (err) return err;
+
+		inode->i_state &= ~I_DIRTY;
+	}
+
+	return smap_flush(inode);
+}
 
-	return err;
+PRIVATE inline bool
+tlv_slot_used(const struct tlv_slot *slot)
+{
+	return slot->owner && slot->owner->i_tlv == &slot->index;
 }
 
+PUBLIC err_t
+inode_tlv_index(Inode *i, u32 (*read)(void *, u32, u8 *, u32),
+                void *src, u32 length)
+{
+	struct tlv_slot *slot;
+	err_t err;
+
+	if (i->i_tlv) return E_GOOD;
+
+	for_each(slot, tlv_slots, LENGTH(tlv_slots)) {
+		if (!tlv_slot_used(slot)) break;
+	}
+
+	if (slot == tlv_slots + LENGTH(tlv_slots)) {
+		slot = &tlv_slots[tlv_victim];
+		tlv_victim = (tlv_victim + 1) % LENGTH(tlv_slots);
+
+		inode_tlv_drop(slot->owner);
+	}
+
+	slot->index.entry = slot->entry;
+	slot->index.max   = LENGTH(slot->entry);
+
+	err = tlv_index_build(&slot->index, read, src, length);
+	if (err) return err;
+
+	slot->owner = i;
+	i->i_tlv    = &slot->index;
+
+	return E_GOOD;
+}
+
+PUBLIC void
+inode_tlv_drop(Inode *i)
+{
+	struct tlv_slot *slot;
+
+	if (!i->i_tlv) return;
+
+	slot = container_of(i->i_tlv, struct tlv_slot, index);
+	slot->owner = NULL;
+	i->i_tlv    = NULL;
+}
@@ -36,30 +36,40 @@ PRIVATE Inode  iarr[IPOOL_SIZE] = {{0}};
 PRIVATE Dentry darr[DPOOL_SIZE] = {{0}};
 PRIVATE File   farr[FPOOL_SIZE] = {{0}};
 
-PRIVATE u8     iarr_usage_mask[IPOOL_SIZE/8] = {0};
-PRIVATE u8     darr_usage_mask[DPOOL_SIZE/8] = {0};
-PRIVATE u8     farr_usage_mask[FPOOL_SIZE/8] = {0};
+PRIVATE u8     iarr_usage_mask[(IPOOL_SIZE + 7)/8] = {0};
+PRIVATE u8     darr_usage_mask[(DPOOL_SIZE + 7)/8] = {0};
+PRIVATE u8     farr_usage_mask[(FPOOL_SIZE + 7)/8] = {0};
+
+PRIVATE u16    iarr_free[IPOOL_SIZE];
+PRIVATE u16    darr_free[DPOOL_SIZE];
+PRIVATE u16    farr_free[FPOOL_SIZE];
 
 /* FIXME rename: this is not a cache */
 PRIVATE struct pool __ipool = {
 		.n     = LENGTH(iarr),
 		.msize = sizeof(Inode),
 		.memb  = iarr,
-		.usage = iarr_usage_mask
+		.usage = iarr_usage_mask,
+		.free  = iarr_free,
+		.flags = POOL_SANITIZE
 };
 
 PRIVATE struct pool __dpool = {
 		.n = LENGTH(darr),
 		.msize = sizeof(Dentry),
 		.memb  = darr,
-		.usage = darr_usage_mask
+		.usage = darr_usage_mask,
+		.free  = darr_free,
+		.flags = POOL_SANITIZE
 };
 
 PRIVATE struct pool __fpool = {
 		.n = LENGTH(farr),
 		.msize = sizeof(File),
 		.memb  = farr,
-		.usage = farr_usage_mask
+		.usage = farr_usage_mask,
+		.free  = farr_free,
+		.flags = POOL_SANITIZE
 };
 
 PUBLIC struct pool *const ipool = &__ipool;
@@ -32,15 +32,6 @@ enum POOLS {
 	FPOOL_SIZE = FS_MAX_ACTIVE_FILES
 };
 
-/* compile time checks */
-#ifdef DEBUG
-struct __check_pool_size {
-	u8 ipool_size[0 - FPOOL_SIZE%8];
-	u8 dpool_size[0 - DPOOL_SIZE%8];
-	u8 fpool_size[0 - IPOOL_SIZE%8];
-}
-#endif
-
 struct pool;
 struct inode;
 struct dentry;
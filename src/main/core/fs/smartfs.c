@@ -31,23 +31,221 @@
 
 #include <mm/pool.h>
 #include <io/dev.h>
+#include <common/list.h>
 
 #include "path.h"
 #include "pools.h"
 #include "smartfs.h"
 
-PRIVATE Super  single_super;
 PUBLIC struct fs_mount mnt = {0};
 
+/**
+ *  There is no allocator for struct super objects. The first one belongs to
+ *  the root mount, any other one to the mount of the same index.
+ */
+PRIVATE Super  supers[1 + FS_MAX_MOUNTS];
+PRIVATE struct fs_mount mounts[FS_MAX_MOUNTS];
+
+PRIVATE const struct fs_type *fs_types[FS_MAX_TYPES];
+
+/**
+ *  The dentry cache keeps looked up names, found or not, until their pool
+ *  slots are needed again. Unused dentries are queued on dentry_lru, the
+ *  least recently used one first.
+ */
+PRIVATE struct list_head dentry_hashtable[FS_DCACHE_BUCKETS];
+PRIVATE struct list_head dentry_lru;
+
+/**
+ *  Resolved paths are memoized by their start directory and FIDs. An entry
+ *  holds as long as its dentry is cached and the directory containing it has
+ *  not changed since, see d_gen.
+ */
+PRIVATE struct path_cache_entry {
+	const Dentry *start;
+	fid_t        path[MAX_PATH_DEPTH];
+	Dentry       *dentry;
+	u16          gen;
+} path_cache[FS_PATH_CACHE_SIZE];
+
+PRIVATE void dentry_release(Dentry *);
+
+PRIVATE void
+dcache_init(void)
+{
+	struct list_head *bucket;
+
+	for_each(bucket, dentry_hashtable, LENGTH(dentry_hashtable))
+		INIT_LIST_HEAD(bucket);
+
+	INIT_LIST_HEAD(&dentry_lru);
+
+	memset(path_cache, 0x00, sizeof(path_cache));
+}
+
+PRIVATE inline struct list_head *
+d_hash(const Dentry *dir, fid_t name)
+{
+	u32 h = dpool_id(dir) * 31 + name;
+
+	return &dentry_hashtable[(h ^ (h >> 8)) % FS_DCACHE_BUCKETS];
+}
+
+/**
+ * Dentries not taken from dentry_alloc() have never been linked.
+ */
+PRIVATE inline bool
+d_unhashed(const Dentry *d)
+{
+	return !d->d_hash.next || list_empty(&d->d_hash);
+}
+
+PRIVATE inline bool
+d_unused(const Dentry *d)
+{
+	return d->d_lru.next && !list_empty(&d->d_lru);
+}
+
+PRIVATE void
+d_add(Dentry *dir, Dentry *d)
+{
+	d->d_parent = dir;
+	list_add(&d->d_hash, d_hash(dir, d->d_name));
+}
+
+PRIVATE Dentry *
+d_lookup(const Dentry *dir, fid_t name)
+{
+	Dentry *d;
+
+	list_for_each_entry(d, d_hash(dir, name), d_hash) {
+		if (d->d_parent == dir && d->d_name == name)
+			return d;
+	}
+
+	return NULL;
+}
+
+PRIVATE inline void
+dget(Dentry *d)
+{
+	if (d_unused(d))
+		list_del_init(&d->d_lru);
+
+	d->d_count++;
+}
+
+/**
+ * Copy a relative path into a fixed size key.
+ *
+ * @return false, if the path is empty or too long to be cached
+ */
+PRIVATE bool
+path_pack(const path_t p, fid_t packed[MAX_PATH_DEPTH])
+{
+	u8 i;
+
+	memset(packed, 0x00, MAX_PATH_DEPTH * sizeof(*packed));
+
+	for (i = 0; i < MAX_PATH_DEPTH && p[i] != EOP; i++)
+		packed[i] = p[i];
+
+	return i && (i < MAX_PATH_DEPTH || p[i] == EOP);
+}
+
+PRIVATE struct path_cache_entry *
+path_cache_slot(const Dentry *start, const fid_t packed[MAX_PATH_DEPTH])
+{
+	u32 h = dpool_id(start);
+	u8  i;
+
+	for (i = 0; i < MAX_PATH_DEPTH; i++)
+		h = h * 31 + packed[i];
+
+	return &path_cache[(h ^ (h >> 16)) % FS_PATH_CACHE_SIZE];
+}
+
+PRIVATE bool
+path_cache_valid(const struct path_cache_entry *e, const Dentry *start,
+                 const fid_t packed[MAX_PATH_DEPTH])
+{
+	return e->dentry
+	    && e->start == start
+	    && !memcmp(e->path, packed, sizeof(e->path))
+	    /* a hashed dentry has a cached parent */
+	    && !d_unhashed(e->dentry)
+	    && e->gen == e->dentry->d_parent->d_gen;
+}
+
+/**
+ * Forget any resolved path starting or ending at a released dentry.
+ */
+PRIVATE void
+path_cache_forget(const Dentry *d)
+{
+	struct path_cache_entry *e;
+
+	for_each(e, path_cache, LENGTH(path_cache)) {
+		if (e->start == d || e->dentry == d)
+			memset(e, 0x00, sizeof(*e));
+	}
+}
+
+/**
+ * Unhash all cached names of a directory, that is going to be released. Its
+ * pool slot may be reused by another directory, which must not see them.
+ */
+PRIVATE void
+d_forget_children(const Dentry *dir)
+{
+	struct list_head *bucket;
+	Dentry *d;
+
+restart:
+	for_each(bucket, dentry_hashtable, LENGTH(dentry_hashtable)) {
+		list_for_each_entry(d, bucket, d_hash) {
+			if (d->d_parent != dir) continue;
+
+			list_del_init(&d->d_hash);
+			d->d_parent = NULL;
+
+			/* releasing d may unhash further entries */
+			if (!d->d_count)
+				dentry_release(d);
+
+			goto restart;
+		}
+	}
+}
+
+PUBLIC bool
+dcache_prune(void)
+{
+	if (list_empty(&dentry_lru))
+		return false;
+
+	dentry_release(list_first_entry(&dentry_lru, Dentry, d_lru));
+
+	return true;
+}
+
 PRIVATE Dentry *
 dentry_alloc(Super *super, fid_t name) {
 	Dentry *dentry = dpool_get();
 
+	/* reclaim unused cached dentries */
+	while (!dentry && dcache_prune())
+		dentry = dpool_get();
+
 	if (dentry) {
-		dentry->d_name  = name;
-		dentry->d_inode = NULL;
-		dentry->d_count = 1;
-		dentry->d_sb    = super;
+		dentry->d_name   = name;
+		dentry->d_inode  = NULL;
+		dentry->d_count  = 1;
+		dentry->d_sb     = super;
+		dentry->d_parent = NULL;
+		dentry->d_gen    = 0;
+		INIT_LIST_HEAD(&dentry->d_hash);
+		INIT_LIST_HEAD(&dentry->d_lru);
 	}
 
 	return dentry;
@@ -99,58 +297,246 @@ dentry_detach(Dentry *d)
 }
 
 PUBLIC err_t
-smartfs_mount_root( MemDev *mdev, fp_do_mount do_mount )
+register_filesystem(const struct fs_type *type)
+{
+	const struct fs_type **t;
+	const struct fs_type *known;
+
+	CHECK_PARAM__NOT_NULL(type);
+	CHECK_PARAM__NOT_NULL(type->name);
+	CHECK_PARAM__NOT_NULL(type->mount);
+
+	known = get_fs_type(type->name);
+	if (known)
+		return known == type ? E_GOOD : E_EXIST;
+
+	for_each(t, fs_types, LENGTH(fs_types)) {
+		if (!*t) {
+			*t = type;
+			return E_GOOD;
+		}
+	}
+
+	return E_NOMEM;
+}
+
+PUBLIC const struct fs_type *
+get_fs_type(const char *name)
+{
+	const struct fs_type **t;
+
+	for_each(t, fs_types, LENGTH(fs_types)) {
+		if (*t && !strcmp((*t)->name, name))
+			return *t;
+	}
+
+	return NULL;
+}
+
+/**
+ * Release the file system context of a super. Its inodes have to be gone.
+ */
+PRIVATE void
+kill_super(Super *s)
 {
+	if (s->s_do && s->s_do->put_super)
+		s->s_do->put_super(s);
+
+	memset(s, 0x00, sizeof(*s));
+}
+
+PRIVATE void
+mounts_init(void)
+{
+	Super *s;
+
+	for_each(s, supers, LENGTH(supers))
+		kill_super(s);
+
+	memset(mounts, 0x00, sizeof(mounts));
+}
+
+PUBLIC err_t
+smartfs_mount_root( MemDev *mdev, const char *fstype )
+{
+	const struct fs_type *type = get_fs_type(fstype);
 	err_t err;
 
-	/* there is no allocator for struct super objects. */
-	mnt.super = &single_super;
+	if (!type) return E_NOENT;
+
+	/* objects of a former root mount are released */
+	smartfs_reset();
+	mnt.super  = &supers[0];
+	mnt.dmount = NULL;
 	mnt.droot = dentry_alloc(mnt.super, MF);
-	// XXX clean objects
+	if (!mnt.droot) return E_NOMEM;
 
-	err = do_mount(mdev, &mnt);
+	err = type->mount(mdev, &mnt);
 	if (err)
 		return E_INTERN | err;
 
+	mnt.super->s_type = type;
 	current->df = mnt.droot;
 
 	return E_GOOD;
 }
 
+/**
+ * Drop the references a mount holds on a DF and its parents.
+ */
+PRIVATE void
+d_unpin(Dentry *d)
+{
+	Dentry *parent;
 
+	while (d) {
+		parent = d->d_parent;
+		dput(d);
+		d = parent;
+	}
+}
 
+PUBLIC err_t
+smartfs_mount( const path_t path, MemDev *mdev, const char *fstype )
+{
+	const struct fs_type *type = get_fs_type(fstype);
+	struct fs_mount *m;
+	Dentry *dir, *d;
+	path_t tmp_path;
+	fid_t  name, next_fid;
+	err_t  err;
+
+	CHECK_PARAM__NOT_NULL(path);
+	CHECK_PARAM__NOT_NULL(mdev);
+
+	if (!type) return E_NOENT;
+
+	if (!path_is_absolute(path)) return E_BAD_PARAM;
+
+	for_each(m, mounts, LENGTH(mounts)) {
+		if (!m->super) break;
+	}
+
+	if (m == mounts + LENGTH(mounts)) return E_BUSY;
+
+	tmp_path = ptail(path);
+	name = pwalk(&tmp_path);
+
+	/* the MF is the root mount */
+	if (!name) return E_BAD_PARAM;
+
+	/* each DF on the way keeps the reference taken here */
+	dir = mnt.droot;
+	dget(dir);
+
+	while ((next_fid = pwalk(&tmp_path))) {
+		d = dentry_lookup(dir, name);
+		if (!d) {
+			d_unpin(dir);
+			return E_NOENT;
+		}
+
+		dir  = d;
+		name = next_fid;
+	}
+
+	if (i7_ftype(dir->d_inode->i_fdb) != DF) {
+		d_unpin(dir);
+		return E_FS;
+	}
+
+	d = dentry_lookup(dir, name);
+	if (d) {
+		dput(d);
+		d_unpin(dir);
+		return E_EXIST;
+	}
+
+	m->super = &supers[1 + (m - mounts)];
+	memset(m->super, 0x00, sizeof(*m->super));
+
+	m->droot = dentry_alloc(m->super, name);
+	if (!m->droot) {
+		m->super = NULL;
+		d_unpin(dir);
+		return E_NOMEM;
+	}
+
+	err = type->mount(mdev, m);
+	if (err) {
+		dentry_free(m->droot);
+		m->droot = NULL;
+		m->super = NULL;
+		d_unpin(dir);
+		return E_INTERN | err;
+	}
+
+	m->super->s_type = type;
+	m->dmount = dir;
+
+	/* the root dentry replaces the negative one and is never released */
+	d = d_lookup(dir, name);
+	if (d && !d->d_inode)
+		dentry_release(d);
+
+	d_add(dir, m->droot);
+	dir->d_gen++;
+
+	return E_GOOD;
+}
+
+
+
+/**
+ * Remove a dentry from the cache and free it. Cached names below it are
+ * forgotten.
+ */
 PRIVATE void
 dentry_release(Dentry *d)
 {
-	// XXX remove dentry from cache, or introduce a flag that forces us to
-	// lookup the dentry next time
+	if (d->d_hash.next)
+		list_del_init(&d->d_hash);
+	if (d->d_lru.next)
+		list_del_init(&d->d_lru);
 
-	dentry_iput(d);
+	d_forget_children(d);
+	path_cache_forget(d);
 
-	// FIXME the cache should release resources
+	dentry_iput(d);
 	dentry_free(d);
 
 	return;
 }
 
+/**
+ * Drop a dentry usage. A cached dentry is kept as least recently used, all
+ * others are released.
+ */
 PUBLIC void
 dput(Dentry *dentry)
 {
-	if (dentry) {
-		dentry->d_count--;
-		if (!dentry->d_count)
-			dentry_release(dentry);
-	}
+	if (!dentry || --dentry->d_count)
+		return;
+
+	if (d_unhashed(dentry))
+		dentry_release(dentry);
+	else
+		list_add_tail(&dentry->d_lru, &dentry_lru);
 }
 
+/**
+ * Look for a cached name in a directory.
+ *
+ * @return the cached dentry, which is still unused or negative, or NULL if the
+ *         name is not cached.
+ */
 PRIVATE Dentry *
-lookup_cache(fid_t fid, Dentry *dir, bool *need_lookup)
+lookup_cache(fid_t fid, Dentry *dir)
 {
-	Dentry *dentry;
-
-	*need_lookup = true;
+	Dentry *dentry = d_lookup(dir, fid);
 
-	dentry = dentry_alloc(dir->d_sb, fid);
+	if (dentry && d_unused(dentry))
+		list_del_init(&dentry->d_lru);
 
 	return dentry;
 }
@@ -158,51 +544,58 @@ lookup_cache(fid_t fid, Dentry *dir, bool *need_lookup)
 PRIVATE err_t
 lookup_real(Inode *dir, Dentry *dentry)
 {
-	err_t err;
-
-	err = dir->i_do->lookup(dir, dentry);
-
-	if (err) {
-		dentry_free(dentry);
-	}
-
-	return err;
+	return dir->i_do->lookup(dir, dentry);
 }
 
 /**
  *  Step into lookup logic of a single file system object in a known directory.
  *
- *  There is a two way lookup. First we try to locate the object in a cache
- *  structure. If the cache does not contain such an element, it creates one and
- *  we are advised to do a real lookup from file system implementation.
- *  (i.e. a lookup from storage)
- *
- *  There is no backreference to parent objects yet ...
+ *  There is a two way lookup. First we try to locate the object in the dentry
+ *  cache. If the cache does not contain such an element, we create one and do
+ *  a real lookup from file system implementation (i.e. a lookup from storage).
+ *  The result is cached in both cases: a missing object is remembered by a
+ *  negative dentry, that has no inode.
  */
 PUBLIC Dentry *
 dentry_lookup(Dentry *dir, fid_t name)
 {
 	Dentry *dentry;
-	bool   need_lookup;
 	err_t  err;
 
-	need_lookup = false;
+	dentry = lookup_cache(name, dir);
+	if (dentry) {
+		if (dentry->d_inode) {
+			dentry->d_count++;
+			return dentry;
+		}
+
+		/* negative dentries stay unused */
+		list_add_tail(&dentry->d_lru, &dentry_lru);
+		return NULL;
+	}
 
-	dentry = lookup_cache(name, dir, &need_lookup);
+	dentry = dentry_alloc(dir->d_sb, name);
 	if (!dentry) {
 		return NULL;
 	}
 
-	if (need_lookup) {
-		err = lookup_real(dir->d_inode, dentry);
-		if (err) {
-			return NULL;
-		}
-		/* At this point dentry may not be complete. There was just a
-		 * successful inode lookup. The inode objects needs to be read.
-		 */
-		inode_pull(dentry->d_inode);
+	err = lookup_real(dir->d_inode, dentry);
+	if (err == E_NOENT) {
+		d_add(dir, dentry);
+		dput(dentry);
+		return NULL;
 	}
+	if (err) {
+		dentry_free(dentry);
+		return NULL;
+	}
+
+	/* At this point dentry may not be complete. There was just a
+	 * successful inode lookup. The inode objects needs to be read.
+	 */
+	inode_pull(dentry->d_inode);
+
+	d_add(dir, dentry);
 
 	return dentry;
 }
@@ -219,23 +612,73 @@ dentry_create(Dentry *dir, fid_t name, Attr *attr)
 	Dentry *new;
 	err_t  err;
 
+	/* the name is going to exist */
+	new = d_lookup(dir, name);
+	if (new && !new->d_inode)
+		dentry_release(new);
+
 	new = dentry_alloc(parent->i_super, name);
+	if (!new)
+		return NULL;
 
 	err = parent->i_do->create(parent, new, attr);
-	/* ...oh the beauty of quick and dirty workarounds */
-	inode_pull(new->d_inode);
 	if (err) {
 		dentry_free(new);
-		new = NULL;
+		return NULL;
 	}
-	// XXX insert into cache
+
+	/* ...oh the beauty of quick and dirty workarounds */
+	inode_pull(new->d_inode);
+
+	d_add(dir, new);
+	dir->d_gen++;
+
 	return new;
 }
 
+/**
+ *  Remove a file system object. An EF is unlinked, a DF removed by rmdir.
+ *  Once the inode is not used any longer, it is evicted.
+ */
+PUBLIC err_t
+dentry_unlink(Dentry *d)
+{
+	Dentry *dir   = d->d_parent;
+	Inode  *inode = d->d_inode;
+	Inode  *parent;
+	err_t  (*remove)(Inode *, Dentry *);
+	err_t  err;
+
+	if (!inode) return E_NOENT;
+
+	/* the MF or the root of a mount */
+	if (!dir || dir->d_sb != d->d_sb) return E_BUSY;
+
+	if (d->d_count > 1) return E_BUSY;
+
+	parent = dir->d_inode;
+	if (i7_ftype(inode->i_fdb) == DF)
+		remove = parent->i_do->rmdir;
+	else
+		remove = parent->i_do->unlink;
+
+	if (!remove) return E_NO_LOGIC;
+
+	err = remove(parent, d);
+	if (err) return err;
+
+	d_forget_children(d);
+	path_cache_forget(d);
+	dentry_iput(d);
+	dir->d_gen++;
+
+	return E_GOOD;
+}
 
 /**
- * This version of lookup allocates a new dentry object on each call. There
- * is no cached data. The caller must release the object.
+ * Walk a path through the dentry cache. The caller must release the object.
+ *
+ * Paths resolved before are taken from the path cache by a single probe.
  *
  * @param[in] path a zero terminated fid_t array
  * @param[out] the dentry object accoding to input path
@@ -243,9 +686,11 @@ dentry_create(Dentry *dir, fid_t name, Attr *attr)
 PUBLIC err_t
 smartfs_path_lookup(const path_t path, Dentry **dentry)
 {
-	Dentry *dir, *next;
+	struct path_cache_entry *e = NULL;
+	Dentry *start, *dir, *next;
 	/* temporary relative path */
 	path_t tmp_path = path;
+	fid_t  packed[MAX_PATH_DEPTH];
 	/* curret file identifier points to
 	 * next relative file system object */
 	fid_t  next_fid;
@@ -254,24 +699,44 @@ smartfs_path_lookup(const path_t path, Dentry **dentry)
 
 	/* remove leading MF fid */
 	if (path_is_absolute(path)) {
-		next = mnt.droot;
+		start = mnt.droot;
 		tmp_path = ptail(path);
 	} else {
-		next = current->df;
+		start = current->df;
 	}
 
+	if (path_pack(tmp_path, packed)) {
+		e = path_cache_slot(start, packed);
+
+		if (path_cache_valid(e, start, packed)) {
+			dget(e->dentry);
+			*dentry = e->dentry;
+			return E_GOOD;
+		}
+	}
+
+	next = start;
 	next->d_count++;
 
 	while ((next_fid = pwalk(&tmp_path))) {
 		dir = next;
 		next = dentry_lookup(dir, next_fid);
 
-		if (!next)
+		if (!next) {
+			dput(dir);
 			return E_NOENT;
+		}
 
 		dput(dir);
 	}
 
+	if (e && !d_unhashed(next)) {
+		e->start  = start;
+		e->dentry = next;
+		e->gen    = next->d_parent->d_gen;
+		memcpy(e->path, packed, sizeof(e->path));
+	}
+
 	*dentry = next;
 
 	return E_GOOD;
@@ -279,12 +744,120 @@ smartfs_path_lookup(const path_t path, Dentry **dentry)
 
 
 
+PRIVATE err_t
+sync_super(Super *s)
+{
+	if (!s->s_do || !s->s_do->sync_fs) return E_GOOD;
+
+	return s->s_do->sync_fs(s);
+}
+
+PUBLIC err_t
+smartfs_snapshot(Super *s)
+{
+	err_t err;
+
+	CHECK_PARAM__NOT_NULL(s);
+
+	if (s->s_do && s->s_do->snapshot) {
+		err = s->s_do->snapshot(s);
+		if (err) return err;
+	}
+
+	return sync_super(s);
+}
+
+PUBLIC err_t
+smartfs_sync()
+{
+	struct fs_mount *m;
+	err_t err;
+
+	if (!mnt.super) return E_GOOD;
+
+	err = sync_super(mnt.super);
+	if (err) return err;
+
+	for_each(m, mounts, LENGTH(mounts)) {
+		if (!m->super) continue;
+
+		err = sync_super(m->super);
+		if (err) return err;
+	}
+
+	return E_GOOD;
+}
+
+/**
+ * Tell if anything but the mount itself uses the file system of a mount.
+ */
+PRIVATE bool
+mount_busy(const struct fs_mount *m)
+{
+	const Dentry *d = current->df;
+	u32 id;
+
+	if (m->droot->d_count > 1) return true;
+
+	if (d && d->d_sb == m->super) return true;
+
+	for (id = 1; id <= DPOOL_SIZE; id++) {
+		d = dpool_lookup(id);
+		if (d && d != m->droot && d->d_count && d->d_sb == m->super)
+			return true;
+	}
+
+	return false;
+}
+
+PUBLIC err_t
+smartfs_umount(const path_t path)
+{
+	struct fs_mount *m;
+	Dentry *d;
+	err_t  err;
+
+	CHECK_PARAM__NOT_NULL(path);
+
+	err = smartfs_path_lookup(path, &d);
+	if (err) return err;
+	dput(d);
+
+	for_each(m, mounts, LENGTH(mounts)) {
+		if (m->super && m->droot == d) break;
+	}
+
+	/* neither a mount point nor the root mount */
+	if (m == mounts + LENGTH(mounts)) return E_BAD_PARAM;
+
+	if (mount_busy(m)) return E_BUSY;
+
+	err = sync_super(m->super);
+	if (err) return err;
+
+	/* the name is looked up in the DF mounted on again */
+	m->dmount->d_gen++;
+	list_del_init(&m->droot->d_hash);
+	dentry_release(m->droot);
+
+	icache_forget(m->super);
+	kill_super(m->super);
+	d_unpin(m->dmount);
+	memset(m, 0x00, sizeof(*m));
+
+	return E_GOOD;
+}
+
 PUBLIC err_t
 smartfs_reset()
 {
+	/* cached inodes go back to the pool before it is reset */
+	icache_init();
+	dcache_init();
 	ipool_reset();
 	dpool_reset();
 	fpool_reset();
+	mounts_init();
 
 	return E_GOOD;
 }
@@ -34,6 +34,7 @@
 
 /* extern objects */
 struct mem_dev;
+struct tlv_index;
 
 
 
@@ -42,6 +43,8 @@ struct super;
 struct dentry;
 struct inode;
 
+struct f_seg;
+
 struct super_does;
 struct inode_does;
 struct dentry_does;
@@ -55,15 +58,27 @@ typedef struct file        File;
 
 typedef err_t (*fp_do_mount)(struct mem_dev *, Mount *);
 
+/**
+ * A file system implementation, which is mounted by its name.
+ *
+ * @see register_filesystem
+ */
+struct fs_type {
+	const char  *name;
+	fp_do_mount mount;
+};
+
 /**
  * Smartfs file system implementation is being accessed through this mount
  * point structure. Initialization is done through smartfs_mount_root function.
+ * Further file systems are mounted by smartfs_mount.
  */
 extern struct fs_mount mnt;
 
 enum Inode_State {
 	I_NEW = 0x10,
 	I_DIRTY = 0x20,
+	I_SMAP_DIRTY = 0x40,
 };
 
 /**
@@ -76,6 +91,8 @@ struct fs_mount {
 	struct dentry      *droot;
 	/* file system handler */
 	struct super       *super;
+	/* DF the root dentry is named in, NULL for the root mount */
+	struct dentry      *dmount;
 };
 
 
@@ -86,6 +103,7 @@ struct fs_mount {
  */
 struct super {
 	const struct super_does *s_do;
+	const struct fs_type    *s_type;
 	/* point to implementation specific infos */
 	void *s_ctx;
 	/* further properties following */
@@ -115,12 +133,17 @@ struct inode {
 	u32                i_size;	/* size of data part */
 	u8                 i_sections;  /* number of sections */
 	laddr_t            i_smap_loc;	/* where to find section_map */
-	struct section_map *i_smap;     /*  */
+	u8                 i_smap_first;/* first section held by i_smap */
+	u8                 i_smap_count;/* number of loaded entries */
+	struct section_map i_smap[FS_SMAP_WINDOW];
 	void               *i_ctx;	/* file system specific inode context */
 	struct super       *i_super;	/* supe_block this inode belongs to */
 	const struct inode_does *i_do;  /* hold explicit inode operations */
 	const struct file_does  *i_fdo; /* hold default file operations */
 	struct mem_dev     *i_mdev;
+	struct tlv_index   *i_tlv;      /* optional index of BER-TLV content */
+	struct list_head   i_hash;      /* chain of (i_super, i_ino) hash */
+	struct list_head   i_lru;       /* unused cached inodes */
 };
 
 /**
@@ -130,8 +153,12 @@ struct dentry
 {
 	fid_t          d_name;
 	u8             d_count;
-	struct inode   *d_inode;
+	struct inode   *d_inode;        /* NULL for a cached missing name */
 	struct super   *d_sb;
+	struct dentry  *d_parent;       /* directory d_name was looked up in */
+	u16            d_gen;           /* changes with the directory entries */
+	struct list_head d_hash;        /* chain of (d_parent, d_name) hash */
+	struct list_head d_lru;         /* unused cached dentries */
 	/* filesystem specific infos */
 
 	const struct dentry_does *d_do;
@@ -195,6 +222,13 @@ struct file_does
 	 * next IO operation. */
 	size_t (*seek) (File *, size_t);
 	err_t  (*readdir)(File *, fid_t *);
+	/* Locate up to size_t bytes at current position on the memory device
+	 * without reading them. The position is moved as on reading. */
+	size_t (*map)(File *, size_t, struct mem_dev **, u32 *);
+	/* Transfer a list of segments, see f_readv. Without them, flxio
+	 * transfers one segment after the other. */
+	size_t (*readv) (File *, const struct f_seg *, u8);
+	size_t (*writev)(File *, const struct f_seg *, u8);
 };
 
 struct super_does {
@@ -209,6 +243,12 @@ struct super_does {
 
 	err_t  (*read_inode)(Inode *);   /* default read operation  */
 	err_t  (*write_inode)(Inode *);  /* default write operation */
+	/* write back file system metadata kept in memory */
+	err_t  (*sync_fs)(Super *);
+	/* release the file system context of a super no longer mounted */
+	void   (*put_super)(Super *);
+	/* summarize the tree for fast mounts and lookups, optional */
+	err_t  (*snapshot)(Super *);
 };
 
 /**
@@ -255,14 +295,44 @@ extern Inode *  iget(Super *, u32);
 extern void     destroy_inode(Inode *);
 /* drop usage count of an inode */
 extern void     iput(Inode *);
+/* drop the link count of an inode removed from its DF */
+extern u8       drop_nlink(Inode *);
 /**
  * Lookup if an inode with given inode number is already in memory.
  */
 extern Inode *  inode_find(Super *, u32);
 /**
- * Fill an inode with data.
+ * Fill an inode with data. Inodes already read are served from memory.
  */
 extern err_t    inode_pull(Inode *);
+/**
+ * Get the section map entry of a section. Entries are read from the device
+ * on first use, a window of FS_SMAP_WINDOW at once.
+ *
+ * @return NULL if there is no such section or it could not be read
+ */
+extern struct section_map * inode_smap(Inode *, u8);
+/**
+ * Write a dirty inode and its section map back to the file system.
+ */
+extern err_t    inode_push(Inode *);
+/**
+ * Forget all cached inodes, e.g. on mounting a file system.
+ */
+extern void     icache_init(void);
+/**
+ * Forget the cached inodes of a super, e.g. on unmounting its file system.
+ */
+extern void     icache_forget(const Super *);
+/**
+ * Build the BER-TLV index of an inode, if it has none yet.
+ */
+extern err_t    inode_tlv_index(Inode *, u32 (*read)(void *, u32, u8 *, u32),
+                                void *src, u32 length);
+/**
+ * Forget the BER-TLV index of an inode, e.g. on content changes.
+ */
+extern void     inode_tlv_drop(Inode *);
 
 static inline u8
 inode_lcs_get(Inode *i) {
@@ -275,17 +345,35 @@ inode_lcs_set(Inode *i, u8 lcs) {
 	i->i_state |= 0x0F & lcs;
 }
 
-static inline u32
-inode_smap_size(const Inode *i) {
-	return i->i_sections * sizeof(struct section_map);
+static inline void
+inode_mark_dirty(Inode *i) {
+	i->i_state |= I_DIRTY;
+}
+
+static inline void
+inode_smap_mark_dirty(Inode *i) {
+	i->i_state |= I_SMAP_DIRTY;
 }
 
 
 Dentry * dentry_lookup(Dentry *, fid_t);
 Dentry * dentry_create(Dentry *, fid_t, Attr *attr);
+/**
+ * Remove the object of a dentry from its DF. The caller must hold the only
+ * reference. The name stays cached as a missing one.
+ *
+ * @return E_BUSY if the dentry is used elsewhere or is the root of a mount
+ */
+err_t    dentry_unlink(Dentry *);
 
 /** drop usage of a dentry object */
 void    dput(Dentry *);
+/**
+ * Release the least recently used dentry of the cache.
+ *
+ * @return true if a cached dentry has been released
+ */
+bool    dcache_prune(void);
 
 /**
  * allocate a file object
@@ -294,9 +382,9 @@ File   * fget(void);
 /** release a file object */
 err_t    fput(File *);
 
-/** get the file object for this file descriptor */
+/** get the file object for this file descriptor, NULL if it is stale */
 File   * fd_lookup(u32);
-/** get a file descriptor of a file object */
+/** get a file descriptor of a file object, 0 is never a valid one */
 u32      fd_get(File *);
 
 void     dentry_attach(Dentry *, Inode *);
@@ -310,14 +398,55 @@ PUBLIC err_t simple_file_do_release(Inode *, File *);
  */
 PUBLIC err_t smartfs_path_lookup(const path_t, Dentry **);
 
-PUBLIC err_t smartfs_mount_root( struct mem_dev *, fp_do_mount);
+/**
+ * Make a file system type known to smartfs_mount_root and smartfs_mount.
+ *
+ * @return E_EXIST if another type has the same name, E_NOMEM if the registry
+ *         is full
+ */
+PUBLIC err_t register_filesystem(const struct fs_type *);
+
+/** @return the registered file system type of this name or NULL */
+PUBLIC const struct fs_type * get_fs_type(const char *);
+
+PUBLIC err_t smartfs_mount_root( struct mem_dev *, const char *);
+
+/**
+ * Mount a file system of a registered type under a DF of the mounted tree.
+ *
+ * The last FID of the absolute path names the root of the new file system and
+ * must not exist yet. The DFs on the way stay cached as long as the mount.
+ */
+PUBLIC err_t smartfs_mount( const path_t, struct mem_dev *, const char *);
+
+/**
+ * Unmount a file system mounted by smartfs_mount. Its metadata is written
+ * back and its context released.
+ *
+ * @return E_BUSY if any object of the file system is still in use
+ */
+PUBLIC err_t smartfs_umount( const path_t );
+
+/**
+ * Let a file system summarize its tree, e.g. at the end of personalization,
+ * and commit it.
+ */
+PUBLIC err_t smartfs_snapshot( Super * );
+
+/**
+ * Commit point of all mounted file systems. Metadata a file system keeps in
+ * memory, e.g. its allocation state, is written back. Changes not committed
+ * are recovered on the next mount.
+ */
+PUBLIC err_t smartfs_sync(void);
 
 /**
  *  This method is just for debugging purpose.
  *
  *  The underlying data structures of file system management are initialized
  *  at system startup. During unit testing it is necessary to reset these
- *  structures (e.g. the inode array cache 'iarr')
+ *  structures (e.g. the inode array cache 'iarr'). File system contexts of
+ *  all mounts are released, nothing is written back.
  */
 PUBLIC err_t smartfs_reset(void);
 
@@ -53,18 +53,27 @@ some_fh_clean( SomeFH *fh )
 	memset( DEST(fh), 0x00, sizeof(*fh) );
 }
 
-laddr_t
-some_df_get_child(const SomeDF *c, fid_t f)
+/** @return the slot of child f, or SOMEFS_MAX_DIR_ENTRIES if there is none */
+u8
+some_df_find_child(const SomeDF *c, fid_t f)
 {
-	int i;
-	if (f == 0) return 0;
+	u8 i;
+	if (f == 0) return SOMEFS_MAX_DIR_ENTRIES;
 
 	FOR_EACH_DF_CHILD (i) {
 		if (c->child[i].fid == f)
-			return c->child[i].addr;
+			break;
 	}
 
-	return 0;
+	return i;
+}
+
+laddr_t
+some_df_get_child(const SomeDF *c, fid_t f)
+{
+	u8 i = some_df_find_child(c, f);
+
+	return i < SOMEFS_MAX_DIR_ENTRIES ? c->child[i].addr : 0;
 }
 
 
@@ -32,10 +32,12 @@ struct some_superblock;
 struct some_header;
 struct some_df;
 struct some_df_child;
+struct some_snap;
 
 typedef struct some_superblock SomeSB;
 typedef struct some_header     SomeFH;
 typedef struct some_df         SomeDF;
+typedef struct some_super      SomeSuper;
 
 #define SOME_FH(type, args...) { .ftype = type, ##args}
 
@@ -43,11 +45,25 @@ PUBLIC void some_df_clean( SomeDF * );
 PUBLIC void some_fh_clean( SomeFH * );
 PUBLIC void some_sb_clean( SomeSB * );
 
+PUBLIC u8      some_df_find_child( const SomeDF *, fid_t );
 PUBLIC laddr_t some_df_get_child( const SomeDF *, fid_t );
 PUBLIC err_t   some_df_put_child( SomeDF *, laddr_t, fid_t );
 
 
 
+enum Some_SB_Flags {
+	/** allocations since the last commit are not recorded on the device */
+	SOMEFS_SB_OPEN = 0x0001
+};
+
+/*!
+ * A range of free space below next_free_addr.
+ */
+struct __packed some_extent {
+	laddr_t addr;
+	u32     bytes;
+};
+
 struct __packed some_superblock {
 	/* a magic number just for validation check */
 	u16     magic;
@@ -56,6 +72,10 @@ struct __packed some_superblock {
 	/* allocation data */
 	laddr_t next_free_addr;
 	u16 flags;
+	/* tree snapshot region, NO_ADDR if there is none */
+	laddr_t snapshot;
+	/* freed space sorted by address, unused extents have no bytes */
+	struct some_extent free[SOMEFS_FREE_EXTENTS];
 };
 
 struct __packed some_header {
@@ -95,3 +115,44 @@ static const struct some_df_child UNSET_CHILD = {
 	.fid = 0,
 	.addr = 0
 };
+
+/*!
+ * A summary of a file system object within the tree snapshot. Entries are
+ * sorted by the DF holding the object and its FID.
+ */
+struct __packed some_snap_entry {
+	/** inode of the DF, NO_ADDR for the MF */
+	laddr_t parent;
+	fid_t   fid;
+	laddr_t ino;
+	/** the file header of ino */
+	u8      fdb;
+	u8      lcs;
+	laddr_t data;
+	u8      sections;
+	u16     sec_size;
+};
+
+/*!
+ * Read-only copy of the whole tree in a single region, so mounting and any
+ * lookup take no more than one read of it.
+ */
+struct __packed some_snap {
+	u8      magic;
+	u8      count;
+	struct some_snap_entry entry[SOMEFS_SNAP_ENTRIES];
+};
+
+/*!
+ * Somefs context of a super object. The superblock comes first, so s_ctx may
+ * be taken as SomeSB.
+ */
+struct some_super {
+	SomeSB           sb;
+	/* copy of the tree snapshot, NULL if there is none */
+	struct some_snap *snap;
+	/* the snapshot on the device is invalid until the next commit */
+	bool             snap_open;
+	/* files created since the last commit */
+	u8               created;
+};
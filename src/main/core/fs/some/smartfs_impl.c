@@ -27,6 +27,7 @@
 #include <flxlib.h>
 #include <i7816.h>
 
+#include <flxio.h>
 #include <io/dev.h>
 #include <mm/pool.h>
 #include <fs/smartfs.h>
@@ -35,15 +36,31 @@
 #include "somefs.h"
 #include "data.h"
 #include "some_io.h"
+#include "some_snap.h"
+#include "some_dir.h"
 
 #include "smartfs_impl.h"
 
 #define MAX_RECORDS 16
 
+/**
+ *  Somefs context of an inode. The header comes first, so i_ctx may be taken
+ *  as SomeFH.
+ */
+struct some_inode {
+	SomeFH fh;
+	/* children of a DF, read on first use and kept up to date */
+	struct some_dir *dir;
+};
+
 extern laddr_t somefs_alloc(MemDev *, SomeSB *, size_t);
 
+/* one context per inode object of the pool, so no inode needs the heap */
+PRIVATE struct some_inode some_inodes[IPOOL_SIZE];
+
 
 
+PRIVATE err_t some_dir_get(Inode *, struct some_dir **);
 PRIVATE err_t sync_to_header(Inode *, SomeFH *);
 PRIVATE err_t sync_to_inode(Inode *, SomeFH *);
 PRIVATE laddr_t create_fresh_smap(Super *, u8, u16);
@@ -53,16 +70,21 @@ PRIVATE laddr_t create_fresh_smap(Super *, u8, u16);
 PUBLIC const struct super_does somefs_super_does = {
 	.alloc_inode = somefs_super_do_alloc_inode,
 	.destroy_inode = somefs_super_do_destroy_inode,
-	.evict_inode = NULL,
+	.evict_inode = somefs_super_do_evict_inode,
 	.drop_inode = NULL,
 	.read_inode = somefs_do_read_inode,
 	.write_inode = somefs_do_write_inode,
+	.sync_fs = somefs_super_do_sync,
+	.put_super = somefs_super_do_put,
+	.snapshot = somefs_super_do_snapshot,
 };
 
 PUBLIC const struct inode_does somefs_inode_does = {
 	.lookup = somefs_inode_do_lookup,
 	.create = somefs_inode_do_create,
+	.unlink = somefs_inode_do_unlink,
 	.mkdir = NULL,
+	.rmdir = somefs_inode_do_rmdir,
 	.write = somefs_do_write_inode,
 	.read = somefs_do_read_inode
 };
@@ -72,7 +94,10 @@ PRIVATE const struct file_does somefs_file_does = {
 	.release = NULL,
 	.read = somefs_file_do_read,
 	.write = somefs_file_do_write,
-	.seek = NULL
+	.seek = NULL,
+	.map = somefs_file_do_map,
+	.readv = somefs_file_do_readv,
+	.writev = somefs_file_do_writev
 };
 
 /**
@@ -94,31 +119,124 @@ static inline u32     addr_to_ino( laddr_t a ) { return a; }
 PUBLIC Inode *
 somefs_super_do_alloc_inode(Super *s)
 {
-	SomeFH *fh;
+	struct some_inode *si;
 	Inode *inew;
 
 	inew = ipool_get();
 
 	if (!inew) return NULL;
 
-	fh = malloc(sizeof(*fh));
+	si = &some_inodes[ipool_id(inew) - 1];
 
-	if (!fh) {
-		ipool_put(inew);
-		return NULL;
-	}
-
-	inew->i_ctx = fh;
+	si->dir = NULL;
+	inew->i_ctx = si;
 	return inew;
 }
 
+PRIVATE void
+some_dir_drop(Inode *i)
+{
+	struct some_inode *si = i->i_ctx;
+
+	if (si->dir)
+		some_dir_free(si->dir);
+	si->dir = NULL;
+}
+
 PUBLIC void
 somefs_super_do_destroy_inode(Inode *i)
 {
-	free(i->i_ctx);
+	some_dir_drop(i);
+	i->i_ctx = NULL;
 	ipool_put(i);
 }
 
+/**
+ * Give back the space of an inode, that has been removed from its DF.
+ */
+PUBLIC err_t
+somefs_super_do_evict_inode(Inode *i)
+{
+	Super  *s  = i->i_super;
+	SomeFH *fh = i->i_ctx;
+	struct some_dir *dir;
+	err_t  err;
+
+	/* blocks chained to an empty DF */
+	if (i7_ftype(i->i_fdb) == DF) {
+		err = some_dir_get(i, &dir);
+		if (!err)
+			err = some_dir_destroy(s->s_mdev, s->s_ctx, dir);
+		if (err) return err;
+	}
+
+	err = somefs_free(s->s_mdev, s->s_ctx, fh->data, some_fh_data_bytes(fh));
+	if (err) return err;
+
+	return somefs_free(s->s_mdev, s->s_ctx, addr_of_ino(i->i_ino),
+	                   sizeof(*fh));
+}
+
+PUBLIC err_t
+somefs_super_do_sync(Super *s)
+{
+	SomeSuper *ss = s->s_ctx;
+
+	err_t err;
+
+	/* the snapshot is valid again, before the superblock is */
+	some_snap_commit(s->s_mdev, ss);
+
+	err = some_sb_commit(s->s_mdev, &ss->sb);
+	if (!err) ss->created = 0;
+
+	return err;
+}
+
+/**
+ *  A tree too large for the snapshot is no error, it is still found by its DFs.
+ */
+PUBLIC err_t
+somefs_super_do_snapshot(Super *s)
+{
+	err_t err = somefs_snapshot(s);
+
+	return err == E_NOMEM ? E_GOOD : err;
+}
+
+/**
+ *  Free the context set up by somefs_mount(). Nothing is written back.
+ */
+PUBLIC void
+somefs_super_do_put(Super *s)
+{
+	SomeSuper *ss = s->s_ctx;
+
+	if (!ss) return;
+
+	some_snap_drop(ss);
+	free(ss);
+	s->s_ctx = NULL;
+}
+
+/**
+ *  Get the children of a DF. They are read once and stay with the inode.
+ */
+PRIVATE err_t
+some_dir_get(Inode *i, struct some_dir **dir)
+{
+	struct some_inode *si = i->i_ctx;
+	err_t err;
+
+	if (!si->dir) {
+		err = some_dir_load(i->i_mdev, i->i_data, &si->dir);
+		if (err) return err;
+	}
+
+	*dir = si->dir;
+	return E_GOOD;
+}
+
 /**
  * Fill an inode object with new data from file system.
  */
@@ -129,12 +247,21 @@ somefs_do_read_inode(Inode *i)
 	laddr_t addr;
 	Super   *s  = i->i_super;
 	SomeFH  *fh = i->i_ctx;
+	const struct some_snap_entry *e;
 
 	addr = addr_of_ino(i->i_ino);
 	if (addr == 0) return E_BAD_PARAM | E_FS_INO;
 
-	err = some_fh_read( s->s_mdev, addr, fh );
-	if (err) return E_INTERN | err;
+	/* children may have moved with the header */
+	some_dir_drop(i);
+
+	e = some_snap_find_ino(s->s_ctx, addr);
+	if (e) {
+		some_snap_to_fh(e, fh);
+	} else {
+		err = some_fh_read( s->s_mdev, addr, fh );
+		if (err) return E_INTERN | err;
+	}
 
 	sync_to_inode(i, fh);
 	return E_GOOD;
@@ -161,9 +288,14 @@ somefs_do_write_inode(Inode *i)
 
 	sync_to_header(i, fh);
 
+	err = some_snap_open(s->s_mdev, s->s_ctx);
+	if (err) return E_INTERN | err;
+
 	err = some_fh_write(s->s_mdev, addr, fh);
 	if (err) return E_INTERN | err;
 
+	some_snap_update(s->s_ctx, addr, fh);
+
 	return E_GOOD;
 }
 
@@ -172,9 +304,11 @@ somefs_do_write_inode(Inode *i)
 PUBLIC err_t
 somefs_inode_do_lookup(Inode *iparent, Dentry *d)
 {
-	SomeDF df;
+	struct some_dir *dir;
 	Inode  *child_inode;
 	Super  *s;
+	SomeSuper *ss;
+	const struct some_snap_entry *e;
 	err_t  err;
 	u32    ino;
 
@@ -184,13 +318,21 @@ somefs_inode_do_lookup(Inode *iparent, Dentry *d)
 
 	s = iparent->i_super;
 	CHECK_PARAM__NOT_NULL (s);
-	// XXX too lazy!!
 
-	err = some_df_read( iparent->i_mdev, iparent->i_data, &df );
-	if (err) return E_INTERN | err;
+	ss = s->s_ctx;
+
+	/* the snapshot knows every object, so the DF is not needed */
+	if (ss->snap) {
+		e   = some_snap_lookup(ss, iparent->i_ino, d->d_name);
+		ino = e ? e->ino : 0;
+	} else {
+		err = some_dir_get(iparent, &dir);
+		if (err) return E_INTERN | err;
+
+		/* read ino from directory */
+		ino = some_dir_find(dir, d->d_name);
+	}
 
-	/* read ino from directory */
-	ino = some_df_get_child(&df, d->d_name);
 	// if ino is 0 <=> no such file or directory
 	if (!ino) return E_NOENT;
 
@@ -213,31 +355,49 @@ somefs_inode_do_lookup(Inode *iparent, Dentry *d)
 PUBLIC err_t
 somefs_inode_do_create(Inode *iparent, Dentry *d, const Attr *attr)
 {
+	struct some_inode *si;
+	struct some_dir   *dir;
 	Inode  *inew;
 	Super  *s;
+	SomeSuper *ss;
 	SomeFH *fh;
-	SomeDF df;
 	u32    addr_h;
 	u32    addr_b;
+	u32    bytes_b;
 	err_t  err;
 
 	CHECK_PARAM__NOT_NULL(iparent);
 	CHECK_PARAM__NOT_NULL(d);
 	CHECK_PARAM__NOT_ZERO(d->d_name);
+	CHECK_PARAM__NOT_NULL(attr);
 
 	s = iparent->i_super;
 	CHECK_PARAM__NOT_NULL(s);
 
+	ss = s->s_ctx;
+
 	/* this will fail if iparent does not point to a directory */
-	err = some_df_read( iparent->i_mdev, iparent->i_data, &df);
+	err = some_dir_get(iparent, &dir);
 	if (err) return E_INTERN | err;
 
+	si = iparent->i_ctx;
+
 	/* Allocate space for file header and data body  */
 	addr_h = somefs_alloc(s->s_mdev, s->s_ctx, sizeof(SomeFH));
+	if (!addr_h) return E_NOMEM;
+
+	bytes_b = attr->sections * (sizeof(struct section_map) + attr->sec_size);
+	addr_b  = create_fresh_smap(s, attr->sections, attr->sec_size);
+	if (!addr_b) {
+		err = E_NOMEM;
+		goto free_header;
+	}
 
-	addr_b = create_fresh_smap(s, attr->sections, attr->sec_size);
 	inew = iget(s, addr_to_ino(addr_h));
-	if (!inew) return E_ALLOC;
+	if (!inew) {
+		err = E_ALLOC;
+		goto free_body;
+	}
 
 	/* SomeFH structure has already been allocated and attached to
 	 * the inodes private context. */
@@ -252,19 +412,95 @@ somefs_inode_do_create(Inode *iparent, Dentry *d, const Attr *attr)
 
 	sync_to_inode(inew, fh);
 
-	if ((err = some_fh_write( inew->i_mdev, inew->i_ino, fh))
-	||  (err = some_df_put_child(&df, inew->i_ino, d->d_name))
-	||  (err = some_df_write( iparent->i_mdev, iparent->i_data, &df )))
+	/* only the new child slot changed, unless the DF needs another block */
+	if ((err = some_snap_open(s->s_mdev, s->s_ctx))
+	||  (err = some_fh_write( inew->i_mdev, inew->i_ino, fh))
+	||  (err = some_dir_add(iparent->i_mdev, s->s_ctx, &si->dir, d->d_name,
+	                        inew->i_ino)))
 	{
-		/* XXX introduce flag orphaned? */
 		iput(inew);
-		return E_INTERN | err;
+		err = E_INTERN | err;
+		goto free_body;
 	}
 
+	/* a snapshot without room for the file is given up */
+	some_snap_insert(s->s_ctx, iparent->i_ino, d->d_name, inew->i_ino, fh);
+
 	dentry_attach(d, inew);
+
+	/* a commit, that fails, leaves the superblock open to be recovered */
+	if (++ss->created >= SOMEFS_COMMIT_FILES)
+		somefs_super_do_sync(s);
+
+	return E_GOOD;
+
+	/* no DF refers to the space taken, so it is given back */
+free_body:
+	somefs_free(s->s_mdev, s->s_ctx, addr_b, bytes_b);
+free_header:
+	somefs_free(s->s_mdev, s->s_ctx, addr_h, sizeof(SomeFH));
+	return err;
+}
+
+/**
+ *  Take the object of a dentry out of its DF. Its space is given back on
+ *  eviction, when the inode is not used any longer.
+ */
+PRIVATE err_t
+some_dir_remove(Inode *iparent, Dentry *d)
+{
+	Super  *s = iparent->i_super;
+	struct some_inode *si = iparent->i_ctx;
+	struct some_dir   *dir;
+	err_t  err;
+
+	err = some_dir_get(iparent, &dir);
+	if (err) return E_INTERN | err;
+
+	err = some_snap_open(s->s_mdev, s->s_ctx);
+	if (err) return E_INTERN | err;
+
+	err = some_dir_del(iparent->i_mdev, s->s_ctx, &si->dir, d->d_name);
+	if (err == E_NOENT) return err;
+	if (err) return E_INTERN | err;
+
+	some_snap_remove(s->s_ctx, iparent->i_ino, d->d_name);
+
+	drop_nlink(d->d_inode);
 	return E_GOOD;
 }
 
+PUBLIC err_t
+somefs_inode_do_unlink(Inode *iparent, Dentry *d)
+{
+	CHECK_PARAM__NOT_NULL(iparent);
+	CHECK_PARAM__NOT_NULL(d);
+	CHECK_PARAM__NOT_NULL(d->d_inode);
+
+	return some_dir_remove(iparent, d);
+}
+
+/**
+ *  Remove an empty DF.
+ */
+PUBLIC err_t
+somefs_inode_do_rmdir(Inode *iparent, Dentry *d)
+{
+	struct some_dir *dir;
+	err_t  err;
+
+	CHECK_PARAM__NOT_NULL(iparent);
+	CHECK_PARAM__NOT_NULL(d);
+	CHECK_PARAM__NOT_NULL(d->d_inode);
+
+	err = some_dir_get(d->d_inode, &dir);
+	if (err) return E_INTERN | err;
+
+	if (!some_dir_is_empty(dir)) return E_FS_BUSY;
+
+	return some_dir_remove(iparent, d);
+}
+
 PUBLIC err_t
 somefs_inode_do_mkdir(Inode *iparent, Dentry *d)
 {
@@ -276,31 +512,36 @@ somefs_inode_do_mkdir(Inode *iparent, Dentry *d)
  *
  *  FIXME export this
  */
-PRIVATE void
-somefs_sec_info(const Inode *i, u8 sec, u16 *length, u16 *size)
+PRIVATE const struct section_map *
+somefs_sec_info(Inode *i, u8 sec, u16 *length, u16 *size)
 {
+	const struct section_map *m = inode_smap(i, sec);
+
 	/* NOTE This is for fixed length files only */
-	if (sec > i->i_sections) {
+	if (!m) {
 		*length = 0;
 		*size   = 0;
+		return NULL;
 	}
 
 	*size = i->i_size / i->i_sections;
-	*length = i->i_smap[sec].length;
+	*length = m->length;
+
+	return m;
 }
 
 PRIVATE void
-somefs_sec_update(const Inode *i, u8 sec, u16 length)
+somefs_sec_update(Inode *i, u8 sec, u16 length)
 {
+	struct section_map *m = inode_smap(i, sec);
+
 	/* nothing to do if length has not been increased */
-	if (i->i_smap[sec].length >= length) return;
+	if (!m || m->length >= length) return;
 
-	i->i_smap[sec].length = length;
+	m->length = length;
 
-	mdev_write(i->i_mdev,
-	           i->i_smap_loc,
-	           i->i_sections * sizeof(struct section_map),
-		   SRC(i->i_smap));
+	/* the section map is written back with the inode */
+	inode_smap_mark_dirty(i);
 }
 
 /**
@@ -311,18 +552,17 @@ somefs_file_do_read(File *f, buff8_t dest, size_t bytes)
 {
 	Inode  *i = f->f_dentry->d_inode;
 	MemDev *dev = i->i_mdev;
+	const struct section_map *m;
 	u16 rmax, rlen;
 	u32 addr;
 
-	if (f->section >= i->i_sections) return EOF;
-
-	somefs_sec_info(i, f->section, &rlen, &rmax);
+	m = somefs_sec_info(i, f->section, &rlen, &rmax);
 
-	if (f->pos >= rlen) return EOF;
+	if (!m || f->pos >= rlen) return EOF;
 
 	bytes = MIN((rlen - f->pos), bytes);
 
-	addr  = i->i_smap[f->section].addr;
+	addr  = m->addr;
 	addr += f->pos;
 
 	if (dev->read(addr, bytes, DEST(dest)))
@@ -332,12 +572,39 @@ somefs_file_do_read(File *f, buff8_t dest, size_t bytes)
 	return bytes;
 }
 
+/**
+ *  Locate the bytes a subsequent read would return.
+ *
+ *  Every section is stored contiguously, so the mapping ends at the end of
+ *  the current section at the latest.
+ */
+PUBLIC size_t
+somefs_file_do_map(File *f, size_t bytes, MemDev **dev, u32 *addr)
+{
+	Inode  *i = f->f_dentry->d_inode;
+	const struct section_map *m;
+	u16 rmax, rlen;
+
+	m = somefs_sec_info(i, f->section, &rlen, &rmax);
+
+	if (!m || f->pos >= rlen) return EOF;
+
+	bytes = MIN((rlen - f->pos), bytes);
+
+	*dev  = i->i_mdev;
+	*addr = m->addr + f->pos;
+
+	f->pos += bytes;
+	return bytes;
+}
+
 
 PUBLIC size_t
 somefs_file_do_write(File *f, const buff8_t src, size_t bytes)
 {
 	Inode  *i;
 	MemDev *dev;
+	const struct section_map *m;
 	laddr_t addr;
 
 	CHECK_PARAM__NOT_NULL (f->f_dentry);
@@ -349,9 +616,10 @@ somefs_file_do_write(File *f, const buff8_t src, size_t bytes)
 	/* This version has a static file size */
 	if (f->pos > i->i_size) return EOF;
 
-	if (f->section >= i->i_sections) return EOF;
+	m = inode_smap(i, f->section);
+	if (!m) return EOF;
 
-	addr  = i->i_smap[f->section].addr;
+	addr  = m->addr;
 	addr += f->pos;
 
 	bytes = MIN ((i->i_size - f->pos), bytes);
@@ -366,6 +634,120 @@ somefs_file_do_write(File *f, const buff8_t src, size_t bytes)
 }
 
 
+/**
+ *  Get the number of bytes of a segment, that can be transferred, and their
+ *  device address. Reading ends with the data of a section, writing with its
+ *  size.
+ */
+PRIVATE u16
+somefs_seg_info(Inode *i, const struct f_seg *s, bool write, laddr_t *addr)
+{
+	const struct section_map *m = inode_smap(i, s->section);
+	u16 limit;
+
+	if (!m) return 0;
+
+	limit = write ? i->i_size / i->i_sections : m->length;
+	*addr = m->addr + s->offset;
+
+	return s->offset < limit ? MIN(s->len, limit - s->offset) : 0;
+}
+
+/**
+ *  Transfer the merged segments [first, end) of 'bytes' in one go.
+ */
+PRIVATE err_t
+somefs_run_xfer(File *f, const struct f_seg *first, const struct f_seg *end,
+                laddr_t addr, u32 bytes, bool write)
+{
+	Inode  *i = f->f_dentry->d_inode;
+	const struct f_seg *s;
+	laddr_t unused;
+	u16     len = 0;
+	err_t   err;
+
+	if (write)
+		err = mdev_write(i->i_mdev, addr, bytes, first->buff);
+	else
+		err = mdev_read(i->i_mdev, addr, bytes, first->buff);
+
+	if (err) return err;
+
+	for (s = first; s < end; s++) {
+		len = somefs_seg_info(i, s, write, &unused);
+		if (write)
+			somefs_sec_update(i, s->section, s->offset + len);
+	}
+
+	f->section = (end - 1)->section;
+	f->pos     = (end - 1)->offset + len;
+
+	return E_GOOD;
+}
+
+/**
+ *  Segments, which follow each other on the device and in memory, are merged
+ *  into a single device transfer. Whole records read into one buffer take a
+ *  single read, since the sections of a file are allocated in a row.
+ */
+PRIVATE size_t
+somefs_file_do_xferv(File *f, const struct f_seg *seg, u8 n, bool write)
+{
+	Inode  *i = f->f_dentry->d_inode;
+	const struct f_seg *run = seg;
+	const struct f_seg *s;
+	laddr_t run_addr = 0;
+	laddr_t addr = 0;
+	u32     run_len = 0;
+	size_t  done = 0;
+	u16     len;
+
+	for (s = seg; s < seg + n; s++) {
+		len = somefs_seg_info(i, s, write, &addr);
+
+		if (run_len
+		&& (addr != run_addr + run_len || s->buff != run->buff + run_len))
+		{
+			if (somefs_run_xfer(f, run, s, run_addr, run_len, write))
+				return done;
+
+			done   += run_len;
+			run_len = 0;
+		}
+
+		if (!run_len) {
+			run      = s;
+			run_addr = addr;
+		}
+
+		run_len += len;
+
+		/* a short segment ends the transfer */
+		if (len < s->len) {
+			s++;
+			break;
+		}
+	}
+
+	if (run_len && !somefs_run_xfer(f, run, s, run_addr, run_len, write))
+		done += run_len;
+
+	return done;
+}
+
+PUBLIC size_t
+somefs_file_do_readv(File *f, const struct f_seg *seg, u8 n)
+{
+	return somefs_file_do_xferv(f, seg, n, false);
+}
+
+PUBLIC size_t
+somefs_file_do_writev(File *f, const struct f_seg *seg, u8 n)
+{
+	return somefs_file_do_xferv(f, seg, n, true);
+}
+
+
 /* ----- Utility methods ---------------------------------------------------- */
 PRIVATE laddr_t
 create_fresh_smap(Super *s, u8 sections, u16 section_size)
@@ -34,11 +34,20 @@ PUBLIC Inode * somefs_super_do_alloc_inode(Super *);
 PUBLIC void  somefs_super_do_destroy_inode(Inode *);
 PUBLIC err_t somefs_do_read_inode(Inode *);
 PUBLIC err_t somefs_do_write_inode(Inode *);
+PUBLIC err_t somefs_super_do_evict_inode(Inode *);
+PUBLIC err_t somefs_super_do_sync(Super *);
+PUBLIC void  somefs_super_do_put(Super *);
+PUBLIC err_t somefs_super_do_snapshot(Super *);
 
 /* --- Interface: struct inode_does --- */
 PUBLIC err_t somefs_inode_do_lookup(Inode *, Dentry *);
 PUBLIC err_t somefs_inode_do_create(Inode *, Dentry *, const Attr *);
+PUBLIC err_t somefs_inode_do_unlink(Inode *, Dentry *);
+PUBLIC err_t somefs_inode_do_rmdir(Inode *, Dentry *);
 
 /* --- Interface: struct file_does --- */
 PUBLIC size_t somefs_file_do_read(File *, buff8_t, size_t);
 PUBLIC size_t somefs_file_do_write(File *, const buff8_t, size_t);
+PUBLIC size_t somefs_file_do_map(File *, size_t, MemDev **, u32 *);
+PUBLIC size_t somefs_file_do_readv(File *, const struct f_seg *, u8);
+PUBLIC size_t somefs_file_do_writev(File *, const struct f_seg *, u8);
@@ -0,0 +1,471 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+/**
+ * some_dir.c
+ *
+ * A DF is a chain of blocks, each one a SomeDF. When every slot of the last
+ * block is taken, its last child moves to a new block and the slot becomes
+ * a link to it. Once read, the blocks stay in memory together with an index
+ * of the children sorted by FID. Lookups are binary searches, adding or
+ * removing a child writes a single slot. Blocks left empty at the end of
+ * the chain are given back.
+ */
+
+#include <flxlib.h>
+#include <i7816.h>
+#include <string.h>
+
+#include <io/dev.h>
+
+#include "somefs.h"
+#include "data.h"
+#include "some_io.h"
+#include "some_dir.h"
+
+#define LAST_SLOT   (SOMEFS_MAX_DIR_ENTRIES - 1)
+#define NO_SLOT     0xFFFF
+
+struct some_dir {
+	u8      blocks;
+	u16     count;
+	laddr_t *addr;
+	SomeDF  *block;
+	/* slots of the children sorted by FID, see dir_child */
+	u16     *index;
+};
+
+/* ===== Local functions =================================================== */
+/**
+ * The block addresses, the blocks and the index share a single allocation,
+ * which is resized block by block.
+ */
+PRIVATE inline size_t
+dir_size(u8 blocks)
+{
+	return sizeof(struct some_dir)
+	     + blocks * (sizeof(laddr_t) + sizeof(SomeDF))
+	     + blocks * SOMEFS_MAX_DIR_ENTRIES * sizeof(u16);
+}
+
+PRIVATE void
+dir_layout(struct some_dir *dir, u8 blocks)
+{
+	dir->blocks = blocks;
+	dir->addr   = (laddr_t *) (dir + 1);
+	dir->block  = (SomeDF *) (dir->addr + blocks);
+	dir->index  = (u16 *) (dir->block + blocks);
+}
+
+PRIVATE struct some_dir *
+dir_alloc(void)
+{
+	struct some_dir *dir;
+
+	dir = malloc(dir_size(0));
+	if (!dir) return NULL;
+
+	dir->count = 0;
+	dir_layout(dir, 0);
+
+	return dir;
+}
+
+/**
+ * Change the number of blocks of a DF. The blocks and the index are moved
+ * to their new place, blocks dropped at the end must not have children.
+ * Shrinking never fails.
+ */
+PRIVATE err_t
+dir_resize(struct some_dir **pdir, u8 blocks)
+{
+	struct some_dir *dir = *pdir;
+	struct some_dir *new;
+	SomeDF *block;
+	u16    *index;
+	u8      n = dir->blocks;
+
+	if (blocks < n) {
+		block = dir->block;
+		index = dir->index;
+		dir_layout(dir, blocks);
+
+		memmove(dir->block, block, blocks * sizeof(dir->block[0]));
+		memmove(dir->index, index, dir->count * sizeof(dir->index[0]));
+
+		/* the larger allocation is fine, if it can not be shrunk */
+		new = realloc(dir, dir_size(blocks));
+		if (!new) return E_GOOD;
+		dir = new;
+	} else {
+		dir = realloc(dir, dir_size(blocks));
+		if (!dir) return E_NOMEM;
+
+		dir_layout(dir, n);
+		block = dir->block;
+		index = dir->index;
+		dir_layout(dir, blocks);
+
+		/* the index moves further, it goes first */
+		memmove(dir->index, index, dir->count * sizeof(dir->index[0]));
+		memmove(dir->block, block, n * sizeof(dir->block[0]));
+	}
+
+	dir_layout(dir, blocks);
+	*pdir = dir;
+
+	return E_GOOD;
+}
+
+PRIVATE inline struct some_df_child *
+dir_child(const struct some_dir *dir, u16 slot)
+{
+	return &dir->block[slot / SOMEFS_MAX_DIR_ENTRIES]
+	        .child[slot % SOMEFS_MAX_DIR_ENTRIES];
+}
+
+PRIVATE err_t
+dir_write_slot(MemDev *mdev, const struct some_dir *dir, u16 slot)
+{
+	u8 b = slot / SOMEFS_MAX_DIR_ENTRIES;
+
+	return some_df_write_child(mdev, dir->addr[b], &dir->block[b],
+	                           slot % SOMEFS_MAX_DIR_ENTRIES);
+}
+
+/**
+ * @return the index position of a FID, or the one it belongs to if not found
+ */
+PRIVATE u16
+dir_search(const struct some_dir *dir, fid_t fid, bool *found)
+{
+	u16   lo = 0;
+	u16   hi = dir->count;
+	u16   mid;
+	fid_t f;
+
+	*found = false;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		f   = dir_child(dir, dir->index[mid])->fid;
+
+		if (f == fid) {
+			*found = true;
+			return mid;
+		}
+
+		if (f < fid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+PRIVATE void
+dir_index_insert(struct some_dir *dir, u16 pos, u16 slot)
+{
+	memmove(&dir->index[pos + 1], &dir->index[pos],
+	        (dir->count - pos) * sizeof(dir->index[0]));
+
+	dir->index[pos] = slot;
+	dir->count++;
+}
+
+PRIVATE u16
+dir_free_slot(const struct some_dir *dir)
+{
+	u16 slot;
+
+	for (slot = 0; slot < dir->blocks * SOMEFS_MAX_DIR_ENTRIES; slot++) {
+		if (!dir_child(dir, slot)->fid)
+			return slot;
+	}
+
+	return NO_SLOT;
+}
+
+/**
+ * Chain a new block to a full DF. Besides the new block, only the link slot
+ * of the last one is written.
+ */
+PRIVATE err_t
+dir_grow(MemDev *mdev, SomeSB *sb, struct some_dir **pdir)
+{
+	struct some_dir      *dir;
+	struct some_df_child *last;
+	laddr_t addr;
+	bool    found;
+	u16     pos;
+	u8      n = (*pdir)->blocks;
+	err_t   err;
+
+	if (n == SOMEFS_DF_MAX_BLOCKS) return E_NOMEM;
+
+	addr = somefs_alloc(mdev, sb, sizeof(SomeDF));
+	if (addr == NO_ADDR) return E_NOMEM;
+
+	err = dir_resize(pdir, n + 1);
+	if (err) {
+		somefs_free(mdev, sb, addr, sizeof(SomeDF));
+		return err;
+	}
+
+	dir = *pdir;
+	dir->addr[n] = addr;
+
+	/* the last child moves, its slot becomes the link */
+	last = &dir->block[n - 1].child[LAST_SLOT];
+	pos  = dir_search(dir, last->fid, &found);
+
+	some_df_clean(&dir->block[n]);
+	dir->block[n].child[0] = *last;
+
+	err = some_df_write(mdev, addr, &dir->block[n]);
+	if (!err) {
+		last->fid  = SOMEFS_DF_LINK;
+		last->addr = addr;
+		err = dir_write_slot(mdev, dir, (n - 1) * SOMEFS_MAX_DIR_ENTRIES
+		                                + LAST_SLOT);
+		if (err) *last = dir->block[n].child[0];
+	}
+
+	if (err) {
+		dir_resize(pdir, n);
+		somefs_free(mdev, sb, addr, sizeof(SomeDF));
+		return err;
+	}
+
+	dir->index[pos] = n * SOMEFS_MAX_DIR_ENTRIES;
+
+	return E_GOOD;
+}
+
+PRIVATE bool
+dir_block_is_empty(const struct some_dir *dir, u8 b)
+{
+	u8 i;
+
+	FOR_EACH_DF_CHILD (i) {
+		if (dir->block[b].child[i].fid) return false;
+	}
+
+	return true;
+}
+
+/**
+ * Give back empty blocks at the end of a DF. A block is unlinked before its
+ * space is freed. If the link can not be written, the empty block stays in
+ * the chain, the next deletion tries again.
+ */
+PRIVATE void
+dir_trim(MemDev *mdev, SomeSB *sb, struct some_dir **pdir)
+{
+	struct some_dir      *dir = *pdir;
+	struct some_df_child *link;
+	u8 n;
+
+	for (n = dir->blocks; n > 1 && dir_block_is_empty(dir, n - 1); n--) {
+		link  = &dir->block[n - 2].child[LAST_SLOT];
+		*link = UNSET_CHILD;
+
+		if (dir_write_slot(mdev, dir, (n - 2) * SOMEFS_MAX_DIR_ENTRIES
+		                              + LAST_SLOT)) {
+			link->fid  = SOMEFS_DF_LINK;
+			link->addr = dir->addr[n - 1];
+			break;
+		}
+
+		somefs_free(mdev, sb, dir->addr[n - 1], sizeof(SomeDF));
+	}
+
+	dir_resize(pdir, n);
+}
+
+/* ===== Public functions ================================================== */
+/**
+ * Read all blocks of a DF, whose first block is at 'data'. Each block links
+ * to the next one by its last slot.
+ */
+PUBLIC err_t
+some_dir_load(MemDev *mdev, laddr_t data, struct some_dir **pdir)
+{
+	struct some_dir      *dir;
+	struct some_df_child *c;
+	laddr_t next;
+	bool    found;
+	u16     slot;
+	u8      n;
+	err_t   err;
+
+	dir = dir_alloc();
+	if (!dir) return E_NOMEM;
+
+	for (n = 0, next = data; next != NO_ADDR; n++) {
+		err = n == SOMEFS_DF_MAX_BLOCKS ? E_FS : dir_resize(&dir, n + 1);
+		if (!err) err = some_df_read(mdev, next, &dir->block[n]);
+		if (err) {
+			free(dir);
+			return err;
+		}
+
+		dir->addr[n] = next;
+
+		c    = &dir->block[n].child[LAST_SLOT];
+		next = c->fid == SOMEFS_DF_LINK ? c->addr : NO_ADDR;
+	}
+
+	for (slot = 0; slot < dir->blocks * SOMEFS_MAX_DIR_ENTRIES; slot++) {
+		c = dir_child(dir, slot);
+		if (!c->fid || c->fid == SOMEFS_DF_LINK) continue;
+
+		dir_index_insert(dir, dir_search(dir, c->fid, &found), slot);
+	}
+
+	*pdir = dir;
+
+	return E_GOOD;
+}
+
+PUBLIC void
+some_dir_free(struct some_dir *dir)
+{
+	free(dir);
+}
+
+/** @return the inode of a child, NO_ADDR if there is none */
+PUBLIC laddr_t
+some_dir_find(const struct some_dir *dir, fid_t fid)
+{
+	bool found;
+	u16  pos = dir_search(dir, fid, &found);
+
+	return found ? dir_child(dir, dir->index[pos])->addr : NO_ADDR;
+}
+
+PUBLIC bool
+some_dir_is_empty(const struct some_dir *dir)
+{
+	return !dir->count;
+}
+
+/**
+ * Add a child to the first free slot. A full DF gets another block, so the
+ * DF object may change.
+ */
+PUBLIC err_t
+some_dir_add(MemDev *mdev, SomeSB *sb, struct some_dir **pdir, fid_t fid,
+             laddr_t addr)
+{
+	struct some_df_child *c;
+	bool  found;
+	u16   pos, slot;
+	err_t err;
+
+	CHECK_PARAM__NOT_ZERO(fid);
+	CHECK_PARAM__NOT_ZERO(addr);
+	if (fid == SOMEFS_DF_LINK) return E_BAD_PARAM;
+
+	pos = dir_search(*pdir, fid, &found);
+	if (found) return E_FS_EXIST;
+
+	slot = dir_free_slot(*pdir);
+	if (slot == NO_SLOT) {
+		err = dir_grow(mdev, sb, pdir);
+		if (err) return err;
+
+		slot = dir_free_slot(*pdir);
+	}
+
+	c = dir_child(*pdir, slot);
+	c->fid  = fid;
+	c->addr = addr;
+
+	err = dir_write_slot(mdev, *pdir, slot);
+	if (err) {
+		*c = UNSET_CHILD;
+		return err;
+	}
+
+	dir_index_insert(*pdir, pos, slot);
+
+	return E_GOOD;
+}
+
+/**
+ * Remove a child. Chained blocks left empty at the end of the DF are given
+ * back, so the DF object may change.
+ */
+PUBLIC err_t
+some_dir_del(MemDev *mdev, SomeSB *sb, struct some_dir **pdir, fid_t fid)
+{
+	struct some_dir      *dir = *pdir;
+	struct some_df_child *c, old;
+	bool  found;
+	u16   pos;
+	err_t err;
+
+	pos = dir_search(dir, fid, &found);
+	if (!found) return E_NOENT;
+
+	c   = dir_child(dir, dir->index[pos]);
+	old = *c;
+	*c  = UNSET_CHILD;
+
+	err = dir_write_slot(mdev, dir, dir->index[pos]);
+	if (err) {
+		*c = old;
+		return err;
+	}
+
+	dir->count--;
+	memmove(&dir->index[pos], &dir->index[pos + 1],
+	        (dir->count - pos) * sizeof(dir->index[0]));
+
+	dir_trim(mdev, sb, pdir);
+
+	return E_GOOD;
+}
+
+/**
+ * Give back the chained blocks of a removed DF. The first one belongs to the
+ * data of its file header.
+ */
+PUBLIC err_t
+some_dir_destroy(MemDev *mdev, SomeSB *sb, struct some_dir *dir)
+{
+	err_t err;
+	u8    b;
+
+	for (b = dir->blocks; b > 1; b--) {
+		err = somefs_free(mdev, sb, dir->addr[b - 1], sizeof(SomeDF));
+		if (err) return err;
+	}
+
+	return E_GOOD;
+}
@@ -0,0 +1,41 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#pragma once
+
+struct some_dir;
+
+PUBLIC err_t   some_dir_load ( MemDev *, laddr_t, struct some_dir ** );
+PUBLIC void    some_dir_free ( struct some_dir * );
+
+PUBLIC laddr_t some_dir_find ( const struct some_dir *, fid_t );
+PUBLIC bool    some_dir_is_empty( const struct some_dir * );
+
+PUBLIC err_t   some_dir_add ( MemDev *, SomeSB *, struct some_dir **, fid_t,
+                              laddr_t );
+PUBLIC err_t   some_dir_del ( MemDev *, SomeSB *, struct some_dir **, fid_t );
+
+PUBLIC err_t   some_dir_destroy( MemDev *, SomeSB *, struct some_dir * );
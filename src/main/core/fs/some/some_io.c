@@ -27,8 +27,11 @@
 /* System includes */
 #include <flxlib.h>
 #include <i7816.h>
+#include <string.h>
 /* Dependency includes */
 #include <io/dev.h>
+#include <fs/smartfs.h>
+#include <fs/path.h>
 
 /* Package includes */
 #include "somefs.h"
@@ -74,32 +77,368 @@ fh_is_invalid( SomeFH *fh ) {
 	return !fh_is_valid(fh);
 }
 
+/**
+ * Mark the superblock on the device as open, before the first change after a
+ * commit.
+ */
+PUBLIC err_t
+some_sb_open(MemDev *mdev, SomeSB *sb)
+{
+	err_t err;
+
+	if (sb->flags & SOMEFS_SB_OPEN)
+		return E_GOOD;
+
+	sb->flags |= SOMEFS_SB_OPEN;
+
+	err = some_sb_write(mdev, sb);
+	if (err) sb->flags &= ~SOMEFS_SB_OPEN;
+
+	return err;
+}
+
+PRIVATE u8
+extent_count(const SomeSB *sb)
+{
+	u8 n = 0;
+
+	while (n < SOMEFS_FREE_EXTENTS && sb->free[n].bytes)
+		n++;
+
+	return n;
+}
+
+PRIVATE void
+extent_remove(SomeSB *sb, u8 i, u8 n)
+{
+	memmove(&sb->free[i], &sb->free[i + 1],
+	        (n - i - 1) * sizeof(sb->free[0]));
+
+	sb->free[n - 1].addr  = NO_ADDR;
+	sb->free[n - 1].bytes = 0;
+}
+
+PRIVATE void
+extent_insert(SomeSB *sb, u8 i, u8 n, laddr_t addr, u32 bytes)
+{
+	memmove(&sb->free[i + 1], &sb->free[i], (n - i) * sizeof(sb->free[0]));
+
+	sb->free[i].addr  = addr;
+	sb->free[i].bytes = bytes;
+}
+
+/**
+ * @return the smallest extent of at least 'bytes', or the first one of 'n'
+ *         if it was passed 'bytes' of 0
+ */
+PRIVATE u8
+extent_smallest(const SomeSB *sb, u8 n, u32 bytes)
+{
+	u8 i, best = n;
+
+	for (i = 0; i < n; i++) {
+		if (sb->free[i].bytes < bytes)
+			continue;
+		if (best == n || sb->free[i].bytes < sb->free[best].bytes)
+			best = i;
+	}
+
+	return best;
+}
+
+/**
+ * Take a range, that is in use, out of the free extents.
+ */
+PRIVATE void
+extent_carve(SomeSB *sb, laddr_t addr, u32 bytes)
+{
+	struct some_extent *e;
+	laddr_t end = addr + bytes;
+	laddr_t e_end;
+	u8      n = extent_count(sb);
+	u8      i = 0;
+
+	while (i < n) {
+		e     = &sb->free[i];
+		e_end = e->addr + e->bytes;
+
+		if (e_end <= addr || e->addr >= end) {
+			i++;
+		} else if (e->addr < addr && e_end > end) {
+			/* without room for the upper part, it is not reused */
+			e->bytes = addr - e->addr;
+			if (n < SOMEFS_FREE_EXTENTS)
+				extent_insert(sb, i + 1, n, end, e_end - end);
+			return;
+		} else if (e->addr < addr) {
+			e->bytes = addr - e->addr;
+			i++;
+		} else if (e_end > end) {
+			e->bytes = e_end - end;
+			e->addr  = end;
+			i++;
+		} else {
+			extent_remove(sb, i, n--);
+		}
+	}
+}
+
 /* ===== Public functions =================================================== */
 /**
  * Allocate memory for new file system objects
+ *
+ * The superblock of the mounted file system is the authority, allocating
+ * does not touch the device. Only the first allocation after a commit marks
+ * the superblock on the device as open, see some_sb_recover.
+ *
+ * Freed space is taken first, from the smallest extent that fits.
  */
 PUBLIC laddr_t
 somefs_alloc(MemDev *mdev, SomeSB *sb, size_t bytes) {
+	struct some_extent *e;
 	laddr_t addr;
-	err_t   err;
-
-	err = some_sb_read(mdev, sb);
-	if (err) return NO_ADDR;
+	u8      n, i;
 
-	addr = sb->next_free_addr;
+	n = extent_count(sb);
+	i = bytes ? extent_smallest(sb, n, bytes) : n;
 
 	/* not enough memory left */
-	if ((addr + bytes) > sb->total_bytes)
+	if (i == n && (sb->next_free_addr + bytes) > sb->total_bytes)
 		return NO_ADDR;
 
-	sb->next_free_addr += bytes;
+	if (some_sb_open(mdev, sb))
+		return NO_ADDR;
 
-	err = some_sb_write(mdev, sb);
-	if (err) return NO_ADDR;
+	if (i == n) {
+		addr = sb->next_free_addr;
+		sb->next_free_addr += bytes;
+		return addr;
+	}
+
+	e    = &sb->free[i];
+	addr = e->addr;
+
+	e->addr  += bytes;
+	e->bytes -= bytes;
+	if (!e->bytes)
+		extent_remove(sb, i, n);
 
 	return addr;
 }
 
+/**
+ * Give back memory of a removed file system object. Neighbouring extents are
+ * merged, space at the end of the allocated memory is given back to
+ * next_free_addr. If there is no room to record an extent, the smallest one
+ * is not reused.
+ */
+PUBLIC err_t
+somefs_free(MemDev *mdev, SomeSB *sb, laddr_t addr, size_t bytes)
+{
+	struct some_extent *e;
+	err_t err;
+	u8    n, i;
+
+	if (!bytes) return E_GOOD;
+
+	if (addr < sizeof(*sb) || (addr + bytes) > sb->next_free_addr)
+		return E_BAD_PARAM | E_RANGE;
+
+	err = some_sb_open(mdev, sb);
+	if (err) return err;
+
+	n = extent_count(sb);
+
+	if (addr + bytes == sb->next_free_addr) {
+		sb->next_free_addr = addr;
+
+		/* the last extent may end there */
+		if (n && sb->free[n - 1].addr + sb->free[n - 1].bytes == addr) {
+			sb->next_free_addr = sb->free[n - 1].addr;
+			extent_remove(sb, n - 1, n);
+		}
+
+		return E_GOOD;
+	}
+
+	for (i = 0; i < n && sb->free[i].addr < addr; i++)
+		;
+
+	if (i && sb->free[i - 1].addr + sb->free[i - 1].bytes == addr) {
+		e = &sb->free[i - 1];
+		e->bytes += bytes;
+
+		/* which may close the gap to the next one */
+		if (i < n && e->addr + e->bytes == sb->free[i].addr) {
+			e->bytes += sb->free[i].bytes;
+			extent_remove(sb, i, n);
+		}
+	} else if (i < n && addr + bytes == sb->free[i].addr) {
+		sb->free[i].addr   = addr;
+		sb->free[i].bytes += bytes;
+	} else {
+		if (n == SOMEFS_FREE_EXTENTS) {
+			e = &sb->free[extent_smallest(sb, n, 0)];
+			if (e->bytes >= bytes)
+				return E_GOOD;
+
+			if (e < &sb->free[i]) i--;
+			extent_remove(sb, e - sb->free, n--);
+		}
+
+		extent_insert(sb, i, n, addr, bytes);
+	}
+
+	return E_GOOD;
+}
+
+/**
+ * @return number of bytes allocated for the sections of an object below the
+ *         MF, including the section map in front of them
+ */
+PUBLIC u32
+some_fh_data_bytes(const SomeFH *fh)
+{
+	return fh->sections * (sizeof(struct section_map) + fh->sec_size);
+}
+
+/**
+ * Write back allocations of a mounted file system.
+ */
+PUBLIC err_t
+some_sb_commit(MemDev *mdev, SomeSB *sb)
+{
+	err_t err;
+
+	if (!(sb->flags & SOMEFS_SB_OPEN))
+		return E_GOOD;
+
+	sb->flags &= ~SOMEFS_SB_OPEN;
+
+	err = some_sb_write(mdev, sb);
+	if (err) sb->flags |= SOMEFS_SB_OPEN;
+
+	return err;
+}
+
+PRIVATE err_t
+sb_recover_object(void *ctx, laddr_t dir, fid_t fid, laddr_t ino,
+                  const SomeFH *fh)
+{
+	SomeSB *sb = ctx;
+	u32    bytes;
+
+	/* the parent does not matter, only the space taken */
+	PARAM_UNUSED(dir);
+
+	/* a block chained to a DF */
+	if (fid == SOMEFS_DF_LINK) {
+		sb->next_free_addr = MAX(sb->next_free_addr, ino + sizeof(SomeDF));
+		extent_carve(sb, ino, sizeof(SomeDF));
+		return E_GOOD;
+	}
+
+	bytes = some_fh_data_bytes(fh);
+
+	sb->next_free_addr = MAX(sb->next_free_addr, fh->data + bytes);
+	sb->next_free_addr = MAX(sb->next_free_addr, ino + sizeof(*fh));
+
+	/* space freed before the last commit may have been taken again */
+	extent_carve(sb, ino, sizeof(*fh));
+	extent_carve(sb, fh->data, bytes);
+
+	return E_GOOD;
+}
+
+/**
+ * The superblock has not been committed after its last changes. Allocations
+ * are found again by the objects of the tree, which are all stored behind the
+ * allocation mark or within the free extents recorded. Space freed since the
+ * commit is not reused.
+ */
+PUBLIC err_t
+some_sb_recover(MemDev *mdev, SomeSB *sb)
+{
+	SomeFH fh;
+	err_t  err;
+
+	if (!(sb->flags & SOMEFS_SB_OPEN))
+		return E_GOOD;
+
+	err = some_fh_read(mdev, sb->mf_header, &fh);
+	if (err) return err;
+
+	err = some_tree_walk(mdev, sb->mf_header, fh.data, sb_recover_object, sb);
+	if (err) return err;
+
+	if (sb->snapshot != NO_ADDR) {
+		sb->next_free_addr = MAX(sb->next_free_addr,
+		                         sb->snapshot + sizeof(struct some_snap));
+		extent_carve(sb, sb->snapshot, sizeof(struct some_snap));
+	}
+
+	return some_sb_commit(mdev, sb);
+}
+
+PRIVATE err_t
+tree_walk(MemDev *mdev, laddr_t dir, laddr_t data, some_walk_fn fn, void *ctx,
+          u8 depth)
+{
+	SomeDF  df;
+	SomeFH  fh;
+	laddr_t addr;
+	laddr_t next;
+	err_t   err;
+	u8      i, blocks;
+
+	if (depth > MAX_PATH_DEPTH) return E_FS;
+
+	for (blocks = 0; data != NO_ADDR; blocks++, data = next) {
+		if (blocks == SOMEFS_DF_MAX_BLOCKS) return E_FS;
+
+		err = some_df_read(mdev, data, &df);
+		if (err) return err;
+
+		next = NO_ADDR;
+
+		FOR_EACH_DF_CHILD (i) {
+			if (!df.child[i].fid) continue;
+
+			addr = df.child[i].addr;
+
+			if (df.child[i].fid == SOMEFS_DF_LINK) {
+				next = addr;
+				err  = fn(ctx, dir, SOMEFS_DF_LINK, addr, NULL);
+				if (err) return err;
+				continue;
+			}
+
+			err = some_fh_read(mdev, addr, &fh);
+			if (err) return err;
+
+			err = fn(ctx, dir, df.child[i].fid, addr, &fh);
+			if (err) return err;
+
+			if (i7_ftype(fh.fdb) != DF) continue;
+
+			err = tree_walk(mdev, addr, fh.data, fn, ctx, depth + 1);
+			if (err) return err;
+		}
+	}
+
+	return E_GOOD;
+}
+
+/**
+ * Visit every object below a DF, given by its inode and its data.
+ */
+PUBLIC err_t
+some_tree_walk(MemDev *mdev, laddr_t dir, laddr_t data, some_walk_fn fn,
+               void *ctx)
+{
+	return tree_walk(mdev, dir, data, fn, ctx, 1);
+}
+
 
 PUBLIC err_t
 some_fh_read(MemDev *mdev, laddr_t addr, SomeFH *fh)
@@ -158,6 +497,23 @@ some_df_write(MemDev *mdev, laddr_t addr, SomeDF *df)
 	return E_GOOD;
 }
 
+/**
+ * Write a single child slot of a SomeDF stored at addr.
+ */
+PUBLIC err_t
+some_df_write_child(MemDev *mdev, laddr_t addr, const SomeDF *df, u8 slot)
+{
+	err_t err;
+
+	if (slot >= SOMEFS_MAX_DIR_ENTRIES) return E_BAD_PARAM | E_RANGE;
+
+	err = mdev->write(addr + slot * sizeof(df->child[0]),
+	                  sizeof(df->child[0]), SRC(&df->child[slot]));
+	if (err) return E_HWW;
+
+	return E_GOOD;
+}
+
 PUBLIC err_t
 some_sb_read(MemDev *mdev, SomeSB *sb)
 {
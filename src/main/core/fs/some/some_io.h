@@ -27,12 +27,27 @@
 #pragma once
 
 PUBLIC laddr_t  somefs_alloc(MemDev*, SomeSB *, size_t);
+PUBLIC err_t    somefs_free(MemDev*, SomeSB *, laddr_t, size_t);
+PUBLIC u32      some_fh_data_bytes(const SomeFH *);
 
 PUBLIC err_t some_sb_read  ( MemDev *, SomeSB * );
 PUBLIC err_t some_sb_write ( MemDev *, SomeSB * );
+PUBLIC err_t some_sb_open  ( MemDev *, SomeSB * );
+PUBLIC err_t some_sb_commit( MemDev *, SomeSB * );
+PUBLIC err_t some_sb_recover( MemDev *, SomeSB * );
+
+/**
+ * Called for each object below a DF: the DF inode, the FID, the inode of the
+ * object and its file header. Further blocks of a DF are passed as objects
+ * of FID SOMEFS_DF_LINK without a file header.
+ */
+typedef err_t (*some_walk_fn)(void *, laddr_t, fid_t, laddr_t, const SomeFH *);
+
+PUBLIC err_t some_tree_walk( MemDev *, laddr_t, laddr_t, some_walk_fn, void * );
 
 PUBLIC err_t some_df_read  ( MemDev *, laddr_t, SomeDF * );
 PUBLIC err_t some_df_write ( MemDev *, laddr_t, SomeDF * );
+PUBLIC err_t some_df_write_child ( MemDev *, laddr_t, const SomeDF *, u8 );
 
 PUBLIC err_t some_fh_read ( MemDev *, laddr_t, SomeFH * );
 PUBLIC err_t some_fh_write( MemDev *, laddr_t, SomeFH * );
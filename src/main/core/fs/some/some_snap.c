@@ -0,0 +1,470 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+/**
+ * some_snap.c
+ *
+ * The tree snapshot is an optional, read-mostly region holding a summary of
+ * every file system object. It is loaded on mount by a single read. Lookups
+ * and inode reads are answered from it without touching DFs or file headers.
+ *
+ * Changes of the tree go to the copy in memory only. The region is marked
+ * invalid before the first change after a commit and written back on the
+ * next one, so the device never holds a snapshot lagging behind the tree.
+ */
+
+#include <flxlib.h>
+#include <i7816.h>
+#include <string.h>
+
+#include <io/dev.h>
+#include <fs/smartfs.h>
+
+#include "somefs.h"
+#include "data.h"
+#include "some_io.h"
+#include "some_snap.h"
+
+/* ===== Local functions =================================================== */
+PRIVATE inline u32
+snap_bytes(const struct some_snap *snap)
+{
+	return offsetof(struct some_snap, entry)
+	     + snap->count * sizeof(snap->entry[0]);
+}
+
+PRIVATE int
+snap_cmp(const struct some_snap_entry *e, laddr_t parent, fid_t fid)
+{
+	if (e->parent != parent) return e->parent < parent ? -1 : 1;
+	if (e->fid    != fid)    return e->fid    < fid    ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * @return the index of the entry, or the index it belongs to if not found
+ */
+PRIVATE u8
+snap_search(const struct some_snap *snap, laddr_t parent, fid_t fid,
+            bool *found)
+{
+	u8  lo = 0;
+	u8  hi = snap->count;
+	u8  mid;
+	int c;
+
+	*found = false;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		c   = snap_cmp(&snap->entry[mid], parent, fid);
+
+		if (!c) {
+			*found = true;
+			return mid;
+		}
+
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+PRIVATE void
+snap_fill(struct some_snap_entry *e, laddr_t parent, fid_t fid, laddr_t ino,
+          const SomeFH *fh)
+{
+	e->parent   = parent;
+	e->fid      = fid;
+	e->ino      = ino;
+	e->fdb      = fh->fdb;
+	e->lcs      = fh->lcs;
+	e->data     = fh->data;
+	e->sections = fh->sections;
+	e->sec_size = fh->sec_size;
+}
+
+PRIVATE void
+snap_sort(struct some_snap *snap)
+{
+	struct some_snap_entry e;
+	u8 i, j;
+
+	for (i = 1; i < snap->count; i++) {
+		e = snap->entry[i];
+
+		for (j = i; j && snap_cmp(&snap->entry[j - 1], e.parent, e.fid) > 0; j--)
+			snap->entry[j] = snap->entry[j - 1];
+
+		snap->entry[j] = e;
+	}
+}
+
+/**
+ * Overwrite the magic number of the region, so it is not loaded on mount.
+ */
+PRIVATE err_t
+snap_clear(MemDev *mdev, const SomeSuper *ss)
+{
+	const u8 magic = 0;
+
+	if (mdev->write(ss->sb.snapshot, sizeof(magic), SRC(&magic)))
+		return E_HWW;
+
+	return E_GOOD;
+}
+
+/**
+ * Write the copy of the snapshot. The magic number goes last, so the region
+ * stays invalid, if writing is interrupted.
+ */
+PRIVATE err_t
+snap_write(MemDev *mdev, SomeSuper *ss)
+{
+	const struct some_snap *snap = ss->snap;
+	laddr_t addr = ss->sb.snapshot;
+
+	if (!ss->snap_open && snap_clear(mdev, ss))
+		return E_HWW;
+
+	if (mdev->write(addr + sizeof(snap->magic),
+	                snap_bytes(snap) - sizeof(snap->magic), SRC(&snap->count))
+	||  mdev->write(addr, sizeof(snap->magic), SRC(&snap->magic)))
+		return E_HWW;
+
+	ss->snap_open = false;
+
+	return E_GOOD;
+}
+
+/**
+ * The snapshot could not follow the tree. Lookups fall back to the DFs, even
+ * after the next mount.
+ */
+PRIVATE err_t
+snap_invalidate(MemDev *mdev, SomeSuper *ss)
+{
+	some_snap_drop(ss);
+
+	if (ss->sb.snapshot == NO_ADDR)
+		return E_GOOD;
+
+	return snap_clear(mdev, ss);
+}
+
+PRIVATE err_t
+snap_add(void *ctx, laddr_t dir, fid_t fid, laddr_t ino, const SomeFH *fh)
+{
+	struct some_snap *snap = ctx;
+
+	if (!fh) return E_GOOD;
+
+	if (snap->count == SOMEFS_SNAP_ENTRIES) return E_NOMEM;
+
+	snap_fill(&snap->entry[snap->count++], dir, fid, ino, fh);
+
+	return E_GOOD;
+}
+
+/**
+ * Fill the copy of the snapshot by a walk of the whole tree.
+ */
+PRIVATE err_t
+snap_build(MemDev *mdev, SomeSuper *ss)
+{
+	SomeFH fh;
+	err_t  err;
+
+	if (!ss->snap) {
+		ss->snap = malloc(sizeof(*ss->snap));
+		if (!ss->snap) return E_NOMEM;
+	}
+
+	ss->snap->magic = SOMEFS_SNAP_MAGIC;
+	ss->snap->count = 0;
+
+	err = some_fh_read(mdev, ss->sb.mf_header, &fh);
+	if (err) return err;
+
+	snap_fill(&ss->snap->entry[ss->snap->count++], NO_ADDR, MF,
+	          ss->sb.mf_header, &fh);
+
+	err = some_tree_walk(mdev, ss->sb.mf_header, fh.data, snap_add, ss->snap);
+	if (err) return err;
+
+	snap_sort(ss->snap);
+
+	return E_GOOD;
+}
+
+/* ===== Public functions =================================================== */
+PUBLIC err_t
+somefs_snapshot(Super *s)
+{
+	SomeSuper *ss;
+	MemDev    *mdev;
+	laddr_t   addr;
+	err_t     err;
+
+	CHECK_PARAM__NOT_NULL (s);
+	CHECK_PARAM__NOT_NULL (s->s_ctx);
+
+	ss   = s->s_ctx;
+	mdev = s->s_mdev;
+
+	err = snap_build(mdev, ss);
+	if (err) goto fail;
+
+	/* the region is allocated once with room for all entries and written,
+	 * before the superblock points to it */
+	addr = ss->sb.snapshot;
+	if (addr == NO_ADDR) {
+		ss->sb.snapshot = somefs_alloc(mdev, &ss->sb, sizeof(*ss->snap));
+		if (!ss->sb.snapshot) {
+			err = E_NOMEM;
+			goto fail;
+		}
+	}
+
+	err = snap_write(mdev, ss);
+	if (err) goto fail;
+
+	if (addr == NO_ADDR) {
+		err = some_sb_commit(mdev, &ss->sb);
+		if (err) goto fail;
+	}
+
+	return E_GOOD;
+
+fail:
+	snap_invalidate(mdev, ss);
+	return err;
+}
+
+PUBLIC err_t
+some_snap_load(MemDev *mdev, SomeSuper *ss)
+{
+	struct some_snap *snap;
+
+	ss->snap      = NULL;
+	ss->snap_open = false;
+
+	if (ss->sb.snapshot == NO_ADDR)
+		return E_GOOD;
+
+	snap = malloc(sizeof(*snap));
+	if (!snap) return E_NOMEM;
+
+	if (mdev->read(ss->sb.snapshot, sizeof(*snap), DEST(snap))) {
+		free(snap);
+		return E_HWR;
+	}
+
+	/* an invalidated snapshot is just ignored */
+	if (snap->magic != SOMEFS_SNAP_MAGIC
+	||  snap->count >  SOMEFS_SNAP_ENTRIES)
+	{
+		free(snap);
+		return E_GOOD;
+	}
+
+	ss->snap = snap;
+
+	return E_GOOD;
+}
+
+/**
+ * The superblock was not committed at the end of the last session, so the
+ * snapshot may not know its last changes. It is built again from the tree.
+ * A tree, that does not fit, leaves the snapshot invalid.
+ */
+PUBLIC err_t
+some_snap_rebuild(MemDev *mdev, SomeSuper *ss)
+{
+	ss->snap      = NULL;
+	ss->snap_open = false;
+
+	if (ss->sb.snapshot == NO_ADDR)
+		return E_GOOD;
+
+	if (snap_build(mdev, ss) || snap_write(mdev, ss))
+		return snap_invalidate(mdev, ss);
+
+	return E_GOOD;
+}
+
+PUBLIC void
+some_snap_drop(SomeSuper *ss)
+{
+	free(ss->snap);
+	ss->snap      = NULL;
+	ss->snap_open = false;
+}
+
+/**
+ * Mark the snapshot on the device invalid, before the tree is changed for the
+ * first time after a commit. The superblock is opened too, so the snapshot is
+ * built again on mount, if there is no commit.
+ */
+PUBLIC err_t
+some_snap_open(MemDev *mdev, SomeSuper *ss)
+{
+	err_t err;
+
+	if (!ss->snap || ss->snap_open)
+		return E_GOOD;
+
+	err = some_sb_open(mdev, &ss->sb);
+	if (!err)
+		err = snap_clear(mdev, ss);
+	if (err) return err;
+
+	ss->snap_open = true;
+
+	return E_GOOD;
+}
+
+/**
+ * Write back the snapshot of an open session. A snapshot, that can not be
+ * written, is given up.
+ */
+PUBLIC void
+some_snap_commit(MemDev *mdev, SomeSuper *ss)
+{
+	if (!ss->snap || !ss->snap_open)
+		return;
+
+	if (snap_write(mdev, ss))
+		snap_invalidate(mdev, ss);
+}
+
+PUBLIC const struct some_snap_entry *
+some_snap_lookup(const SomeSuper *ss, laddr_t parent, fid_t fid)
+{
+	bool found;
+	u8   i;
+
+	if (!ss->snap) return NULL;
+
+	i = snap_search(ss->snap, parent, fid, &found);
+
+	return found ? &ss->snap->entry[i] : NULL;
+}
+
+PUBLIC const struct some_snap_entry *
+some_snap_find_ino(const SomeSuper *ss, laddr_t ino)
+{
+	const struct some_snap_entry *e;
+
+	if (!ss->snap) return NULL;
+
+	for_each(e, ss->snap->entry, ss->snap->count) {
+		if (e->ino == ino)
+			return e;
+	}
+
+	return NULL;
+}
+
+/**
+ * Add a new object to the snapshot. If there is no room left, the snapshot
+ * is given up. The region has been opened before.
+ */
+PUBLIC void
+some_snap_insert(SomeSuper *ss, laddr_t parent, fid_t fid, laddr_t ino,
+                 const SomeFH *fh)
+{
+	struct some_snap *snap = ss->snap;
+	bool  found;
+	u8    i;
+
+	if (!snap) return;
+
+	i = snap_search(snap, parent, fid, &found);
+
+	if (!found) {
+		if (snap->count == SOMEFS_SNAP_ENTRIES) {
+			some_snap_drop(ss);
+			return;
+		}
+
+		memmove(&snap->entry[i + 1], &snap->entry[i],
+		        (snap->count - i) * sizeof(snap->entry[0]));
+		snap->count++;
+	}
+
+	snap_fill(&snap->entry[i], parent, fid, ino, fh);
+}
+
+/**
+ * Forget a removed object.
+ */
+PUBLIC void
+some_snap_remove(SomeSuper *ss, laddr_t parent, fid_t fid)
+{
+	struct some_snap *snap = ss->snap;
+	bool  found;
+	u8    i;
+
+	if (!snap) return;
+
+	i = snap_search(snap, parent, fid, &found);
+	if (!found) return;
+
+	snap->count--;
+	memmove(&snap->entry[i], &snap->entry[i + 1],
+	        (snap->count - i) * sizeof(snap->entry[0]));
+}
+
+/**
+ * Follow a changed file header of an object within the snapshot.
+ */
+PUBLIC void
+some_snap_update(SomeSuper *ss, laddr_t ino, const SomeFH *fh)
+{
+	struct some_snap_entry *e;
+
+	e = (struct some_snap_entry *) some_snap_find_ino(ss, ino);
+	if (!e) return;
+
+	snap_fill(e, e->parent, e->fid, ino, fh);
+}
+
+PUBLIC void
+some_snap_to_fh(const struct some_snap_entry *e, SomeFH *fh)
+{
+	some_fh_clean(fh);
+
+	fh->fdb      = e->fdb;
+	fh->lcs      = e->lcs;
+	fh->data     = e->data;
+	fh->sections = e->sections;
+	fh->sec_size = e->sec_size;
+}
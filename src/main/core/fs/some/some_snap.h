@@ -0,0 +1,48 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#pragma once
+
+struct some_snap_entry;
+
+PUBLIC err_t some_snap_load   ( MemDev *, SomeSuper * );
+PUBLIC err_t some_snap_rebuild( MemDev *, SomeSuper * );
+PUBLIC void  some_snap_drop   ( SomeSuper * );
+
+PUBLIC err_t some_snap_open  ( MemDev *, SomeSuper * );
+PUBLIC void  some_snap_commit( MemDev *, SomeSuper * );
+
+PUBLIC const struct some_snap_entry *
+some_snap_lookup( const SomeSuper *, laddr_t, fid_t );
+PUBLIC const struct some_snap_entry *
+some_snap_find_ino( const SomeSuper *, laddr_t );
+
+PUBLIC void  some_snap_insert( SomeSuper *, laddr_t, fid_t, laddr_t,
+                               const SomeFH * );
+PUBLIC void  some_snap_remove( SomeSuper *, laddr_t, fid_t );
+PUBLIC void  some_snap_update( SomeSuper *, laddr_t, const SomeFH * );
+
+PUBLIC void  some_snap_to_fh( const struct some_snap_entry *, SomeFH * );
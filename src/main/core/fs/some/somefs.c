@@ -35,11 +35,17 @@
 #include "smartfs_impl.h"
 #include "data.h"
 #include "some_io.h"
+#include "some_snap.h"
 
 PRIVATE const laddr_t SUPER_BLOCK_START = 0;
 
 PUBLIC extern const struct super_does somefs_super_does;
 
+PUBLIC const struct fs_type somefs_fs_type = {
+	.name  = "somefs",
+	.mount = somefs_mount
+};
+
 /**
  *  File system creation is done by writing a Superblock and Root directory at
  *  the beginning of some memory device.
@@ -85,10 +91,11 @@ somefs_mkfs(MemDev *mdev)
 PUBLIC err_t
 somefs_mount(MemDev *mdev, Mount *mnt)
 {
-	err_t  err;
-	Super  *s;
-	Inode  *i;
-	SomeSB *sb;
+	err_t     err;
+	Super     *s;
+	Inode     *i;
+	SomeSuper *ss;
+	bool      unclean;
 
 	CHECK_PARAM__NOT_NULL (mdev);
 	CHECK_PARAM__NOT_NULL (mnt);
@@ -96,23 +103,42 @@ somefs_mount(MemDev *mdev, Mount *mnt)
 	s = mnt->super;
 
 	/*  */
-	sb = malloc(sizeof(*sb));
-	if (sb == NULL) return E_ALLOC;
-
-	err = some_sb_read(mdev, sb);
-	if (err) return E_INTERN | err;
+	ss = malloc(sizeof(*ss));
+	if (ss == NULL) return E_ALLOC;
+
+	ss->created = 0;
+
+	err = some_sb_read(mdev, &ss->sb);
+	unclean = !err && (ss->sb.flags & SOMEFS_SB_OPEN);
+	if (!err)
+		err = some_sb_recover(mdev, &ss->sb);
+
+	/* after an unclean session the snapshot is not trusted */
+	if (!err && unclean)
+		err = some_snap_rebuild(mdev, ss);
+	else if (!err)
+		err = some_snap_load(mdev, ss);
+	if (err) {
+		free(ss);
+		return E_INTERN | err;
+	}
 
 	/* reading super block was successful
 	 * write file system context to mount point */
 	s->s_mdev = mdev;
-	s->s_ctx  = sb;
+	s->s_ctx  = ss;
 	s->s_do   = &somefs_super_does;
 
-	i = iget(s, sb->mf_header);
-	if (i == NULL) return E_INTERN;
+	/* with a snapshot, the MF is read from it */
+	i = iget(s, ss->sb.mf_header);
+	if (i == NULL) {
+		somefs_super_do_put(s);
+		return E_INTERN;
+	}
 
 	if (somefs_do_read_inode(i)) {
 		destroy_inode(i);
+		somefs_super_do_put(s);
 		return E_FS;
 	}
 
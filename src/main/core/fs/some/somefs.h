@@ -30,15 +30,28 @@
 
 struct mem_dev;
 struct fs_mount;
+struct fs_type;
+struct super;
 
 enum SOMEFS_CONSTANTNS {
 	SOMEFS_MAGIC = 0x34,
+	SOMEFS_SNAP_MAGIC = 0x35,
+	/* FID of a DF child slot linking the next block of the DF */
+	SOMEFS_DF_LINK = 0xFFFF,
 	NO_ADDR = 0x00
 };
 
 
 err_t somefs_mkfs( struct mem_dev * );
 err_t somefs_mount( struct mem_dev *, struct fs_mount * );
+/**
+ * Write a snapshot of the whole tree, e.g. after personalization. Later
+ * changes are written back with the superblock, as long as it has room for
+ * new objects.
+ */
+err_t somefs_snapshot( struct super * );
+
+extern const struct fs_type somefs_fs_type;
 
 
 #endif
@@ -27,8 +27,12 @@
 #include <flxlib.h>
 #include <flxio.h>
 #include <io/stream.h>
+#include <io/iovec.h>
 #include "file_stream.h"
 
+/* bounce buffer size for streams without splice support */
+#define FILE_STREAM_CHUNK 64
+
 
 static inline struct file_stream_in *
 __to_fis(struct stream_in *is)
@@ -50,21 +54,116 @@ file_stream_get(struct stream_in *is, u8 *c)
 	return file_stream_read(is, c, 1);
 }
 
+/**
+ *  Skip bytes by moving the file position, without reading them.
+ *
+ *  Skipping stops at the end of data of the current section.
+ */
 PRIVATE u32
 file_stream_skip(struct stream_in *is, u32 bytes)
 {
-	return 0;
+	struct file_stream_in *fis = __to_fis(is);
+	u16 pos, end;
+
+	pos = f_tell(fis->fh);
+
+	if (f_seek(fis->fh, 0, SEEK_END))
+		return 0;
+
+	end   = f_tell(fis->fh);
+	bytes = MIN(bytes, (u32) (end > pos ? end - pos : 0));
+
+	if (f_seek(fis->fh, pos + bytes, SEEK_SET))
+		return 0;
+
+	return bytes;
+}
+
+/**
+ *  Give back bytes taken from the file but not accepted by an output stream.
+ */
+static inline void
+__unread(struct file_stream_in *fis, u32 bytes)
+{
+	if (bytes) f_seek(fis->fh, -((s32) bytes), SEEK_CUR);
+}
+
+/**
+ *  Splice file contents as device extents into the output stream.
+ *
+ *  @return Number of bytes spliced, zero if the file system has no device
+ *          mapping.
+ */
+PRIVATE u32
+file_stream_splice(struct file_stream_in *fis, struct stream_out *os, u32 bytes)
+{
+	struct iov_seg seg = { .type = IOV_EXTENT };
+	u32 passed = 0;
+	u32 spliced;
+
+	while (passed < bytes) {
+		seg.len = f_map(fis->fh, bytes - passed, &seg.ext.dev, &seg.ext.addr);
+
+		/* end of section */
+		if (!seg.len) break;
+
+		spliced = stream_splice(os, &seg);
+		passed += spliced;
+
+		if (spliced < seg.len) {
+			__unread(fis, seg.len - spliced);
+			break;
+		}
+	}
+
+	return passed;
+}
+
+/**
+ *  Pass file contents to the output stream in chunks.
+ *
+ *  Streams that are able to splice get references to the underlying device
+ *  ranges, any other stream gets blocks of FILE_STREAM_CHUNK bytes. Transfer
+ *  stops at the end of the current section.
+ */
+PRIVATE u32
+file_stream_push_to(struct stream_in *is, struct stream_out *os, u32 bytes)
+{
+	struct file_stream_in *fis = __to_fis(is);
+	u8  chunk[FILE_STREAM_CHUNK];
+	u32 passed = 0;
+	u32 got, written;
+
+	if (os->ops->splice)
+		passed = file_stream_splice(fis, os, bytes);
+
+	while (passed < bytes) {
+		got = f_read(chunk, 1, MIN(sizeof(chunk), bytes - passed), fis->fh);
+
+		/* end of section */
+		if (!got) break;
+
+		written = stream_write(os, chunk, got);
+		passed += written;
+
+		if (written < got) {
+			__unread(fis, got - written);
+			break;
+		}
+	}
+
+	return passed;
 }
 
 PRIVATE const struct stream_in_ops __file_stream_in_ops = {
 	.get = file_stream_get,
 	.read = file_stream_read,
 	.skip = file_stream_skip,
-	.push_to = NULL
+	.push_to = file_stream_push_to
 };
 
 PUBLIC err_t
-file_stream_in_init(struct file_stream_in *fis, FILE *fh)
+file_stream_in_init(struct file_stream_in *fis, FILE fh)
 {
 	fis->stream.ops = &__file_stream_in_ops;
 
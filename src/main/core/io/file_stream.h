@@ -30,13 +30,13 @@ struct stream_out;
 
 struct file_stream_in {
 	struct stream_in stream;
-	FILE   *fh;
+	FILE   fh;
 };
 
 struct file_stream_out {
 	struct stream_out stream;
-	FILE   *fh;
+	FILE   fh;
 };
 
 PUBLIC err_t
-file_stream_in_init(struct file_stream_in *, FILE *);
+file_stream_in_init(struct file_stream_in *, FILE);
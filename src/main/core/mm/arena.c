@@ -0,0 +1,164 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#include <flxlib.h>
+#include <string.h>
+#include <array.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN  sizeof(void *)
+
+/**
+ *  The arena buffer itself need not be aligned, so padding depends on the
+ *  address and not on the offset alone.
+ *
+ *  @return Offset of the first aligned address at or after 'base + off'.
+ */
+PRIVATE inline u32
+arena_align(const struct arena *a, u32 off)
+{
+	size_t addr = (size_t) (a->base + off);
+
+	return off + ((ARENA_ALIGN - addr % ARENA_ALIGN) % ARENA_ALIGN);
+}
+
+/**
+ *  @return True if the object ending at 'end' is the latest allocation.
+ */
+PRIVATE inline bool
+arena_is_top(const struct arena *a, const u8 *end)
+{
+	return MIN(arena_align(a, end - a->base), a->size) == a->top;
+}
+
+/**
+ *  Allocate some bytes from the arena.
+ *
+ *  @return Pointer to uninitialized memory or NULL, if the arena is exhausted.
+ */
+PUBLIC void *
+arena_alloc(struct arena *a, u32 bytes)
+{
+	u8  *obj;
+	u32 top;
+
+	if (!a) return NULL;
+
+	top = arena_align(a, a->top);
+
+	if ((top > a->size) || (bytes > a->size - top))
+		return NULL;
+
+	obj    = a->base + top;
+	a->top = arena_align(a, top + bytes);
+
+	/* an unaligned arena end still holds the object */
+	if (a->top > a->size) a->top = a->size;
+
+	return obj;
+}
+
+/**
+ *  Resize the latest allocation in place.
+ *
+ *  @return E_NOMEM, if 'obj' is not at top of the arena or there is not
+ *          enough space left.
+ */
+PUBLIC err_t
+arena_extend(struct arena *a, const void *obj, u32 old, u32 bytes)
+{
+	u32 off;
+
+	CHECK_PARAM__NOT_NULL (a);
+	CHECK_PARAM__NOT_NULL (obj);
+
+	if (!arena_is_top(a, (const u8 *) obj + old))
+		return E_NOMEM;
+
+	off = (const u8 *) obj - a->base;
+
+	if (bytes > a->size - off)
+		return E_NOMEM;
+
+	a->top = MIN(arena_align(a, off + bytes), a->size);
+
+	return E_GOOD;
+}
+
+/**
+ *  Allocate an empty array with capacity 'bytes' from the arena.
+ *
+ *  Array descriptor and data are allocated in one piece. Such an array is
+ *  released together with the arena and must not be passed to array_free().
+ */
+PUBLIC struct array *
+arena_array_alloc(struct arena *a, u32 bytes)
+{
+	struct array *new;
+
+	new = arena_alloc(a, sizeof(*new) + bytes);
+
+	if (!new) return NULL;
+
+	array_init(new, (u8 *) (new + 1), bytes);
+
+	return new;
+}
+
+/**
+ *  Raise the capacity of an arena backed array to 'bytes'.
+ *
+ *  If the array data is at top of the arena, it grows in place. Otherwise the
+ *  data is moved to a new arena location, the old memory is not reused
+ *  until the arena is released.
+ */
+PUBLIC err_t
+arena_array_grow(struct arena *a, struct array *arr, u32 bytes)
+{
+	u8 *val;
+
+	CHECK_PARAM__NOT_NULL (a);
+	CHECK_PARAM__NOT_NULL (arr);
+
+	if (bytes <= arr->max) return E_GOOD;
+
+	if (!arena_extend(a, arr->val, arr->max, bytes)) {
+		arr->__max = bytes;
+		return E_GOOD;
+	}
+
+	val = arena_alloc(a, bytes);
+
+	if (!val) return E_NOMEM;
+
+	memcpy(val, arr->val, arr->len);
+
+	arr->__val = val;
+	arr->__max = bytes;
+
+	return E_GOOD;
+}
@@ -0,0 +1,80 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#pragma once
+
+struct array;
+
+/**
+ *  Initialize an arena on top of a static buffer.
+ */
+#define Arena(buff, s)   { .base = (buff), .size = (s), .top = 0 }
+#define CArena(buff)     Arena(buff, sizeof((buff)))
+
+/**
+ *  A bump allocator for short living objects, e.g. of a single request.
+ *
+ *  Objects are never freed one by one. Instead the whole arena is reset, or
+ *  rolled back to a mark taken before.
+ */
+struct arena {
+	u8 *const  base;
+	const u32  size;
+	u32        top;
+};
+
+PUBLIC void *arena_alloc(struct arena *, u32);
+PUBLIC err_t arena_extend(struct arena *, const void *, u32, u32);
+
+PUBLIC struct array *arena_array_alloc(struct arena *, u32);
+PUBLIC err_t         arena_array_grow(struct arena *, struct array *, u32);
+
+static inline void
+arena_reset(struct arena *a)
+{
+	a->top = 0;
+}
+
+static inline u32
+arena_mark(const struct arena *a)
+{
+	return a->top;
+}
+
+/**
+ *  Release all objects allocated after 'mark' has been taken.
+ */
+static inline void
+arena_release(struct arena *a, u32 mark)
+{
+	if (mark < a->top) a->top = mark;
+}
+
+static inline u32
+arena_bytes_left(const struct arena *a)
+{
+	return a->size - a->top;
+}
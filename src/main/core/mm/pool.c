@@ -32,16 +32,111 @@
 
 PRIVATE inline u32 usage_slot_of(u32 e) { return e >> 3; }
 PRIVATE inline u8  usage_mark_of(u32 e) { return 1 << (e & 0x7); }
+PRIVATE inline u32 usage_bytes(const struct pool *p) { return (p->n + 7) >> 3; }
+
+#if defined(__GNUC__)
+#define ctz32(x)   __builtin_ctz(x)
+#else
+PRIVATE const u8 ctz_nibble[16] = {
+	4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
+};
+
+/* x must not be zero */
+PRIVATE inline u32
+ctz32(u32 x)
+{
+	u32 c = 0;
+
+	while (!(x & 0xF)) {
+		x >>= 4;
+		c  += 4;
+	}
+
+	return c + ctz_nibble[x & 0xF];
+}
+#endif
+
+/**
+ * Load four usage bytes starting at byte b. Missing bytes read as used.
+ */
+PRIVATE inline u32
+usage_word(const struct pool *p, u32 b)
+{
+	const u8 *u = p->usage + b;
+	u32 left = usage_bytes(p) - b;
+
+	if (left >= 4)
+		return u[0] | (u[1] << 8) | (u[2] << 16) | ((u32) u[3] << 24);
+
+	return u[0]
+	     | (left > 1 ? u[1] : 0xFF) << 8
+	     | (left > 2 ? u[2] : 0xFF) << 16
+	     | (u32) 0xFF << 24;
+}
+
+PRIVATE inline bool
+is_used(const struct pool *p, u32 i)
+{
+	return p->usage[usage_slot_of(i)] & usage_mark_of(i);
+}
+
+/**
+ * Find the first free member by the usage bitmap.
+ *
+ * @return index of the member or p->n, if there is none
+ */
+PRIVATE u32
+find_free(struct pool *p)
+{
+	u32 b, w;
+
+	for (b = p->hint; b < usage_bytes(p); b += 4) {
+		w = usage_word(p, b);
+		if (w == 0xFFFFFFFF) continue;
+
+		p->hint = b;
+		return MIN(p->n, (b << 3) + ctz32(~w));
+	}
+
+	p->hint = usage_bytes(p);
+	return p->n;
+}
+
+/**
+ * Pop a free member from the stack. Entries might have been taken by
+ * find_free() in the meantime, so they are checked against the bitmap.
+ */
+PRIVATE u32
+pop_free(struct pool *p)
+{
+	u32 i;
+
+	while (p->nfree) {
+		i = p->free[--p->nfree];
+		if (!is_used(p, i)) return i;
+	}
+
+	return p->n;
+}
 
 PUBLIC err_t
 pool_reset(struct pool *p)
 {
+	u32 i;
+
 	CHECK_PARAM__NOT_NULL (p);
 	CHECK_PARAM__NOT_NULL (p->usage);
 	CHECK_PARAM__NOT_NULL (p->memb);
 
 	memset(DEST(p->memb), 0x00, p->n * p->msize);
-	memset(DEST(p->usage), 0x00, (p->n + 7) >> 3);
+	memset(DEST(p->usage), 0x00, usage_bytes(p));
+	memset(&p->stats, 0x00, sizeof(p->stats));
+	p->hint = 0;
+
+	/* lowest index on top */
+	p->nfree = 0;
+	for (i = p->n; p->free && i; i--)
+		p->free[p->nfree++] = i - 1;
 
 	return E_GOOD;
 }
@@ -50,19 +145,25 @@ pool_reset(struct pool *p)
 PUBLIC void *
 pool_get(struct pool *p)
 {
-	u32 i, used, slot;
+	u32 i = p->n;
 
-	for (i = 0; i < p->n; i++) {
-		slot = usage_slot_of(i);
-		used = usage_mark_of(i);
+	if (p->free)
+		i = pop_free(p);
 
-		if (p->usage[slot] & used) continue;
+	if (i >= p->n)
+		i = find_free(p);
 
-		p->usage[slot] ^= used;
-		return p->memb + (i * p->msize);
+	if (i >= p->n) {
+		p->stats.fails++;
+		return NULL;
 	}
 
-	return NULL;
+	p->usage[usage_slot_of(i)] |= usage_mark_of(i);
+
+	p->stats.used++;
+	p->stats.high = MAX(p->stats.high, p->stats.used);
+
+	return p->memb + (i * p->msize);
 }
 
 /**
@@ -73,16 +174,13 @@ pool_get(struct pool *p)
 PUBLIC void *
 pool_lookup(const struct pool *p, u32 id)
 {
-	u32 i, used, slot;
+	u32 i;
 
 	if ( !id || id > p->n ) return NULL;
 
 	i = id - 1;
 
-	slot = usage_slot_of(i);
-	used = usage_mark_of(i);
-
-	if (!(p->usage[slot] & used)) return NULL;
+	if (!is_used(p, i)) return NULL;
 
 	return p->memb + (i * p->msize);
 }
@@ -102,23 +200,27 @@ pool_id(const struct pool *p, const void *m)
 PUBLIC err_t
 pool_put(struct pool *p, void *m)
 {
-	int i, used, slot;
-	
+	u32 i;
+
 	/* is this member m part of the pool? */
 	i = pool_id(p, m);
 	if (!i) return E_BAD_PARAM;
 	i -= 1;
 
-	/* convert array index i to bit position */
-	slot = usage_slot_of(i);
-	used = usage_mark_of(i);
+	if (p->flags & POOL_SANITIZE)
+		memset(m, 0x00, p->msize);
 
-	/* sanitize member */
-	memset(m, 0x00, p->msize);
+	/* putting a free member twice must not count twice */
+	if (!is_used(p, i))
+		return E_GOOD;
 
-	if (p->usage[slot] & used)
-		p->usage[slot] ^= used;
+	p->usage[usage_slot_of(i)] &= ~usage_mark_of(i);
+	p->hint = MIN(p->hint, usage_slot_of(i));
+	p->stats.used--;
+
+	/* the stack may hold stale entries, so it could be full */
+	if (p->free && p->nfree < p->n)
+		p->free[p->nfree++] = i;
 
 	return E_GOOD;
 }
-
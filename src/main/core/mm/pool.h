@@ -26,11 +26,37 @@
 
 #pragma once
 
+enum Pool_Flags {
+	POOL_SANITIZE = BIT_1          /**< zero members on pool_put() */
+};
+
+/**
+ *  Usage statistics, e.g. to size FS_MAX_ACTIVE_* settings.
+ */
+struct pool_stats {
+	u16 used;                      /**< members currently in use */
+	u16 high;                      /**< high-water mark of 'used' */
+	u16 fails;                     /**< pool_get() without a free member */
+};
+
+/**
+ *  A fixed number of equally sized members.
+ *
+ *  A usage bitmap marks members in use. It is searched a word at a time. An
+ *  optional stack of recently freed member indices makes pool_get() and
+ *  pool_put() O(1). It must provide room for n indices.
+ */
 struct pool {
 	const size_t  n;
 	const size_t  msize;
 	void *const memb;
 	u8   *const usage;
+	u16  *const free;
+	const u8    flags;
+	u16         nfree;
+	/* there is no free member below usage byte 'hint' */
+	u16         hint;
+	struct pool_stats stats;
 };
 
 PUBLIC extern err_t
@@ -47,4 +73,3 @@ pool_lookup(const struct pool *, u32);
 
 PUBLIC extern u32
 pool_id(const struct pool *, const void *);
-
@@ -32,6 +32,8 @@
  */
 
 #include <flxlib.h>
+#include <string.h>
+#include <array.h>
 #include <common/list.h>
 #include <io/stream.h>
 
@@ -44,16 +46,6 @@ enum Tlv_BerTag {
 	PRV_CLASS = 0x11 << 6
 };
 
-/**
- *  Instead of tlv_nesting structure the parser uses this one, which holds an
- *  additional end marker for each nesting.
- */
-struct tlv_parse_scope {
-	struct list_head   list;
-	u32 tag;
-	u16 end_marker;
-};
-
 /**
  * Decode SIMPLE-TLV length field.
  *
@@ -66,6 +58,8 @@ PUBLIC u8
 tlv_simple_decode_length(const u8 *buff, u16 *l)
 {
 	u8 byte = 0;
+
+	*l = 0;
 	if (buff[byte] == 0xFF) {
 		byte += 1;
 		*l = buff[byte] << 8;
@@ -95,25 +89,27 @@ __shift_add(u32 *v, u8 new)
 }
 
 /**
- *  Decode a BER tag field from data of an input stream.
+ *  Decode a BER tag field directly from a buffer.
  *
  *  Maximum supported tag field length is limited to three bytes.
  *
- *  @param[in]  input stream
+ *  @param[in]  start of the tag field
+ *  @param[in]  number of bytes available at src
  *  @param[out] tag value in raw BER format
- *  @param[out] field size, number bytes that have been taken from stream
+ *  @param[out] field size, number bytes that have been decoded
  *
- *  @return E_TLV on streaming error
+ *  @return E_TLV on truncated input
  *          E_TLV_TAG on any kind of bad formated tag field
  *          E_GOOD on success
  */
 PRIVATE err_t
-__decode_tag_ber(struct stream_in *is, u32 *tag, u8 *fs)
+__decode_tag_ber(const u8 *src, u32 avail, u32 *tag, u8 *fs)
 {
 #define SUBSEQUENT_BIT BIT_8
 	u8 t;
 
-	if (!stream_get(is, &t)) goto end_of_stream;
+	if (avail < 1) goto end_of_data;
+	t = src[0];
 
 	*tag = t;
 	*fs  = 1;
@@ -124,7 +120,8 @@ __decode_tag_ber(struct stream_in *is, u32 *tag, u8 *fs)
 	if ((t & 0x1F) != 0x1F) goto success;
 
 	/* decode second byte */
-	if (!stream_get(is, &t)) goto end_of_stream;
+	if (avail < 2) goto end_of_data;
+	t = src[1];
 	__shift_add(tag, t);
 	(*fs)++;
 
@@ -137,7 +134,8 @@ __decode_tag_ber(struct stream_in *is, u32 *tag, u8 *fs)
 	if (t < 0x80) goto success;
 
 	/* decode third byte */
-	if (!stream_get(is, &t)) goto end_of_stream;
+	if (avail < 3) goto end_of_data;
+	t = src[2];
 	__shift_add(tag, t);
 	(*fs)++;
 
@@ -145,29 +143,31 @@ __decode_tag_ber(struct stream_in *is, u32 *tag, u8 *fs)
 
 success:
 	return E_GOOD;
-end_of_stream:
+end_of_data:
 	return E_TLV;
 }
 
 /**
- *  Decode a BER length field from data of an input stream.
+ *  Decode a BER length field directly from a buffer.
  *
- *  @param[in]  input stream
+ *  @param[in]  start of the length field
+ *  @param[in]  number of bytes available at src
  *  @param[out] decoded length value
- *  @param[out] field size, number of bytes that have been taken from stream
+ *  @param[out] field size, number of bytes that have been decoded
  *
  *  @return E_GOOD on success
- *          E_TLV  on streaming error
+ *          E_TLV  on truncated input
  *          E_TLV_LEN on any length field violations
  */
-PRIVATE inline u8
-__decode_length_ber(struct stream_in *is, u32 *l, u8 *fs)
+PRIVATE inline err_t
+__decode_length_ber(const u8 *src, u32 avail, u32 *l, u8 *fs)
 {
 	u8 i;
 	u8 b;
 	u8 bytes;
 
-	if (!stream_get(is, &b)) goto end_of_stream;
+	if (avail < 1) return E_TLV;
+	b = src[0];
 
 	if (b < 0x80) {
 		*l = b;
@@ -180,43 +180,54 @@ __decode_length_ber(struct stream_in *is, u32 *l, u8 *fs)
 	bytes = b & 0x07;
 
 	if (!bytes || bytes > 4) return E_TLV_LEN;
+	if (avail < bytes + 1u)  return E_TLV;
+
+	for (i = 1, *l = 0; i <= bytes; i++)
+		__shift_add(l, src[i]);
 
-	/* XXX instead of this loop we could use stream_read with respect to
-	 * endianess */
-	for (i = 1, *l = 0; i <= bytes; i++) {
-		if (!stream_get(is, &b)) goto end_of_stream;
-		*l |= b << ((bytes - i) * 8);
-	}
 	*fs = bytes + 1;
 
 	return E_GOOD;
-
-end_of_stream:
-	return E_TLV;
 }
 
-PRIVATE inline struct tlv_parse_scope *
-scope_new(void)
+/**
+ *  Decode tag and length field at 'pos' and advance 'pos' to the value.
+ *
+ *  @return E_TLV_VAL if the value exceeds the buffer, any error of the tag
+ *          and length decoders otherwise.
+ */
+PRIVATE err_t
+__decode_header_ber(const u8 *src, u32 length, u32 *pos, u32 *tag, u32 *l)
 {
-	return malloc(sizeof(struct tlv_parse_scope));
-}
+	err_t err;
+	u8    field_size;
 
-PRIVATE inline void
-scope_destroy(struct tlv_parse_scope *s)
-{
-	free(s);
+	err = __decode_tag_ber(src + *pos, length - *pos, tag, &field_size);
+	if (err) return err;
+	*pos += field_size;
+
+	err = __decode_length_ber(src + *pos, length - *pos, l, &field_size);
+	if (err) return err;
+	*pos += field_size;
+
+	if (*l > length - *pos)
+		return E_TLV_VAL;
+
+	return E_GOOD;
 }
 
-PRIVATE u8
-__pop_nestings(u32 pos, struct list_head *nesting)
+/**
+ *  Close all scopes which end at 'pos'. The scope stack is linked into
+ *  tlv->nesting, innermost scope first.
+ */
+PRIVATE err_t
+__pop_nestings(u32 pos, struct tlv_parse_ctx *tlv, u8 *top)
 {
 	struct tlv_parse_scope *scope;
 
-	loop {
-		if (list_empty(nesting))
-			return E_GOOD;
-
-		scope = list_first_entry(nesting, struct tlv_parse_scope, list);
+	while (*top) {
+		scope = list_first_entry(&tlv->nesting, struct tlv_parse_scope,
+		                         nesting.list);
 
 		if (pos < scope->end_marker)
 			return E_GOOD;
@@ -224,39 +235,13 @@ __pop_nestings(u32 pos, struct list_head *nesting)
 		if (pos > scope->end_marker)
 			return E_TLV_FIT;
 
-		list_del(&(scope->list));
-		scope_destroy(scope);
+		list_del(&scope->nesting.list);
+		(*top)--;
 	}
-}
-
-PRIVATE err_t
-__push_nesting(struct tlv_parse_ctx *tlv, u32 pos)
-{
-	struct tlv_parse_scope *scope;
-
-	scope = scope_new();
-	if (!scope) return E_ALLOC;
-
-	scope->tag        = tlv->tag;
-	scope->end_marker = tlv->length + pos;
-
-	list_add(&scope->list, &tlv->nesting);
 
 	return E_GOOD;
 }
 
-PRIVATE void
-__clean_nestings(struct list_head *nesting)
-{
-	struct tlv_parse_scope *s;
-	struct list_head *pos, *q;
-	list_for_each_safe(pos, q, nesting) {
-		s = list_entry(pos, struct tlv_parse_scope, list);
-		list_del(pos);
-		scope_destroy(s);
-	}
-}
-
 PRIVATE inline bool
 __is_constructed(u32 tag) {
 	tag = tag & (0xFF << 16) ? tag & (0x20 << 16) :
@@ -267,69 +252,940 @@ __is_constructed(u32 tag) {
 }
 
 /**
- *  A non-recursive BER-TLV parser.
+ *  A non-recursive BER-TLV parser which works without any allocation.
  *
+ *  Each constructed object the visitor steps into occupies one entry of
+ *  the caller provided scope stack. Nesting deeper than 'depth' is rejected
+ *  with E_TLV_DEPTH.
  *
+ *  @return E_GOOD    if all data has been parsed
+ *          E_TLV     on STOP or truncated tag/length fields
+ *          E_TLV_VAL if a value exceeds the input buffer
+ *          E_TLV_FIT if an object exceeds its parent object
  */
 PUBLIC err_t
-tlv_parse_ber(const u8 *src, const u16 length, fp_tlv_visit visit, void *opaque)
+tlv_parse_ber_scoped(const u8 *src, const u16 length, fp_tlv_visit visit,
+                     void *opaque, struct tlv_parse_scope *stack, u8 depth)
 {
 	err_t  err;
-	u8     field_size;
+	u8     top = 0;
+	u32    pos = 0;
+	u32    end;
 	enum   Tlv_Parse_Cmd   cmd;
-	struct array_stream_in ais = ARRAY_STREAM_IN(src, length);
 	struct tlv_parse_ctx   tlv;
-	struct stream_in       *is = &ais.impl;
-
-	u16 pos = 0;
+	struct tlv_parse_scope *scope;
 
 	INIT_LIST_HEAD(&tlv.nesting);
 
 	while (pos < length) {
-decode_next:
-		err = __decode_tag_ber(is, &tlv.tag, &field_size);
-		if (err) goto cleanup;
-		pos += field_size;
+		err = __decode_header_ber(src, length, &pos, &tlv.tag, &tlv.length);
+		if (err) return err;
 
-		err = __decode_length_ber(is, &tlv.length, &field_size);
-		if (err) goto cleanup;
-		pos += field_size;
+		end = top ? stack[top - 1].end_marker : length;
+		if ((pos > end)
+		||  (tlv.length > end - pos))
+		{
+			return E_TLV_FIT;
+		}
 
 		tlv.value = src + pos;
 
 		cmd = visit(&tlv, opaque);
 
-		if (cmd == STOP) {
-			err = E_TLV;
-			goto cleanup;
-		}
+		if (cmd == STOP)
+			return E_TLV;
 
-		/**
-		 *
-		 */
 		if ((__is_constructed(tlv.tag))
 		&&  (cmd == STEP_INTO))
 		{
-			if ((err = __push_nesting(&tlv, pos)))
-				goto cleanup;
+			if (top >= depth)
+				return E_TLV_DEPTH;
 
-			goto decode_next;
-		}
+			scope = &stack[top++];
+			scope->nesting.tag = tlv.tag;
+			scope->end_marker  = pos + tlv.length;
 
-		if (stream_skip(is, tlv.length) != tlv.length) {
-			err = E_TLV_VAL;
-			goto cleanup;
+			list_add(&scope->nesting.list, &tlv.nesting);
+		} else {
+			pos += tlv.length;
 		}
 
+		if ((err = __pop_nestings(pos, &tlv, &top)))
+			return err;
+	}
+
+	return E_GOOD;
+}
+
+PUBLIC err_t
+tlv_parse_ber(const u8 *src, const u16 length, fp_tlv_visit visit, void *opaque)
+{
+	struct tlv_parse_scope stack[TLV_MAX_NESTING];
+
+	return tlv_parse_ber_scoped(src, length, visit, opaque,
+	                            stack, LENGTH(stack));
+}
+
+/**
+ *  A SIMPLE-TLV parser. Tags are one byte of 0x01 to 0xFE, the length field
+ *  is one byte or 0xFF followed by two bytes. There is no nesting, so
+ *  STEP_INTO is treated like NEXT.
+ */
+PUBLIC err_t
+tlv_parse_simple(const u8 *src, const u16 length, fp_tlv_visit visit,
+                 void *opaque)
+{
+	struct tlv_parse_ctx tlv;
+	u32 pos = 0;
+	u16 l;
+
+	INIT_LIST_HEAD(&tlv.nesting);
+
+	while (pos < length) {
+		if (length - pos < 2) return E_TLV;
+
+		tlv.tag = src[pos++];
+		if (tlv.tag == 0x00 || tlv.tag == 0xFF) return E_TLV_TAG;
+
+		if (src[pos] == 0xFF && length - pos < 3) return E_TLV;
+
+		pos += tlv_simple_decode_length(src + pos, &l);
+		tlv.length = l;
+
+		if (tlv.length > length - pos) return E_TLV_VAL;
+
+		tlv.value = src + pos;
+
+		if (visit(&tlv, opaque) == STOP) return E_TLV;
+
 		pos += tlv.length;
+	}
+
+	return E_GOOD;
+}
+
+/**
+ *  A COMPACT-TLV parser as used within historical bytes. Each object starts
+ *  with one byte holding the tag number in the high and the length in the
+ *  low nibble.
+ */
+PUBLIC err_t
+tlv_parse_compact(const u8 *src, const u16 length, fp_tlv_visit visit,
+                  void *opaque)
+{
+	struct tlv_parse_ctx tlv;
+	u32 pos = 0;
+
+	INIT_LIST_HEAD(&tlv.nesting);
+
+	while (pos < length) {
+		tlv.tag    = src[pos] >> 4;
+		tlv.length = src[pos] & 0x0F;
+		pos++;
+
+		if (tlv.length > length - pos) return E_TLV_VAL;
+
+		tlv.value = src + pos;
+
+		if (visit(&tlv, opaque) == STOP) return E_TLV;
+
+		pos += tlv.length;
+	}
+
+	return E_GOOD;
+}
+
+/**
+ *  Store a big endian unsigned integer of 'length' bytes at 'dest', which
+ *  is of 'size' bytes.
+ */
+PRIVATE err_t
+__schema_decode_uint(const u8 *val, u32 length, void *dest, u8 size)
+{
+	u32 v = 0;
+	u32 i;
+
+	if (length > size) return E_TLV_LEN;
+
+	for (i = 0; i < length; i++)
+		__shift_add(&v, val[i]);
+
+	switch (size) {
+	case 1: *(u8  *) dest = v; break;
+	case 2: *(u16 *) dest = v; break;
+	default: *(u32 *) dest = v;
+	}
+
+	return E_GOOD;
+}
+
+PRIVATE err_t
+__schema_decode(const struct tlv_field *f, const u8 *val, u32 length,
+                void *obj)
+{
+	void         *dest = (u8 *) obj + f->offset;
+	struct array *arr;
+
+	switch (f->kind) {
+	case TLV_FIELD_U8:
+		return __schema_decode_uint(val, length, dest, 1);
+	case TLV_FIELD_U16:
+		return __schema_decode_uint(val, length, dest, 2);
+	case TLV_FIELD_U32:
+		return __schema_decode_uint(val, length, dest, 4);
+	case TLV_FIELD_BYTES:
+		memcpy(dest, val, length);
+		return E_GOOD;
+	case TLV_FIELD_ARRAY:
+		/* the array references the source buffer, nothing is copied */
+		arr = dest;
+		arr->__val  = (u8 *) val;
+		arr->length = length;
+		arr->__max  = length;
+		return E_GOOD;
+	case TLV_FIELD_CUSTOM:
+		return f->decode(val, length, dest);
+	default:
+		return E_NO_LOGIC;
+	}
+}
+
+PRIVATE inline const struct tlv_field *
+__schema_lookup(const struct tlv_schema *schema, u32 parent, u32 tag)
+{
+	const struct tlv_field *f;
+
+	for_each(f, schema->field, schema->count) {
+		if (f->tag == tag && f->parent == parent)
+			return f;
+	}
+
+	return NULL;
+}
+
+/**
+ *  Decode BER-TLV data straight into the struct at 'obj' as described by
+ *  'schema'. Nested objects are entered if the schema declares a
+ *  TLV_FIELD_NESTED field for them.
+ *
+ *  @return E_GOOD    on success
+ *          E_TLV_TAG if a tag is not part of the schema at its position
+ *          E_TLV_LEN if a value length is out of the declared bounds
+ *          E_TLV     if a field occurs more than once
+ *          E_NOENT   if a mandatory field is missing
+ *          any error of tlv_parse_ber() on malformed data
+ */
+PUBLIC err_t
+tlv_decode_schema(const u8 *src, const u16 length,
+                  const struct tlv_schema *schema, void *obj)
+{
+	err_t  err;
+	u32    seen = 0;
+	u32    pos  = 0;
+	u32    tag;
+	u32    len;
+	u32    bit;
+	u8     top  = 0;
+	const struct tlv_field *f;
+	struct {
+		u32 tag;
+		u32 end;
+	} scope[TLV_MAX_NESTING];
+
+	CHECK_PARAM__NOT_NULL(schema);
+	if (schema->count > 32) return E_BAD_PARAM | E_RANGE;
+
+	while (pos < length) {
+		err = __decode_header_ber(src, length, &pos, &tag, &len);
+		if (err) return err;
+
+		if ((top)
+		&&  ((pos > scope[top - 1].end) || (len > scope[top - 1].end - pos)))
+		{
+			return E_TLV_FIT;
+		}
+
+		f = __schema_lookup(schema, top ? scope[top - 1].tag : 0, tag);
+		if (!f) return E_TLV_TAG;
+
+		bit = 1u << (f - schema->field);
+		if (seen & bit) return E_TLV;
+		seen |= bit;
+
+		if (len < f->min || len > f->max)
+			return E_TLV_LEN;
 
-		if ((err = __pop_nestings(pos, &tlv.nesting)))
+		if (f->kind == TLV_FIELD_NESTED) {
+			if (!__is_constructed(tag)) return E_TLV_TAG;
+			if (top >= LENGTH(scope))   return E_TLV_DEPTH;
+
+			scope[top].tag = tag;
+			scope[top].end = pos + len;
+			top++;
+		} else {
+			err = __schema_decode(f, src + pos, len, obj);
+			if (err) return err;
+
+			pos += len;
+		}
+
+		while (top && pos == scope[top - 1].end)
+			top--;
+	}
+
+	for_each(f, schema->field, schema->count) {
+		bit = 1u << (f - schema->field);
+		if ((f->flags & TLV_MANDATORY) && !(seen & bit))
+			return E_NOENT;
+	}
+
+	return E_GOOD;
+}
+
+enum Tlv_Stream_State {
+	SP_HEADER = 0x00,
+	SP_VALUE,          /* reassemble value in vbuf */
+	SP_SINK,           /* pass value to a sink stream */
+	SP_SKIP            /* skip constructed value not stepped into */
+};
+
+PUBLIC void
+tlv_stream_parser_init(struct tlv_stream_parser *p, fp_tlv_visit visit,
+                       void *opaque, struct tlv_parse_scope *stack, u8 depth,
+                       u8 *vbuf, u32 vsize, fp_tlv_sink sink)
+{
+	INIT_LIST_HEAD(&p->tlv.nesting);
+
+	p->visit     = visit;
+	p->opaque    = opaque;
+	p->sink      = sink;
+	p->stack     = stack;
+	p->depth     = depth;
+	p->vbuf      = vbuf;
+	p->vsize     = vbuf ? vsize : 0;
+	p->os        = NULL;
+	p->top       = 0;
+	p->state     = SP_HEADER;
+	p->hdr_len   = 0;
+	p->vlen      = 0;
+	p->remaining = 0;
+	p->pos       = 0;
+	p->err       = E_GOOD;
+}
+
+PRIVATE inline err_t
+__sp_fail(struct tlv_stream_parser *p, err_t err)
+{
+	return (p->err = err);
+}
+
+/**
+ *  The current object is complete. Close all scopes ending here.
+ */
+PRIVATE err_t
+__sp_complete(struct tlv_stream_parser *p)
+{
+	err_t err;
+
+	p->state = SP_HEADER;
+
+	if ((err = __pop_nestings(p->pos, &p->tlv, &p->top)))
+		return __sp_fail(p, err);
+
+	return E_GOOD;
+}
+
+PRIVATE err_t
+__sp_visit(struct tlv_stream_parser *p, const u8 *value)
+{
+	p->tlv.value = value;
+
+	if (p->visit(&p->tlv, p->opaque) == STOP)
+		return __sp_fail(p, E_TLV);
+
+	return __sp_complete(p);
+}
+
+/**
+ *  Tag and length of an object have been decoded. Decide how to handle
+ *  the value bytes, of which 'avail' are already at 'src'.
+ *
+ *  @return number of value bytes consumed from src
+ */
+PRIVATE u32
+__sp_header_done(struct tlv_stream_parser *p, const u8 *src, u32 avail)
+{
+	struct tlv_parse_ctx   *tlv = &p->tlv;
+	struct tlv_parse_scope *scope;
+	u32 end;
+
+	if (p->top) {
+		end = p->stack[p->top - 1].end_marker;
+		if ((p->pos > end) || (tlv->length > end - p->pos)) {
+			__sp_fail(p, E_TLV_FIT);
+			return 0;
+		}
+	}
+
+	p->remaining = tlv->length;
+
+	if (__is_constructed(tlv->tag)) {
+		tlv->value = NULL;
+
+		switch (p->visit(tlv, p->opaque)) {
+		case STOP:
+			__sp_fail(p, E_TLV);
+			return 0;
+		case STEP_INTO:
+			if (p->top >= p->depth) {
+				__sp_fail(p, E_TLV_DEPTH);
+				return 0;
+			}
+			scope = &p->stack[p->top++];
+			scope->nesting.tag = tlv->tag;
+			scope->end_marker  = p->pos + tlv->length;
+			list_add(&scope->nesting.list, &tlv->nesting);
+
+			p->remaining = 0;
+			__sp_complete(p);
+			return 0;
+		default:
+			if (tlv->length)
+				p->state = SP_SKIP;
+			else
+				__sp_complete(p);
+			return 0;
+		}
+	}
+
+	if (tlv->length > p->vsize && p->sink) {
+		p->os = p->sink(tlv, p->opaque);
+		if (!p->os) {
+			__sp_fail(p, E_NOMEM);
+			return 0;
+		}
+		p->state = SP_SINK;
+		return 0;
+	}
+
+	/* value is complete in the current chunk */
+	if (tlv->length <= avail) {
+		p->pos += tlv->length;
+		p->remaining = 0;
+		__sp_visit(p, src);
+		return tlv->length;
+	}
+
+	if (tlv->length > p->vsize) {
+		__sp_fail(p, E_NOMEM);
+		return 0;
+	}
+
+	p->vlen  = 0;
+	p->state = SP_VALUE;
+	return 0;
+}
+
+/**
+ *  Collect tag and length field bytes.
+ *
+ *  @return number of bytes consumed from src
+ */
+PRIVATE u32
+__sp_header(struct tlv_stream_parser *p, const u8 *src, u32 n)
+{
+	err_t err;
+	u8    tfs;
+	u8    lfs;
+	u8    old = p->hdr_len;
+	u8    cpy = MIN(sizeof(p->hdr) - old, n);
+	u32   used;
+
+	memcpy(p->hdr + old, src, cpy);
+
+	err = __decode_tag_ber(p->hdr, old + cpy, &p->tlv.tag, &tfs);
+	if (!err)
+		err = __decode_length_ber(p->hdr + tfs, old + cpy - tfs,
+		                          &p->tlv.length, &lfs);
+	if (err == E_TLV) {
+		/* header continues in the next chunk */
+		p->hdr_len += cpy;
+		p->pos     += cpy;
+		return cpy;
+	}
+	if (err) {
+		__sp_fail(p, err);
+		return 0;
+	}
+
+	used = tfs + lfs - old;
+	p->hdr_len = 0;
+	p->pos    += used;
+
+	return used + __sp_header_done(p, src + used, n - used);
+}
+
+PUBLIC err_t
+tlv_stream_parser_feed(struct tlv_stream_parser *p, const u8 *src, u32 n)
+{
+	u32 take;
+
+	while (n && !p->err) {
+		if (p->state == SP_HEADER) {
+			take = __sp_header(p, src, n);
+			src += take;
+			n   -= take;
+			continue;
+		}
+
+		take = MIN(p->remaining, n);
+
+		switch (p->state) {
+		case SP_VALUE:
+			memcpy(p->vbuf + p->vlen, src, take);
+			p->vlen += take;
 			break;
+		case SP_SINK:
+			if (stream_write(p->os, (u8 *) src, take) != take)
+				return __sp_fail(p, E_TLV_VAL);
+			break;
+		default:
+			break;
+		}
+
+		src          += take;
+		n            -= take;
+		p->pos       += take;
+		p->remaining -= take;
+
+		if (p->remaining)
+			continue;
+
+		switch (p->state) {
+		case SP_VALUE:
+			__sp_visit(p, p->vbuf);
+			break;
+		case SP_SINK:
+			__sp_visit(p, NULL);
+			break;
+		default:
+			__sp_complete(p);
+		}
+	}
+
+	return p->err;
+}
+
+PUBLIC err_t
+tlv_stream_parser_finish(struct tlv_stream_parser *p)
+{
+	if (p->err) return p->err;
+
+	if ((p->state != SP_HEADER)
+	||  (p->hdr_len)
+	||  (p->top))
+	{
+		return __sp_fail(p, E_TLV);
 	}
 
-	err = E_GOOD;
-cleanup:
-	__clean_nestings(&tlv.nesting);
+	return E_GOOD;
+}
+
+/**
+ *  A walk over tag and length fields only, values are never read. On any
+ *  error the index is left empty.
+ */
+PUBLIC err_t
+tlv_index_build(struct tlv_index *idx, fp_tlv_read read, void *src, u32 length)
+{
+	err_t  err;
+	u8     hdr[8];
+	u8     tfs;
+	u8     lfs;
+	u8     top = 0;
+	u32    n;
+	u32    pos = 0;
+	u32    end;
+	struct tlv_index_entry *e;
+	struct {
+		u16 entry;
+		u32 end;
+	} scope[TLV_MAX_NESTING];
+
+	CHECK_PARAM__NOT_NULL(idx);
+	CHECK_PARAM__NOT_NULL(read);
+
+	idx->count = 0;
+
+	while (pos < length) {
+		n = read(src, pos, hdr, MIN(sizeof(hdr), length - pos));
+		if (!n) {
+			err = E_TLV;
+			goto fail;
+		}
+
+		/* ISO 7816-4 allows padding before, between and after objects */
+		if (hdr[0] == 0x00 || hdr[0] == 0xFF) {
+			pos++;
+			goto pop;
+		}
+
+		if (idx->count >= idx->max) {
+			err = E_NOMEM;
+			goto fail;
+		}
+
+		e = &idx->entry[idx->count];
+
+		if ((err = __decode_tag_ber(hdr, n, &e->tag, &tfs)))
+			goto fail;
+		if ((err = __decode_length_ber(hdr + tfs, n - tfs, &e->length, &lfs)))
+			goto fail;
+
+		pos += tfs + lfs;
+		end  = top ? scope[top - 1].end : length;
+
+		if ((pos > end) || (e->length > end - pos)) {
+			err = top ? E_TLV_FIT : E_TLV_VAL;
+			goto fail;
+		}
+
+		e->offset = pos;
+		e->parent = top ? scope[top - 1].entry + 1 : 0;
+		idx->count++;
+
+		if (__is_constructed(e->tag)) {
+			if (top >= LENGTH(scope)) {
+				err = E_TLV_DEPTH;
+				goto fail;
+			}
+			scope[top].entry = idx->count - 1;
+			scope[top].end   = pos + e->length;
+			top++;
+		} else {
+			pos += e->length;
+		}
+pop:
+		while (top && pos == scope[top - 1].end)
+			top--;
+	}
+
+	return E_GOOD;
+fail:
+	idx->count = 0;
 	return err;
 }
 
+/**
+ *  Children are recorded after their parent, so each path element is
+ *  searched behind the entry found for its predecessor.
+ */
+PUBLIC const struct tlv_index_entry *
+tlv_index_find(const struct tlv_index *idx, const u32 *path, u8 depth)
+{
+	u16 parent = 0;
+	u16 i;
+	u8  k;
+
+	if (!idx || !depth) return NULL;
+
+	for (k = 0; k < depth; k++) {
+		for (i = parent; i < idx->count; i++) {
+			if ((idx->entry[i].parent == parent)
+			&&  (idx->entry[i].tag    == path[k]))
+			{
+				break;
+			}
+		}
+
+		if (i >= idx->count) return NULL;
+
+		parent = i + 1;
+	}
+
+	return &idx->entry[parent - 1];
+}
+
+/**
+ *  Encode a raw BER tag value (as delivered by the parser) big endian.
+ *
+ *  @return number of tag bytes
+ */
+PRIVATE inline u8
+__encode_tag_ber(u8 *dst, u32 tag)
+{
+	u8 n = (tag & 0xFF0000) ? 3 : (tag & 0xFF00) ? 2 : 1;
+	u8 i;
+
+	for (i = n; i; i--, tag >>= 8)
+		dst[i - 1] = tag;
+
+	return n;
+}
+
+/**
+ *  Encode a BER length field in its shortest form.
+ *
+ *  @return number of length bytes
+ */
+PRIVATE inline u8
+__encode_length_ber(u8 *dst, u32 l)
+{
+	u8 n = (l < 0x80)     ? 0 :
+	       (l < 0x100)    ? 1 :
+	       (l < 0x10000)  ? 2 :
+	       (l < 0x1000000)? 3 : 4;
+	u8 i;
+
+	if (!n) {
+		dst[0] = l;
+		return 1;
+	}
+
+	dst[0] = 0x80 | n;
+	for (i = n; i; i--, l >>= 8)
+		dst[i] = l;
+
+	return n + 1;
+}
+
+PRIVATE inline u8
+__encode_simple(u8 *dst, u8 tag, u16 l)
+{
+	dst[0] = tag;
+
+	if (l < 0xFF) {
+		dst[1] = l;
+		return 2;
+	}
+
+	dst[1] = 0xFF;
+	dst[2] = l >> 8;
+	dst[3] = l;
+
+	return 4;
+}
+
+PRIVATE u32
+__write_tlv(struct stream_out *os, u8 *hdr, u8 n, const u8 *value, u32 length)
+{
+	u32 written;
+
+	written = stream_write(os, hdr, n);
+	if (written != n || !value)
+		return written;
+
+	return written + stream_write(os, (u8 *) value, length);
+}
+
+PUBLIC u32
+tlv_size_ber(u32 tag, u32 length)
+{
+	u8 hdr[8];
+
+	return __encode_tag_ber(hdr, tag)
+	     + __encode_length_ber(hdr, length)
+	     + length;
+}
+
+PUBLIC u32
+tlv_write_ber(struct stream_out *os, u32 tag, u32 length, const u8 *value)
+{
+	u8 hdr[8];
+	u8 n;
+
+	n  = __encode_tag_ber(hdr, tag);
+	n += __encode_length_ber(hdr + n, length);
+
+	return __write_tlv(os, hdr, n, value, length);
+}
+
+/**
+ *  @return number of written bytes, zero for tags 0x00 and 0xFF
+ */
+PUBLIC u32
+tlv_write_simple(struct stream_out *os, u8 tag, u16 length, const u8 *value)
+{
+	u8 hdr[4];
+
+	if (tag == 0x00 || tag == 0xFF) return 0;
+
+	return __write_tlv(os, hdr, __encode_simple(hdr, tag, length),
+	                   value, length);
+}
+
+/**
+ *  @return number of written bytes, zero if tag or length exceed a nibble
+ */
+PUBLIC u32
+tlv_write_compact(struct stream_out *os, u8 tag, u8 length, const u8 *value)
+{
+	u8 hdr;
+
+	if (tag > 0x0F || length > 0x0F) return 0;
+
+	hdr = tag << 4 | length;
+
+	return __write_tlv(os, &hdr, 1, value, length);
+}
+
+PUBLIC void
+tlv_builder_init(struct tlv_builder *b, u8 *buff, u32 size)
+{
+	b->buff  = buff;
+	b->size  = size;
+	b->pos   = 0;
+	b->depth = 0;
+	b->err   = E_GOOD;
+}
+
+PRIVATE inline err_t
+__builder_fail(struct tlv_builder *b, err_t err)
+{
+	return (b->err = err);
+}
+
+/**
+ *  Append an encoded header and 'length' bytes of 'value'.
+ */
+PRIVATE err_t
+__builder_append(struct tlv_builder *b, const u8 *hdr, u8 n,
+                 const u8 *value, u32 length)
+{
+	if (b->err) return b->err;
+
+	if ((n > b->size - b->pos)
+	||  (length > b->size - b->pos - n))
+	{
+		return __builder_fail(b, E_NOMEM);
+	}
+
+	memcpy(b->buff + b->pos, hdr, n);
+	b->pos += n;
+
+	if (length) {
+		memcpy(b->buff + b->pos, value, length);
+		b->pos += length;
+	}
+
+	return E_GOOD;
+}
+
+/**
+ *  Open a constructed object. Its length field is reserved with one byte
+ *  and widened by tlv_end() if the content needs the long form.
+ */
+PUBLIC err_t
+tlv_begin(struct tlv_builder *b, u32 tag)
+{
+	u8 hdr[4];
+	u8 n;
+
+	if (b->err) return b->err;
+
+	if (b->depth >= LENGTH(b->open))
+		return __builder_fail(b, E_TLV_DEPTH);
+
+	n  = __encode_tag_ber(hdr, tag);
+	n += __encode_length_ber(hdr + n, 0);
+
+	if (__builder_append(b, hdr, n, NULL, 0))
+		return b->err;
+
+	b->open[b->depth++] = b->pos - 1;
+
+	return E_GOOD;
+}
+
+PUBLIC err_t
+tlv_end(struct tlv_builder *b)
+{
+	u8  hdr[5];
+	u8  n;
+	u32 at;
+	u32 length;
+
+	if (b->err) return b->err;
+	if (!b->depth) return __builder_fail(b, E_TLV);
+
+	at     = b->open[--b->depth];
+	length = b->pos - at - 1;
+	n      = __encode_length_ber(hdr, length);
+
+	if (n > 1) {
+		if (n - 1u > b->size - b->pos)
+			return __builder_fail(b, E_NOMEM);
+
+		memmove(b->buff + at + n, b->buff + at + 1, length);
+		b->pos += n - 1;
+	}
+
+	memcpy(b->buff + at, hdr, n);
+
+	return E_GOOD;
+}
+
+PUBLIC err_t
+tlv_put(struct tlv_builder *b, u32 tag, const u8 *value, u32 length)
+{
+	u8 hdr[8];
+	u8 n;
+
+	n  = __encode_tag_ber(hdr, tag);
+	n += __encode_length_ber(hdr + n, length);
+
+	return __builder_append(b, hdr, n, value, length);
+}
+
+PUBLIC err_t
+tlv_put_simple(struct tlv_builder *b, u8 tag, const u8 *value, u16 length)
+{
+	u8 hdr[4];
+
+	if (b->err) return b->err;
+	if (tag == 0x00 || tag == 0xFF)
+		return __builder_fail(b, E_TLV_TAG);
+
+	return __builder_append(b, hdr, __encode_simple(hdr, tag, length),
+	                        value, length);
+}
+
+PUBLIC err_t
+tlv_put_compact(struct tlv_builder *b, u8 tag, const u8 *value, u8 length)
+{
+	u8 hdr;
+
+	if (b->err) return b->err;
+	if (tag > 0x0F)
+		return __builder_fail(b, E_TLV_TAG);
+	if (length > 0x0F)
+		return __builder_fail(b, E_TLV_LEN);
+
+	hdr = tag << 4 | length;
+
+	return __builder_append(b, &hdr, 1, value, length);
+}
+
+PUBLIC err_t
+tlv_put_uint(struct tlv_builder *b, u32 tag, u32 v, u8 bytes)
+{
+	u8 val[4];
+	u8 i;
+
+	if (b->err) return b->err;
+	if (!bytes || bytes > sizeof(val))
+		return __builder_fail(b, E_BAD_PARAM | E_RANGE);
+
+	for (i = bytes; i; i--, v >>= 8)
+		val[i - 1] = v;
+
+	return tlv_put(b, tag, val, bytes);
+}
+
+PUBLIC u32
+tlv_builder_flush(struct tlv_builder *b, struct stream_out *os)
+{
+	if (b->err || b->depth) return 0;
+
+	return stream_write(os, b->buff, b->pos);
+}
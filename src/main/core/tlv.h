@@ -30,11 +30,12 @@ struct stream_out;
 
 struct list_head;
 
-struct tlv_object;
-struct tlv_ber_ctx;
+struct tlv_builder;
+struct tlv_stream_parser;
+struct tlv_index;
 struct tlv_parse_ctx;
-
-typedef struct tlv_object TlvObject;
+struct tlv_parse_scope;
+struct tlv_schema;
 
 /** 
  *  During TLV parsing callback method can control behaviour.
@@ -48,42 +49,148 @@ enum Tlv_Parse_Cmd {
  *  General callback for parsing TLV data.
  */
 typedef enum Tlv_Parse_Cmd (*fp_tlv_visit)(const struct tlv_parse_ctx *, void *);
+/**
+ *  Provide a stream for the value of a primitive object, which is too large
+ *  to be reassembled in memory. Return NULL to reject the object.
+ */
+typedef struct stream_out *(*fp_tlv_sink)(const struct tlv_parse_ctx *, void *);
+/**
+ *  Read up to 'n' bytes of stored TLV data at 'offset'.
+ *
+ *  @return number of bytes read
+ */
+typedef u32 (*fp_tlv_read)(void *src, u32 offset, u8 *buff, u32 n);
+
+/**
+ * Number of bytes a BER-TLV object with 'length' value bytes is encoded in.
+ */
+PUBLIC u32
+tlv_size_ber(u32 tag, u32 length);
+
+/**
+ * Write tag and length field to a stream, followed by 'value' if not NULL.
+ * Constructed objects are written with value NULL and their precomputed
+ * length (see tlv_size_ber()).
+ *
+ * @return number of written bytes
+ */
+PUBLIC u32
+tlv_write_ber(struct stream_out *, u32 tag, u32 length, const u8 *value);
 
 /**
- *  @return number of written bytes
+ * Write a SIMPLE-TLV or COMPACT-TLV object to a stream.
+ *
+ * @return number of written bytes
  */
 PUBLIC u32
-tlv_encode_ber(TlvObject *, void *_ctx, struct stream_out *);
+tlv_write_simple(struct stream_out *, u8 tag, u16 length, const u8 *value);
+
+PUBLIC u32
+tlv_write_compact(struct stream_out *, u8 tag, u8 length, const u8 *value);
 
 /**
- * Create a new BER-TLV object of primitive encoded data.
+ * Encode BER-TLV objects into a reserved buffer. Lengths of constructed
+ * objects are back-patched by tlv_end(). Any error is sticky and
+ * reported again by all subsequent calls.
  */
-PUBLIC TlvObject *
-tlv_create_ber_prim(u8 _tag, u32 _length, const u8 *value);
+PUBLIC void
+tlv_builder_init(struct tlv_builder *, u8 *buff, u32 size);
+
+PUBLIC err_t
+tlv_begin(struct tlv_builder *, u32 tag);
+
+PUBLIC err_t
+tlv_end(struct tlv_builder *);
+
+PUBLIC err_t
+tlv_put(struct tlv_builder *, u32 tag, const u8 *value, u32 length);
+
+/**
+ * Put 'v' as big endian unsigned integer of 'bytes' bytes.
+ */
+PUBLIC err_t
+tlv_put_uint(struct tlv_builder *, u32 tag, u32 v, u8 bytes);
+
+/**
+ * Put SIMPLE-TLV or COMPACT-TLV objects, e.g. as value of a BER-TLV object.
+ */
+PUBLIC err_t
+tlv_put_simple(struct tlv_builder *, u8 tag, const u8 *value, u16 length);
+
+PUBLIC err_t
+tlv_put_compact(struct tlv_builder *, u8 tag, const u8 *value, u8 length);
+
+/**
+ * Write the encoded objects to a stream.
+ *
+ * @return number of written bytes, zero on any encoding error.
+ */
+PUBLIC u32
+tlv_builder_flush(struct tlv_builder *, struct stream_out *);
 
 PUBLIC err_t
 tlv_parse_ber(const u8 *, u16, fp_tlv_visit, void *);
 
 /**
- * Create a BER-TLV object with constructed
- * encoding of the data part.
+ * Parse SIMPLE-TLV or COMPACT-TLV data. Visitors see the same context as
+ * for BER-TLV data, without any nesting.
  */
-PUBLIC TlvObject *
-tlv_create_ber_cons(u8 _tag, TlvObject *);
+PUBLIC err_t
+tlv_parse_simple(const u8 *, u16, fp_tlv_visit, void *);
+
+PUBLIC err_t
+tlv_parse_compact(const u8 *, u16, fp_tlv_visit, void *);
 
-PUBLIC TlvObject *
-tlv_object_join(TlvObject *, TlvObject *);
+/**
+ * Parse BER-TLV data like tlv_parse_ber() but keep open nestings in a scope
+ * stack of 'depth' entries provided by the caller.
+ */
+PUBLIC err_t
+tlv_parse_ber_scoped(const u8 *, u16, fp_tlv_visit, void *,
+                     struct tlv_parse_scope *stack, u8 depth);
 
 /**
- * Crawl a TlvObject tree for a TlvObject with a specific tag. Start any where
- * in the tree at object '_start'. We differ between 'depth-first' and
- * 'breadth-first' search algorithm.
+ * Decode BER-TLV data into a struct as declared by a static schema.
  */
-PUBLIC TlvObject *
-tlv_find_next(u8 _tag, TlvObject *_start, u8 _method);
+PUBLIC err_t
+tlv_decode_schema(const u8 *, u16, const struct tlv_schema *, void *obj);
 
+/**
+ * Parse BER-TLV data fed in arbitrary chunks. Primitive values split across
+ * chunks are reassembled in 'vbuf'. Values larger than 'vsize' are written to
+ * the stream returned by 'sink' instead and visited with value NULL.
+ */
 PUBLIC void
-tlv_release_all(TlvObject *);
+tlv_stream_parser_init(struct tlv_stream_parser *, fp_tlv_visit, void *,
+                       struct tlv_parse_scope *stack, u8 depth,
+                       u8 *vbuf, u32 vsize, fp_tlv_sink sink);
+
+PUBLIC err_t
+tlv_stream_parser_feed(struct tlv_stream_parser *, const u8 *, u32);
+
+/**
+ * Signal the end of input.
+ *
+ * @return E_TLV if an object is incomplete.
+ */
+PUBLIC err_t
+tlv_stream_parser_finish(struct tlv_stream_parser *);
+
+/**
+ * Record tag, value offset and length of each object of 'length' bytes of
+ * stored BER-TLV data. Only tag and length fields are read. Padding bytes
+ * 0x00 and 0xFF between objects are skipped.
+ */
+PUBLIC err_t
+tlv_index_build(struct tlv_index *, fp_tlv_read, void *src, u32 length);
+
+/**
+ * Look up an object by its tag path, e.g. { 0x7F21, 0x5F20 }.
+ *
+ * @return NULL if there is no such object.
+ */
+PUBLIC const struct tlv_index_entry *
+tlv_index_find(const struct tlv_index *, const u32 *path, u8 depth);
 
 #define BER_TLV_CLS_BYTES = 0x03 << 6
 #define BER_TLV_ENC_BYTES = 0x01 << 5
@@ -100,6 +207,15 @@ struct tlv_nesting {
 	u32 tag;
 };
 
+/**
+ *  Instead of tlv_nesting structure the parser uses this one, which holds an
+ *  additional end marker for each nesting.
+ */
+struct tlv_parse_scope {
+	struct tlv_nesting nesting;
+	u32                end_marker;
+};
+
 struct tlv_parse_ctx {
 	struct list_head   nesting;
 	u32                tag;
@@ -107,20 +223,107 @@ struct tlv_parse_ctx {
 	const u8           *value;
 };
 
+/**
+ *  Kinds of destination a schema field is decoded into.
+ */
+enum Tlv_Field_Kind {
+	TLV_FIELD_NESTED = 0x00,     /**< constructed object, step into it */
+	TLV_FIELD_U8,                /**< big endian unsigned integer ...  */
+	TLV_FIELD_U16,               /**< ... of up to sizeof(dest) bytes  */
+	TLV_FIELD_U32,
+	TLV_FIELD_BYTES,             /**< copy of the value bytes */
+	TLV_FIELD_ARRAY,             /**< struct array referencing the value */
+	TLV_FIELD_CUSTOM             /**< call tlv_field.decode */
+};
 
-struct tlv_object {
-	u32               enc_bytes; /* real tag-length */
-	u8                tag;
-	u32               length;
+enum Tlv_Field_Flags {
+	TLV_MANDATORY = BIT_1
+};
+
+typedef err_t (*fp_tlv_decode)(const u8 *val, u32 length, void *dest);
 
-	/* a primitive BEL-TLV object has *value set to a valid memory
-	 * address */
-	const u8          *value;
-	/* a constructed BER-TLV object points instead to its first child */
-	struct tlv_object *first_child;
+/**
+ *  One entry of a decoding schema. Each tag may occur once below its
+ *  parent tag. Top level objects use parent tag 0x00.
+ */
+struct tlv_field {
+	u32                tag;
+	u32                parent;
+	u16                min;
+	u16                max;
+	u16                offset;      /* of the destination within the struct */
+	u8                 kind;
+	u8                 flags;
+	fp_tlv_decode      decode;
+};
 
-	struct tlv_object *parent;
-	struct tlv_object *next;        /* each TlvObject is part of a singly linked list */
+struct tlv_schema {
+	const struct tlv_field *field;
+	u8                     count;   /* at most 32 fields */
 };
 
+#define TLV_SCHEMA(fields)  { .field = (fields), .count = LENGTH(fields) }
+
+#define TLV_NESTED(_parent, _tag, _flags) \
+	{ .tag = (_tag), .parent = (_parent), .kind = TLV_FIELD_NESTED, \
+	  .min = 0, .max = 0xFFFF, .flags = (_flags) }
+
+#define TLV_FIELD(_parent, _tag, _kind, _type, _member, _min, _max, _flags) \
+	{ .tag = (_tag), .parent = (_parent), .kind = (_kind), \
+	  .offset = offsetof(_type, _member), .min = (_min), .max = (_max), \
+	  .flags = (_flags) }
+
+#define TLV_FIELD_FN(_parent, _tag, _fn, _type, _member, _min, _max, _flags) \
+	{ .tag = (_tag), .parent = (_parent), .kind = TLV_FIELD_CUSTOM, \
+	  .offset = offsetof(_type, _member), .min = (_min), .max = (_max), \
+	  .flags = (_flags), .decode = (_fn) }
+
+struct tlv_builder {
+	u8                 *buff;
+	u32                size;
+	u32                pos;
+	/* positions of the length fields of all open constructed objects */
+	u32                open[TLV_MAX_NESTING];
+	u8                 depth;
+	err_t              err;
+};
 
+#define TLV_BUILDER(b)  { .buff = (b), .size = sizeof((b)), .pos = 0, \
+                          .depth = 0, .err = E_GOOD }
+
+/**
+ *  State of a resumable parser. The object must not be moved while parsing,
+ *  as open scopes are linked into tlv.nesting.
+ */
+struct tlv_stream_parser {
+	struct tlv_parse_ctx   tlv;
+	fp_tlv_visit           visit;
+	fp_tlv_sink            sink;
+	void                   *opaque;
+	struct tlv_parse_scope *stack;
+	struct stream_out      *os;        /* sink of the current value */
+	u8                     *vbuf;
+	u32                    vsize;
+	u32                    vlen;
+	u32                    remaining;  /* value bytes of current object */
+	u32                    pos;        /* bytes consumed so far */
+	err_t                  err;
+	u8                     depth;
+	u8                     top;
+	u8                     state;
+	u8                     hdr_len;
+	u8                     hdr[8];     /* partial tag and length field */
+};
+
+struct tlv_index_entry {
+	u32                tag;
+	u32                offset;     /* of the value */
+	u32                length;
+	u16                parent;     /* entry number + 1, zero on top level */
+};
+
+struct tlv_index {
+	struct tlv_index_entry *entry;
+	u16                    max;
+	u16                    count;
+};
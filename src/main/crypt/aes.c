@@ -25,21 +25,93 @@
 */
 
 #include <flxlib.h>
+#include <string.h>
+#include <array.h>
 #include <io/stream.h>
+#include <io/pipeline.h>
 
 #include <miracl.h>
 
-struct stream_out_ops aes_enc_stream_ops = {
-	.put = NULL,
-	.write = NULL,
-	.fetch_from = NULL,
-	.close = NULL
-};
+#include "cryptools.h"
+
+#define AES_BLKSZ 16
+
+PRIVATE u32 aes_ctr_transform_process(struct transform *, const u8 *, u8 *, u32);
+PRIVATE u32 aes_ctr_transform_finalize(struct transform *, u8 *, u32);
 
-struct aes_enc_stream {
-	u8 buff[16];
-	struct stream_out impl;
-	aes ae;
-	u8 buff_level;
+PRIVATE const struct transform_ops __aes_ctr_transform_ops = {
+	.process  = aes_ctr_transform_process,
+	.finalize = aes_ctr_transform_finalize
 };
 
+PRIVATE inline struct aes_ctr_transform *
+__as_aes_ctr_transform(struct transform *t)
+{
+	return container_of(t, struct aes_ctr_transform, impl);
+}
+
+/**
+ *  Set up AES in counter mode, starting with an all zero counter block.
+ *
+ *  Counter mode keeps the number of bytes and does not need any padding.
+ *  Only use it with fresh keys, e.g. derived for one single message.
+ */
+PUBLIC err_t
+aes_ctr_transform_init(struct aes_ctr_transform *at, const array *key)
+{
+	CHECK_PARAM__NOT_NULL (at);
+	CHECK_PARAM__NOT_NULL (key);
+
+	transform_init(&at->impl, &__aes_ctr_transform_ops, AES_BLKSZ, 0);
+
+	memset(at->ctr, 0x00, sizeof(at->ctr));
+
+	if (!aes_init(&at->ae, MR_ECB, key->len, (char *) key->val, NULL))
+		return E_BAD_PARAM;
+
+	return E_GOOD;
+}
+
+/**
+ *  XOR up to one block with the next key stream block.
+ */
+PRIVATE void
+aes_ctr_block(struct aes_ctr_transform *at, const u8 *in, u8 *out, u32 n)
+{
+	u8  ks[AES_BLKSZ];
+	u32 i;
+
+	memcpy(ks, at->ctr, sizeof(ks));
+	aes_encrypt(&at->ae, (char *) ks);
+
+	for (i = 0; i < n; i++)
+		out[i] = in[i] ^ ks[i];
+
+	/* increment big endian counter */
+	for (i = AES_BLKSZ; i > 0 && !++at->ctr[i - 1]; i--);
+}
+
+PRIVATE u32
+aes_ctr_transform_process(struct transform *t, const u8 *in, u8 *out, u32 n)
+{
+	struct aes_ctr_transform *at = __as_aes_ctr_transform(t);
+	u32 off;
+
+	for (off = 0; off < n; off += AES_BLKSZ)
+		aes_ctr_block(at, in + off, out + off, MIN(AES_BLKSZ, n - off));
+
+	return n;
+}
+
+PRIVATE u32
+aes_ctr_transform_finalize(struct transform *t, u8 *buff, u32 n)
+{
+	struct aes_ctr_transform *at = __as_aes_ctr_transform(t);
+
+	aes_ctr_transform_process(t, buff, buff, n);
+
+	/* clean up aes environment */
+	aes_end(&at->ae);
+
+	return n;
+}
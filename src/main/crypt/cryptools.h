@@ -37,13 +37,50 @@ struct hmac {
 	sha256 shs;
 };
 
+/**
+ *  Pipeline stage computing a HMAC over all passing bytes (see io/pipeline.h).
+ */
+struct hmac_transform {
+	struct transform impl;
+	struct hmac      ctx;
+};
+
+/* bytes collected before being hashed and passed on, plus space for the MAC */
+#define HMAC_STREAM_SCRATCH (64 + 32)
+
+/**
+ *  Output stream appending a HMAC of all bytes written to it.
+ */
+struct hmac_stream_out {
+	struct pipeline       pipe;
+	struct hmac_transform mac;
+	u8                    scratch[HMAC_STREAM_SCRATCH];
+};
+
+/**
+ *  Pipeline stage en-/decrypting bytes with AES in counter mode.
+ */
+struct aes_ctr_transform {
+	struct transform impl;
+	aes              ae;
+	u8               ctr[16];
+};
+
 err_t hmac_init(struct hmac *, const array *);
 void  hmac_process(struct hmac *, u8);
 void  hmac_hash(struct hmac *, array *);
 
+err_t hmac_transform_init(struct hmac_transform *, const array *);
+err_t aes_ctr_transform_init(struct aes_ctr_transform *, const array *);
+
 err_t kdf_nist2(const array *, const array *, array *);
 
 /* extend array handling */
 u16 array_put_big(array *, const big);
 
+err_t hmac_stream_out_init(struct hmac_stream_out *, const array *,
+                           struct stream_out *);
+void  hmac_stream_out_clean(struct hmac_stream_out *);
+
 struct stream_out *hmac_stream_out_create(const array *, struct stream_out *);
+void               hmac_stream_out_free(struct stream_out *);
@@ -28,46 +28,26 @@
 #include <string.h>
 #include <array.h>
 #include <io/stream.h>
+#include <io/pipeline.h>
 
 #include <miracl.h>
 #include "ecc.h"
 #include "cryptools.h"
 
-#include <stdio.h>
-
-PRIVATE u32  ecies_enc_stream_write(struct stream_out *, u8 *, u32);
-PRIVATE void ecies_enc_stream_close(struct stream_out *);
-
-PRIVATE const struct stream_out_ops __ecies_enc_stream_ops = {
-		.put  = NULL,
-		.write = ecies_enc_stream_write
-};
-
-#define AES_BLKSZ 64
-
+/* bytes collected before being encrypted, plus space for the MAC */
+#define ECIES_SCRATCH (64 + 32)
 
+/**
+ *  ECIES encryption is a pipeline of AES-CTR encryption (k1), followed by a
+ *  HMAC over the cipher text (k2). The MAC is appended on closing.
+ */
 struct ecies_enc_stream {
-	struct stream_out impl;
-	struct hmac       mac;
-	aes               ae;
-	struct stream_out *target;
-	char              blk[AES_BLKSZ];
-	u8                lvl;
+	struct pipeline          pipe;
+	struct aes_ctr_transform enc;
+	struct hmac_transform    mac;
+	u8                       scratch[ECIES_SCRATCH];
 };
 
-PRIVATE inline struct ecies_enc_stream *
-__from_stream_out(struct stream_out *os)
-{
-	return container_of(os, struct ecies_enc_stream, impl);
-}
-
-
-PUBLIC u32
-aes_enc_stream_fetch_from(struct stream_out *os, struct stream_in *is, u32 bytes)
-{
-	return 0;
-}
-
 struct test_struct_ecc_pk_size {
 	char buff[sizeof(struct ecc_pk) < 96 ? -1 : 0];
 };
@@ -80,6 +60,7 @@ ecies_enc_stream_create(
 {
 	struct ecc_pk pk;
 	struct ecc_sk sk;
+	err_t  err;
 
 	u8     *mem = (u8 *) &pk;
 	struct array  s  = Array(mem, 32);
@@ -94,9 +75,6 @@ ecies_enc_stream_create(
 
 	if (!new) return NULL;
 
-	new->impl.ops = &__ecies_enc_stream_ops;
-	new->lvl = 0;
-
 	/* create ephemeral key */
 	ecc_gen(dom, &pk, &sk);
 
@@ -114,63 +92,29 @@ ecies_enc_stream_create(
 
 	/* run KDF => (k1 | k2) */
 	kdf_nist2(&s, NULL, &k);
-	/* setup aes stream with k1 */
-	aes_init(&new->ae, MR_ECB, 32, k.val, NULL);
-	/* setup mac stream with k2 */
-	hmac_init(&new->mac, &k2);
 
-	return &new->impl;
-}
+	/* encrypt with k1, then authenticate cipher text with k2 */
+	err = aes_ctr_transform_init(&new->enc, &k1);
+	if (err) goto wipe;
 
-PRIVATE u32
-ecies_enc_stream_write(struct stream_out *os, u8 *buff, u32 bytes)
-{
-	struct ecies_enc_stream *self = __from_stream_out(os);
-	u32 passed;
-
-	while (passed < bytes) {
-		for (;
-		     self->lvl < sizeof(self->blk);
-		     self->lvl++, passed++)
-		{
-			self->blk[self->lvl] = buff[passed];
-			hmac_process(&self->mac, buff[passed]);
-		}
-
-		if (self->lvl >= sizeof(self->blk)) {
-			aes_encrypt(&self->ae, self->blk);
-			stream_write(self->target, self->blk, sizeof(self->blk));
-
-			self->lvl = 0;
-		}
-	}
+	err = hmac_transform_init(&new->mac, &k2);
+	if (err) goto wipe;
 
-	return passed;
-}
+	err = pipeline_init(&new->pipe, new->scratch, sizeof(new->scratch), target);
+	if (err) goto wipe;
 
-PRIVATE u8
-ecies_enc_stream_push()
-{
-	return 0;
-}
+	err = pipeline_add(&new->pipe, &new->enc.impl);
+	if (err) goto wipe;
 
-PRIVATE void
-ecies_enc_stream_close(struct stream_out *os)
-{
-	u8 __buff[32];
-	struct ecies_enc_stream *self = __from_stream_out(os);
-	array hash = CArray(__buff);
-	/* fill aes block, encrypt */
-	if (self->lvl) {
-		printf("Ignore incomplete AES block.\n");
-	}
-	/* clean up aes environment */
-	aes_end(&self->ae);
+	err = pipeline_add(&new->pipe, &new->mac.impl);
 
-	/* stop MAC processing, write out MAC */
-	hmac_hash(&self->mac, &hash);
+wipe:
+	memset(mem, 0x00, sizeof(pk));
 
-	stream_write(self->target, hash.val, hash.len);
+	if (err) {
+		free(new);
+		return NULL;
+	}
 
-	return;
+	return &new->pipe.impl;
 }
@@ -25,34 +25,29 @@
 */
 
 #include <flxlib.h>
+#include <string.h>
 #include <array.h>
 #include <io/stream.h>
+#include <io/pipeline.h>
 
 #include <miracl.h>
 
 #include "cryptools.h"
 
-PRIVATE u32  hmac_stream_out_put(struct stream_out *, u8);
-PRIVATE void hmac_stream_out_close(struct stream_out *);
+#define HMAC_LEN 32
 
-struct hmac_stream_out {
-	struct stream_out impl;
-	struct hmac       ctx;
-	struct stream_out *target;
-};
+PRIVATE u32 hmac_transform_process(struct transform *, const u8 *, u8 *, u32);
+PRIVATE u32 hmac_transform_finalize(struct transform *, u8 *, u32);
 
-struct stream_out_ops hmac_stream_ops = {
-	.put = hmac_stream_out_put,
-	.write = NULL,
-	.fetch_from = NULL,
-	.close = hmac_stream_out_close
+PRIVATE const struct transform_ops __hmac_transform_ops = {
+	.process  = hmac_transform_process,
+	.finalize = hmac_transform_finalize
 };
 
-
-PRIVATE inline struct hmac_stream_out *
-__as_hmac_stream_out(struct stream_out *os)
+PRIVATE inline struct hmac_transform *
+__as_hmac_transform(struct transform *t)
 {
-	return container_of(os, struct hmac_stream_out, impl);
+	return container_of(t, struct hmac_transform, impl);
 }
 
 /**
@@ -61,7 +56,7 @@ __as_hmac_stream_out(struct stream_out *os)
 PUBLIC err_t
 hmac_init(struct hmac *hmac, const array *key)
 {
-	int hlen,b;
+	u32 hlen,b;
 	u8 *c;
 
 	/* sha256 */
@@ -124,70 +119,110 @@ hmac_hash(struct hmac *hmac, array *out)
 	return;
 }
 
-struct hmac_stream_out *
-hmac_stream_out_alloc(void)
+/**
+ *  Set up a stage hashing all bytes passing by.
+ *
+ *  Bytes are passed on unmodified, the MAC is appended on finalization.
+ */
+PUBLIC err_t
+hmac_transform_init(struct hmac_transform *ht, const array *key)
 {
-	struct hmac_stream_out *new;
+	CHECK_PARAM__NOT_NULL (ht);
+	CHECK_PARAM__NOT_NULL (key);
 
-	new = malloc(sizeof(*new));
+	transform_init(&ht->impl, &__hmac_transform_ops, 1, HMAC_LEN);
 
-	/* TODO errno E_NOMEM */
-	if (!new) return NULL;
+	return hmac_init(&ht->ctx, key);
+}
+
+PRIVATE u32
+hmac_transform_process(struct transform *t, const u8 *in, u8 *out, u32 n)
+{
+	struct hmac_transform *ht = __as_hmac_transform(t);
+	const u8 *c;
+
+	for_each(c, in, n) hmac_process(&ht->ctx, *c);
 
-	new->impl.ops = &hmac_stream_ops;
+	if (in != out) memmove(out, in, n);
 
-	return new;
+	return n;
 }
 
-void
-hmac_stream_out_free(struct hmac_stream_out *os)
+PRIVATE u32
+hmac_transform_finalize(struct transform *t, u8 *buff, u32 n)
 {
-	if (!os) return;
+	struct hmac_transform *ht = __as_hmac_transform(t);
+	array mac = Array(buff + n, HMAC_LEN);
 
-	/* XXX hm, does the compiler do any optimization here? */
-	array_clean(&os->ctx.key);
+	hmac_transform_process(t, buff, buff, n);
+	hmac_hash(&ht->ctx, &mac);
 
-	free(os);
+	return n + mac.len;
 }
 
-PUBLIC struct stream_out *
-hmac_stream_out_create(const array *key, struct stream_out *target)
+/**
+ *  Wipe the key of a stream, which has not been closed.
+ */
+PUBLIC void
+hmac_stream_out_clean(struct hmac_stream_out *hso)
 {
-	struct hmac_stream_out *new;
+	/* XXX hm, does the compiler do any optimization here? */
+	array_clean(&hso->mac.ctx.key);
+}
 
-	new = hmac_stream_out_alloc();
-	if (!new) return NULL;
+void
+hmac_stream_out_free(struct stream_out *os)
+{
+	struct hmac_stream_out *hso;
 
-	new->target = target;
+	if (!os) return;
 
-	if (hmac_init(&new->ctx, key)) {
-		hmac_stream_out_free(new);
-		return NULL;
-	}
+	hso = container_of(os, struct hmac_stream_out, pipe.impl);
 
-	return &new->impl;
+	hmac_stream_out_clean(hso);
+	free(hso);
 }
 
-PRIVATE u32
-hmac_stream_out_put(struct stream_out *os, u8 val)
+/**
+ *  Set up a stream passing all bytes to 'target' and appending their MAC on
+ *  closing. The target stream is left open.
+ *
+ *  The stream object may live anywhere, e.g. in the arena of a command.
+ */
+PUBLIC err_t
+hmac_stream_out_init(struct hmac_stream_out *hso, const array *key,
+                     struct stream_out *target)
 {
-	struct hmac_stream_out *hso = __as_hmac_stream_out(os);
+	err_t err;
+
+	CHECK_PARAM__NOT_NULL (hso);
 
-	hmac_process(&hso->ctx, val);
+	err = hmac_transform_init(&hso->mac, key);
+	if (err) return err;
 
-	return stream_put(hso->target, val);
+	err = pipeline_init(&hso->pipe, hso->scratch, sizeof(hso->scratch), target);
+	if (err) return err;
+
+	return pipeline_add(&hso->pipe, &hso->mac.impl);
 }
 
-PRIVATE void
-hmac_stream_out_close(struct stream_out *os)
+/**
+ *  Allocate and set up a HMAC stream, see hmac_stream_out_init().
+ */
+PUBLIC struct stream_out *
+hmac_stream_out_create(const array *key, struct stream_out *target)
 {
-	struct hmac_stream_out *hso = __as_hmac_stream_out(os);
-	u8 __mem_hash[32];
-	array mac = CArray(__mem_hash);
+	struct hmac_stream_out *new;
 
-	hmac_hash(&hso->ctx, &mac);
+	new = malloc(sizeof(*new));
 
-	stream_write(hso->target, mac.val, mac.len);
+	/* TODO errno E_NOMEM */
+	if (!new) return NULL;
 
-	return;
+	if (hmac_stream_out_init(new, key, target)) {
+		free(new);
+		return NULL;
+	}
+
+	return &new->pipe.impl;
 }
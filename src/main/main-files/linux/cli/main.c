@@ -65,7 +65,8 @@ mount_somefs(void)
 
 	/* since we use ram_dev above, formating fs is needed anyway */
 	if ((err = somefs_mkfs(hal_mdev))
-	||  (err = smartfs_mount_root(hal_mdev, somefs_mount)))
+	||  (err = register_filesystem(&somefs_fs_type))
+	||  (err = smartfs_mount_root(hal_mdev, "somefs")))
 	{
 		return err;
 	}
@@ -40,6 +40,8 @@
 #include <ecc.h>
 #include <octet.h>
 
+#include <io/stream.h>
+#include <io/pipeline.h>
 #include <cryptools.h>
 
 #ifndef MAX_HASH_BYTES
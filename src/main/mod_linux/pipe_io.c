@@ -26,6 +26,7 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
 #include <string.h>
 
 #include <const.h>
@@ -33,6 +34,7 @@
 
 #include <array.h>
 #include <buffers.h>
+#include <io/iovec.h>
 #include <modules.h>
 
 #include "pipe_io.h"
@@ -54,11 +56,24 @@ pipe_card_read(void)
 	return __capdu;
 }
 
+/**
+ * Send the response in chunks, so it is not limited by the size of '__rapdu'.
+ * Responses up to PIPE_BUF bytes are written at once.
+ */
 PRIVATE void
 pipe_card_write(void)
 {
-	write(pipe_card2term[W], __rapdu->v, __rapdu->length);
-	array_truncate(__rapdu);
+	static u8 chunk[PIPE_BUF];
+	u32 done, bytes;
+
+	for (done = 0; done < __rvec->length; done += bytes) {
+		bytes = iov_gather(__rvec, done, chunk, sizeof(chunk));
+		if (!bytes) break;
+
+		write(pipe_card2term[W], chunk, bytes);
+	}
+
+	apdu_response_reset();
 }
 
 PUBLIC size_t
@@ -47,6 +47,7 @@
 
 #include <array.h>
 #include <buffers.h>
+#include <io/iovec.h>
 
 #include "iso14443_4.h"
 #include "as3953.h"
@@ -123,13 +124,19 @@ struct __packed as3953_io_state {
 	u8  block_number;
 	u32 notifications;
 	struct {
-		u16 done;
+		u32 done;
 		u16 bytes;
 	} transfer;
 };
 
 PRIVATE State state = {0};
 
+/* Information field of the current I-Block. Response segments are gathered
+ * into this buffer block by block, e.g. straight from flash. It holds the
+ * last block until the next one has been requested, so a resend is served
+ * from here as well. */
+PRIVATE u8 inf_buff[32];
+
 PRIVATE DevCtx dev_ctx = {
 	/* Hacky: this value should been set to FSD after querying
 	 * RATS register on WakeUp/ACTIVE/PowerUp? */
@@ -295,7 +302,7 @@ PRIVATE void
 __transfer_rapdu_continue(Block *response, const Block *req)
 {
 	enum Iso14443_Block blk;
-	u16                 bytes_left;
+	u32                 bytes_left;
 	u16                 max_INF_size;
 
 	state.transfer.done += state.transfer.bytes;
@@ -310,16 +317,19 @@ __transfer_rapdu_continue(Block *response, const Block *req)
 	 */
 	max_INF_size = dev_ctx.max_frame_size - 3;
 
-	bytes_left = __rapdu->length - state.transfer.done;
+	max_INF_size = MIN(max_INF_size, sizeof(inf_buff));
+
+	bytes_left = __rvec->length - state.transfer.done;
 
 	/* Use I-Block chaining if remaining RAPDU bytes won't fit into one
 	 * I-Block. */
 	blk = bytes_left > max_INF_size ? I_BLK_C : I_BLK;
 
-	state.transfer.bytes = MIN(bytes_left, max_INF_size);
+	state.transfer.bytes = iov_gather(__rvec, state.transfer.done,
+			inf_buff, MIN(bytes_left, max_INF_size));
 
 	fill_response_and_send(response, req, blk,
-			__rapdu->v + state.transfer.done,
+			inf_buff,
 			state.transfer.bytes);
 }
 
@@ -580,7 +590,7 @@ iso14443_recveive(void)
 
 	wait_for_capdu();
 
-	array_truncate(__rapdu);
+	apdu_response_reset();
 
 	_static--;
 
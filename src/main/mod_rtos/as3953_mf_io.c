@@ -49,6 +49,8 @@
 
 #include <array.h>
 #include <buffers.h>
+#include <apdu.h>
+#include <io/stream.h>
 
 #include "iso14443_4.h"
 #include "as3953.h"
@@ -459,6 +461,13 @@ state__handle_request_3(const BitStream *req, BitStream *response)
 	 * important notifications, e.g. START_RX? */
 
 	if (rapdu_ready) {
+		if (!apdu_response_flatten()) {
+			/* the response does not fit into '__rapdu' */
+			apdu_response_reset();
+			stream_put_word(apdu_response, SW__WRONG_LENGTH);
+			apdu_response_flatten();
+		}
+
 		padding_bits = (__rapdu->length * 8) % 9;
 		response->INF = __rapdu->v;
 		response->INF_size = __rapdu->length;
@@ -518,7 +527,7 @@ iso14443_recveive(void)
 
 	wait_for_capdu();
 
-	array_reset(__rapdu);
+	apdu_response_reset();
 
 	_static--;
 
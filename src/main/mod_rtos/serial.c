@@ -32,6 +32,8 @@
 #include <modules.h>
 #include <array.h>
 #include <buffers.h>
+#include <apdu.h>
+#include <io/stream.h>
 
 /* Scheduler includes. */
 #include "FreeRTOS.h"
@@ -164,7 +166,7 @@ serial_receive()
 		}
 	}
 
-	array_truncate(__rapdu);
+	apdu_response_reset();
 
 	return __capdu;
 }
@@ -175,6 +177,13 @@ serial_transmit()
 {
 	u8 header[2];
 
+	if (!apdu_response_flatten()) {
+		/* the response does not fit into '__rapdu' */
+		apdu_response_reset();
+		stream_put_word(apdu_response, SW__WRONG_LENGTH);
+		apdu_response_flatten();
+	}
+
 	header[0] = (__rapdu->length & 0xFF00) >> 8;
 	header[1] = (__rapdu->length & 0x00FF);
 
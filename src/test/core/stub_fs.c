@@ -48,7 +48,8 @@ stub_fs_init()
 {
 	if (stub_memdev_init(&mdev)
 	||  somefs_mkfs(&mdev)
-	||  smartfs_mount_root(&mdev, somefs_mount))
+	||  register_filesystem(&somefs_fs_type)
+	||  smartfs_mount_root(&mdev, "somefs"))
 	{
 		return E_FAILED;
 	}
@@ -48,6 +48,7 @@ static void test_validate_cmd__ext_Lc_Le(void);
 static void test_sizeof_apdu_header(void);
 static void test_cmd_apdu__header_access(void);
 static void test_apdu_registry_is_sorted(void);
+static void test_apdu_resolve__unknown_ins(void);
 static void test_apdu_resolve__select(void);
 static void test_apdu_resolve__read_binary_b0(void);
 
@@ -62,6 +63,7 @@ static const struct test_case tc_arr[] = {
 	TEST_CASE ( test_validate_cmd__Lc_Le,       "validate command APDU: one byte Lc and (ext) Le" ),
 	TEST_CASE ( test_validate_cmd__ext_Lc_Le,   "validate command APDU: extended Lc and (ext) Le" ),
 	TEST_CASE ( test_apdu_registry_is_sorted, "APDU registry is sorted" ),
+	TEST_CASE ( test_apdu_resolve__unknown_ins, "Instruction: not supported" ),
 	TEST_CASE ( test_apdu_resolve__select, "Instruction: SELECT" ),
 	TEST_CASE ( test_apdu_resolve__read_binary_b0, "Instruction: READ BINARY (B0)" ),
 };
@@ -374,6 +376,33 @@ test_apdu_registry_is_sorted(void)
 			CU_FAIL_FATAL ( "registry array is not sorted" );
 }
 
+PRIVATE void
+test_apdu_resolve__unknown_ins(void)
+{
+	u8 apdu[4]  = {0};
+	CmdAPDU capdu = { .msg = apdu, .length = sizeof(apdu) };
+	struct apdu_header *header = (struct apdu_header *) apdu;
+	fp_handle_cmd_apdu cmd;
+
+	/* below the first and above the last registry entry */
+	header->INS = 0x00;
+	cmd = apdu_get_cmd_handler(&capdu);
+	CU_ASSERT_PTR_EQUAL ( cmd, cmd__not_supported );
+
+	header->INS = 0xFF;
+	cmd = apdu_get_cmd_handler(&capdu);
+	CU_ASSERT_PTR_EQUAL ( cmd, cmd__not_supported );
+
+	header->CLA = 0x80;
+	header->INS = 0x00;
+	cmd = apdu_get_cmd_handler(&capdu);
+	CU_ASSERT_PTR_EQUAL ( cmd, cmd__not_supported );
+
+	header->INS = 0xFF;
+	cmd = apdu_get_cmd_handler(&capdu);
+	CU_ASSERT_PTR_EQUAL ( cmd, cmd__not_supported );
+}
+
 PRIVATE void
 test_apdu_resolve__select(void)
 {
@@ -0,0 +1,234 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#include <CUnit/Basic.h>
+#include <const.h>
+#include <types.h>
+#include <string.h>
+
+#include <array.h>
+#include <mm/arena.h>
+
+#include <common/test_macros.h>
+#include <common/test_utils.h>
+
+static int init_suite(void);
+static int clean_suite(void);
+
+/*===========================================================================*
+   Module variables
+ *===========================================================================*/
+PRIVATE u8 __mem[256];
+PRIVATE struct arena arena = CArena(__mem);
+
+/*===========================================================================*
+   Prototype definitions
+ *===========================================================================*/
+PRIVATE void test_arena_alloc(void);
+PRIVATE void test_arena_release(void);
+PRIVATE void test_arena_unaligned(void);
+PRIVATE void test_array_grow_in_place(void);
+PRIVATE void test_array_grow_moved(void);
+PRIVATE void test_array_large(void);
+
+/*===========================================================================*
+   Test case definitions
+ *===========================================================================*/
+static const struct test_case tc_arr[] = {
+	TEST_CASE ( test_arena_alloc,         "allocate until exhaustion" ),
+	TEST_CASE ( test_arena_release,       "roll back to a mark" ),
+	TEST_CASE ( test_arena_unaligned,     "align objects of an unaligned arena" ),
+	TEST_CASE ( test_array_grow_in_place, "grow array at arena top" ),
+	TEST_CASE ( test_array_grow_moved,    "grow array below arena top" ),
+	TEST_CASE ( test_array_large,         "array lengths beyond 64 KiB" ),
+};
+
+/*===========================================================================*
+   Public suite initialisation functions
+ *===========================================================================*/
+int build_suite__arena()
+{
+	INIT_BUILD_SUITE();
+	CU_pSuite pSuite = NULL;
+
+	CREATE_SUITE_OR_DIE("memory arena", pSuite);
+	ADD_TEST_CASES_OR_DIE(pSuite, tc_arr);
+
+	return 0;
+}
+
+/* The suite initialization function.
+ * Returns zero on success, non-zero otherwise.
+ */
+static int
+init_suite(void)
+{
+	arena_reset(&arena);
+	return 0;
+}
+
+/* The suite cleanup function.
+ * Returns zero on success, non-zero otherwise.
+ */
+static int
+clean_suite(void)
+{
+	return 0;
+}
+
+/*===========================================================================*
+   Test case implementations
+ *===========================================================================*/
+PRIVATE void
+test_arena_alloc(void)
+{
+	u8 *a, *b;
+
+	arena_reset(&arena);
+
+	a = arena_alloc(&arena, 3);
+	b = arena_alloc(&arena, 5);
+	CU_ASSERT_PTR_EQUAL (a, __mem);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (b);
+
+	/* objects are aligned */
+	CU_ASSERT_EQUAL ((b - a) % sizeof(void *), 0);
+	CU_ASSERT_TRUE  (b - a >= 3);
+
+	CU_ASSERT_PTR_NULL (arena_alloc(&arena, sizeof(__mem)));
+	CU_ASSERT_PTR_NOT_NULL (arena_alloc(&arena, arena_bytes_left(&arena)));
+	CU_ASSERT_EQUAL (arena_bytes_left(&arena), 0);
+	CU_ASSERT_PTR_NULL (arena_alloc(&arena, 1));
+}
+
+PRIVATE void
+test_arena_release(void)
+{
+	u32 mark;
+	u8  *a, *b;
+
+	arena_reset(&arena);
+
+	arena_alloc(&arena, 10);
+	mark = arena_mark(&arena);
+	a = arena_alloc(&arena, 10);
+
+	arena_release(&arena, mark);
+	b = arena_alloc(&arena, 10);
+	CU_ASSERT_PTR_EQUAL (a, b);
+}
+
+PRIVATE void
+test_arena_unaligned(void)
+{
+	struct arena odd = Arena(__mem + 1, 64);
+	u8 *a, *b;
+
+	a = arena_alloc(&odd, 3);
+	b = arena_alloc(&odd, 5);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (a);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (b);
+
+	CU_ASSERT_EQUAL ((size_t) a % sizeof(void *), 0);
+	CU_ASSERT_EQUAL ((size_t) b % sizeof(void *), 0);
+	CU_ASSERT_TRUE  (a > __mem);
+	CU_ASSERT_TRUE  (b - a >= 3);
+
+	/* 'a' is not at top any more, 'b' is */
+	CU_ASSERT_EQUAL (arena_extend(&odd, a, 3, 4), E_NOMEM);
+	CU_ASSERT_EQUAL (arena_extend(&odd, b, 5, 9), E_GOOD);
+
+	CU_ASSERT_PTR_NULL (arena_alloc(&odd, 64));
+	CU_ASSERT_TRUE  (odd.top <= odd.size);
+}
+
+PRIVATE void
+test_array_grow_in_place(void)
+{
+	struct array *arr;
+	u8 *val;
+
+	arena_reset(&arena);
+
+	arr = arena_array_alloc(&arena, 4);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (arr);
+	CU_ASSERT_EQUAL (arr->max, 4);
+	CU_ASSERT_EQUAL (arr->len, 0);
+
+	array_append(arr, SRC(&OxDEADBEAF), 4);
+	CU_ASSERT_EQUAL (array_put(arr, 0x01), 0);
+
+	val = arr->val;
+	CU_ASSERT_EQUAL (arena_array_grow(&arena, arr, 12), E_GOOD);
+	CU_ASSERT_PTR_EQUAL (arr->val, val);
+	CU_ASSERT_EQUAL (arr->max, 12);
+	CU_ASSERT_EQUAL (array_put(arr, 0x01), 1);
+	CU_ASSERT_EQUAL_BUFFER (arr->val, SRC(&OxDEADBEAF), 4);
+
+	/* the next allocation starts behind the grown array */
+	CU_ASSERT_TRUE ((u8 *) arena_alloc(&arena, 1) >= arr->val + 12);
+}
+
+PRIVATE void
+test_array_grow_moved(void)
+{
+	struct array *arr;
+	u8 *val;
+
+	arena_reset(&arena);
+
+	arr = arena_array_alloc(&arena, 4);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (arr);
+	array_append(arr, SRC(&OxDEADBEAF), 4);
+
+	/* block growing in place */
+	arena_alloc(&arena, 1);
+
+	val = arr->val;
+	CU_ASSERT_EQUAL (arena_array_grow(&arena, arr, 8), E_GOOD);
+	CU_ASSERT_PTR_NOT_EQUAL (arr->val, val);
+	CU_ASSERT_EQUAL (arr->max, 8);
+	CU_ASSERT_EQUAL (arr->len, 4);
+	CU_ASSERT_EQUAL_BUFFER (arr->val, SRC(&OxDEADBEAF), 4);
+
+	CU_ASSERT_EQUAL (arena_array_grow(&arena, arr, sizeof(__mem)), E_NOMEM);
+	CU_ASSERT_EQUAL (arr->max, 8);
+}
+
+PRIVATE void
+test_array_large(void)
+{
+	static u8 __big[0x10000 + 16];
+	struct array big = CArray(__big);
+
+	CU_ASSERT_EQUAL (big.max, sizeof(__big));
+	CU_ASSERT_EQUAL (array_fill(&big, 0xAB), sizeof(__big));
+	CU_ASSERT_EQUAL (big.len, sizeof(__big));
+	CU_ASSERT_EQUAL (array_bytes_left(&big), 0);
+
+	array_reset(&big);
+	CU_ASSERT_EQUAL (array_append(&big, __big, 0x10000 + 1), 0x10000 + 1);
+}
@@ -25,6 +25,7 @@
 */
 
 #include <flxlib.h>
+#include <string.h>
 #include <i7816.h>
 #include <flxio.h>
 #include <CUnit/Basic.h>
@@ -32,6 +33,21 @@
 #include <common/test_macros.h>
 #include <common/test_utils.h>
 
+#include <io/dev.h>
+#include <fs/smartfs.h>
+#include <io/stream.h>
+#include <io/iovec.h>
+#include <io/pipeline.h>
+#include <io/file_stream.h>
+#include <fs/some/somefs.h>
+#include <fs/some/data.h>
+#include <fs/some/some_io.h>
+#include <buffers.h>
+#include <array.h>
+#include <flexcos.h>
+#include <channel.h>
+#include <mm/arena.h>
+
 #include "stub_fs.h"
 
 static int init_suite();
@@ -55,7 +71,7 @@ PRIVATE struct i7_fcp new_file = {
 /*===========================================================================*
    Module variables
  *===========================================================================*/
-PRIVATE FILE *test_file;
+PRIVATE FILE test_file;
 
 
 /*===========================================================================*
@@ -63,9 +79,23 @@ PRIVATE FILE *test_file;
  *===========================================================================*/
 PRIVATE void test_create_file(void);
 PRIVATE void test_open_file(void);
+PRIVATE void test_stale_handle(void);
 PRIVATE void test_close_file(void);
 PRIVATE void test_read_file(void);
 PRIVATE void test_write_file(void);
+PRIVATE void test_seek_file(void);
+PRIVATE void test_file_stream(void);
+PRIVATE void test_tlv_file(void);
+PRIVATE void test_vectored_file(void);
+PRIVATE void test_remove_file(void);
+PRIVATE void test_delete_command(void);
+PRIVATE void test_select_command(void);
+PRIVATE void test_get_data_command(void);
+PRIVATE void test_terminate_command(void);
+PRIVATE void test_activate_command(void);
+PRIVATE void test_command_arena(void);
+PRIVATE void test_command_stream(void);
+PRIVATE void test_command_commit(void);
 
 /*===========================================================================*
    Test case definitions
@@ -74,8 +104,22 @@ static const struct test_case tc_arr[] = {
 	TEST_CASE ( test_create_file, "create a file" ),
 	TEST_CASE ( test_close_file, "close a file"),
 	TEST_CASE ( test_open_file, "open a file"),
+	TEST_CASE ( test_stale_handle, "reject a handle of a closed file"),
 	TEST_CASE ( test_write_file, "write a file"),
 	TEST_CASE ( test_read_file, "read a file"),
+	TEST_CASE ( test_seek_file, "seek within a file"),
+	TEST_CASE ( test_file_stream, "skip and transfer from a file stream"),
+	TEST_CASE ( test_tlv_file, "find tlv objects within a file"),
+	TEST_CASE ( test_vectored_file, "read and write several records at once"),
+	TEST_CASE ( test_remove_file, "remove a file and reuse its space"),
+	TEST_CASE ( test_delete_command, "delete a file by FID"),
+	TEST_CASE ( test_select_command, "select a file by FID"),
+	TEST_CASE ( test_get_data_command, "get a data object of the current EF"),
+	TEST_CASE ( test_terminate_command, "terminate a file and report write errors"),
+	TEST_CASE ( test_activate_command, "activate the current DF and take a snapshot"),
+	TEST_CASE ( test_command_arena, "reset the arena for each command"),
+	TEST_CASE ( test_command_stream, "stream command data to a sink"),
+	TEST_CASE ( test_command_commit, "commit the file system every few files"),
 };
 
 
@@ -100,7 +144,7 @@ int build_suite__flxio()
 static int
 init_suite(void)
 {
-	test_file = NULL;
+	test_file = 0;
 	return stub_fs_init();
 }
 
@@ -120,35 +164,60 @@ PRIVATE void
 test_create_file(void)
 {
 	test_file = f_create(&new_file);
-	CU_ASSERT_PTR_NOT_NULL (test_file);
+	CU_ASSERT_NOT_EQUAL (test_file, 0);
 }
 
 PRIVATE void
 test_close_file(void)
 {
-	CU_ASSERT_PTR_NOT_NULL_FATAL (test_file);
+	CU_ASSERT_NOT_EQUAL_FATAL (test_file, 0);
 	CU_ASSERT_EQUAL (f_close(test_file), E_GOOD);
+	CU_ASSERT_EQUAL (f_close(test_file), E_BADFD);
 }
 
 PRIVATE void
 test_open_file(void)
 {
-	FILE *fh;
+	FILE fh;
 
 	fh = f_open(test_path);
-	CU_ASSERT_PTR_NOT_NULL_FATAL (fh);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
 
 	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
 }
 
+PRIVATE void
+test_stale_handle(void)
+{
+	FILE stale, fh;
+	u8   c;
+
+	stale = f_open(test_path);
+	CU_ASSERT_NOT_EQUAL_FATAL (stale, 0);
+	CU_ASSERT_EQUAL (f_close(stale), E_GOOD);
+
+	/* the file object is reused, but not under the old handle */
+	fh = f_open(test_path);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	CU_ASSERT_NOT_EQUAL (fh, stale);
+
+	CU_ASSERT_EQUAL (f_read(&c, 1, 1, stale), 0);
+	CU_ASSERT_EQUAL (f_seek(stale, 0, SEEK_SET), E_BADF);
+	CU_ASSERT_EQUAL (f_close(stale), E_BADFD);
+	CU_ASSERT_EQUAL (f_tell(fh), 0);
+
+	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
+	CU_ASSERT_EQUAL (f_close(0), E_BADFD);
+}
+
 PRIVATE void
 test_write_file(void)
 {
-	FILE   *fh;
+	FILE   fh;
 	size_t bytes;
 
 	fh = f_open(test_path);
-	CU_ASSERT_PTR_NOT_NULL_FATAL (fh);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
 
 	/* REMINDER: test_file_size is set to 4 */
 
@@ -166,11 +235,11 @@ test_read_file(void)
 	union blob_u16 _beaf = { .set = 0 };
 	union blob_u32 _deadbeaf = { .set = 0 };
 
-	FILE   *fh;
+	FILE   fh;
 	size_t bytes;
 
 	fh = f_open(test_path);
-	CU_ASSERT_PTR_NOT_NULL_FATAL (fh);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
 
 	/* REMINDER: test_file_size is set to 4 */
 
@@ -184,3 +253,695 @@ test_read_file(void)
 
 	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
 }
+
+PRIVATE void
+test_seek_file(void)
+{
+	u8     content[TEST_SIZE];
+	u8     c;
+	FILE   fh;
+
+	fh = f_open(test_path);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+
+	CU_ASSERT_EQUAL_FATAL (f_read(content, 1, TEST_SIZE, fh), TEST_SIZE);
+	CU_ASSERT_EQUAL (f_tell(fh), TEST_SIZE);
+
+	CU_ASSERT_EQUAL (f_seek(fh, 2, SEEK_SET), E_GOOD);
+	CU_ASSERT_EQUAL (f_tell(fh), 2);
+	CU_ASSERT_EQUAL (f_read(&c, 1, 1, fh), 1);
+	CU_ASSERT_EQUAL (c, content[2]);
+
+	CU_ASSERT_EQUAL (f_seek(fh, -2, SEEK_CUR), E_GOOD);
+	CU_ASSERT_EQUAL (f_tell(fh), 1);
+	CU_ASSERT_EQUAL (f_read(&c, 1, 1, fh), 1);
+	CU_ASSERT_EQUAL (c, content[1]);
+
+	CU_ASSERT_EQUAL (f_seek(fh, -1, SEEK_END), E_GOOD);
+	CU_ASSERT_EQUAL (f_tell(fh), TEST_SIZE - 1);
+
+	/* out of range, position is kept */
+	CU_ASSERT_EQUAL (f_seek(fh, TEST_SIZE + 1, SEEK_SET), E_RANGE);
+	CU_ASSERT_EQUAL (f_seek(fh, -TEST_SIZE, SEEK_CUR), E_RANGE);
+	CU_ASSERT_EQUAL (f_tell(fh), TEST_SIZE - 1);
+
+	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
+}
+
+PRIVATE void
+test_file_stream(void)
+{
+	u8     content[TEST_SIZE];
+	u8     scratch[2];
+	struct file_stream_in fis;
+	struct pipeline p;
+	FILE   fh;
+
+	fh = f_open(test_path);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	CU_ASSERT_EQUAL_FATAL (f_read(content, 1, TEST_SIZE, fh), TEST_SIZE);
+	CU_ASSERT_EQUAL (f_seek(fh, 0, SEEK_SET), E_GOOD);
+
+	file_stream_in_init(&fis, fh);
+
+	/* skipping stops at end of data */
+	CU_ASSERT_EQUAL (stream_skip(&fis.stream, 1), 1);
+	CU_ASSERT_EQUAL (f_tell(fh), 1);
+	CU_ASSERT_EQUAL (stream_skip(&fis.stream, 10), TEST_SIZE - 1);
+	CU_ASSERT_EQUAL (f_tell(fh), TEST_SIZE);
+
+	/* the response references file contents on its device */
+	apdu_response_reset();
+	f_seek(fh, 0, SEEK_SET);
+	CU_ASSERT_EQUAL (stream_transfer(&fis.stream, apdu_response, 10), TEST_SIZE);
+	CU_ASSERT_EQUAL (__rapdu->length, 0);
+	CU_ASSERT_EQUAL (__rvec->length, TEST_SIZE);
+	CU_ASSERT_EQUAL (apdu_response_flatten(), TEST_SIZE);
+	CU_ASSERT_EQUAL_BUFFER (__rapdu->val, content, TEST_SIZE);
+
+	/* streams without splice support get chunks of bytes */
+	apdu_response_reset();
+	f_seek(fh, 1, SEEK_SET);
+	pipeline_init(&p, scratch, sizeof(scratch), apdu_response);
+	CU_ASSERT_EQUAL (stream_transfer(&fis.stream, &p.impl, 10), TEST_SIZE - 1);
+	stream_close(&p.impl);
+	CU_ASSERT_EQUAL (__rapdu->length, TEST_SIZE - 1);
+	CU_ASSERT_EQUAL_BUFFER (__rapdu->val, content + 1, TEST_SIZE - 1);
+
+	apdu_response_reset();
+	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
+}
+
+PRIVATE void
+test_tlv_file(void)
+{
+	struct i7_fcp fcp = { .fid = TEST_FID + 1, .fdb = 0x01, .size = 16 };
+	const u8 content[] = {
+		0x70, 0x08,
+			0x5F, 0x20, 0x01, 0xAA,
+			0x81, 0x02, 0xBB, 0xCC,
+		0xFF,
+		0x82, 0x01, 0xDD
+	};
+	const u32 path_81[]  = { 0x70, 0x81 };
+	const u32 path_82[]  = { 0x82 };
+	const u32 path_bad[] = { 0x81 };
+	u8    value[2];
+	u32   length;
+	FILE  fh;
+
+	fh = f_create(&fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	CU_ASSERT_EQUAL_FATAL (f_write(content, 1, sizeof(content), fh),
+	                       sizeof(content));
+
+	CU_ASSERT_EQUAL (f_tlv_find(fh, path_81, 2, &length), E_GOOD);
+	CU_ASSERT_EQUAL (length, 2);
+	CU_ASSERT_EQUAL (f_read(value, 1, length, fh), 2);
+	CU_ASSERT_EQUAL (value[0], 0xBB);
+	CU_ASSERT_EQUAL (value[1], 0xCC);
+
+	CU_ASSERT_EQUAL (f_tlv_find(fh, path_82, 1, &length), E_GOOD);
+	CU_ASSERT_EQUAL (length, 1);
+	CU_ASSERT_EQUAL (f_tell(fh), sizeof(content) - 1);
+
+	CU_ASSERT_EQUAL (f_tlv_find(fh, path_bad, 1, &length), E_NOENT);
+
+	/* writing invalidates the index */
+	CU_ASSERT_EQUAL (f_seek(fh, 6, SEEK_SET), E_GOOD);
+	CU_ASSERT_EQUAL (f_write(path_82, 1, 1, fh), 1);
+	CU_ASSERT_EQUAL (f_tlv_find(fh, path_81, 2, &length), E_NOENT);
+	CU_ASSERT_EQUAL (f_tlv_find(fh, path_82, 2, &length), E_NOENT);
+	{
+		const u32 path_new[] = { 0x70, 0x82 };
+		CU_ASSERT_EQUAL (f_tlv_find(fh, path_new, 2, &length), E_GOOD);
+	}
+
+	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
+}
+
+PRIVATE u32 device_reads;
+PRIVATE err_t (*device_read)(u32, size_t, buff_t);
+
+PRIVATE err_t
+counting_read(u32 offset, size_t bytes, buff_t dest)
+{
+	device_reads++;
+	return device_read(offset, bytes, dest);
+}
+
+PRIVATE void
+test_vectored_file(void)
+{
+	struct i7_fcp fcp = {
+		.fid    = TEST_FID + 2,
+		.fdb    = 0x02,
+		.rsize  = 4,
+		.rcount = 3
+	};
+	struct f_seg seg[3];
+	u8     in[12], out[12] = {0};
+	MemDev *mdev;
+	FILE   fh;
+	u8     k;
+
+	for (k = 0; k < sizeof(in); k++)
+		in[k] = k + 1;
+
+	fh = f_create(&fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+
+	for (k = 0; k < LENGTH(seg); k++)
+		seg[k] = (struct f_seg) { k, 0, 4, in + 4 * k };
+
+	CU_ASSERT_EQUAL (f_writev(fh, seg, LENGTH(seg)), sizeof(in));
+	CU_ASSERT_EQUAL (f_tells(fh), 2);
+	CU_ASSERT_EQUAL (f_tell(fh), 4);
+
+	/* records adjacent on the device and in memory take a single read */
+	for (k = 0; k < LENGTH(seg); k++)
+		seg[k].buff = out + 4 * k;
+
+	mdev = fd_lookup(fh)->f_dentry->d_inode->i_mdev;
+	device_read   = mdev->read;
+	device_reads  = 0;
+	mdev->read    = counting_read;
+	CU_ASSERT_EQUAL (f_readv(fh, seg, LENGTH(seg)), sizeof(out));
+	mdev->read    = device_read;
+
+	CU_ASSERT_EQUAL (device_reads, 1);
+	CU_ASSERT_EQUAL_BUFFER (out, in, sizeof(in));
+
+	/* a segment beyond the data of its record ends the transfer */
+	memset(out, 0x00, sizeof(out));
+	seg[0] = (struct f_seg) { 1, 2, 4, out };
+	seg[1] = (struct f_seg) { 0, 0, 4, out + 4 };
+	CU_ASSERT_EQUAL (f_readv(fh, seg, 2), 2);
+	CU_ASSERT_EQUAL (out[0], in[6]);
+	CU_ASSERT_EQUAL (out[4], 0);
+	CU_ASSERT_EQUAL (f_tells(fh), 1);
+	CU_ASSERT_EQUAL (f_tell(fh), 4);
+
+	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
+	CU_ASSERT_EQUAL (f_readv(fh, seg, 2), 0);
+}
+
+PRIVATE void
+test_remove_file(void)
+{
+	struct i7_fcp fcp = { .fid = TEST_FID + 3, .fdb = 0x01, .size = 32 };
+	fid_t  path[] = { TEST_FID + 3, EOP };
+	u32    addr;
+	FILE   fh;
+
+	fh = f_create(&fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	addr = fd_lookup(fh)->f_dentry->d_inode->i_data;
+
+	/* open files are not removed */
+	CU_ASSERT_EQUAL (f_remove(path), E_BUSY);
+	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
+
+	CU_ASSERT_EQUAL (f_remove(path), E_GOOD);
+	CU_ASSERT_EQUAL (f_open(path), 0);
+	CU_ASSERT_EQUAL (f_remove(path), E_NOENT);
+
+	/* a file of the same size takes the space again */
+	fh = f_create(&fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	CU_ASSERT_EQUAL (fd_lookup(fh)->f_dentry->d_inode->i_data, addr);
+
+	CU_ASSERT_EQUAL (f_unlink(fh), E_GOOD);
+	CU_ASSERT_EQUAL (f_close(fh), E_BADFD);
+	CU_ASSERT_EQUAL (f_open(path), 0);
+}
+
+/**
+ *  Process a DELETE FILE command for a FID.
+ *
+ *  @return the status word
+ */
+PRIVATE u16
+delete_by_fid(fid_t fid)
+{
+	u8    cmd[] = { 0x00, 0xE4, 0x00, 0x00, 0x02, fid >> 8, fid & 0xFF };
+	Array capdu = CArray(cmd);
+	u16   sw;
+
+	capdu.length = sizeof(cmd);
+
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+
+	CU_ASSERT_EQUAL (apdu_response_flatten(), 2);
+	sw = (__rapdu->val[0] << 8) | __rapdu->val[1];
+	apdu_response_reset();
+
+	return sw;
+}
+
+PRIVATE void
+test_delete_command(void)
+{
+	struct i7_fcp fcp = { .fid = TEST_FID + 5, .fdb = 0x01, .size = 8 };
+	fid_t  path[] = { TEST_FID + 5, EOP };
+	FILE   fh, other;
+
+	fh = f_create(&fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	fcp.fid++;
+	other = f_create(&fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (other, 0);
+	CU_ASSERT_EQUAL (f_close(other), E_GOOD);
+	current->ef = fh;
+
+	CU_ASSERT_TRUE  (f_is(fh, path));
+	CU_ASSERT_FALSE (f_is(fh, _test_path));
+
+	/* another file, the current EF stays open */
+	CU_ASSERT_EQUAL (delete_by_fid(TEST_FID + 6), 0x9000);
+	CU_ASSERT_EQUAL (current->ef, fh);
+	CU_ASSERT_EQUAL (f_seek(fh, 0, SEEK_SET), E_GOOD);
+
+	/* the current EF is closed before it is deleted */
+	CU_ASSERT_EQUAL (delete_by_fid(TEST_FID + 5), 0x9000);
+	CU_ASSERT_EQUAL (current->ef, 0);
+	CU_ASSERT_EQUAL (f_close(fh), E_BADFD);
+	CU_ASSERT_EQUAL (f_open(path), 0);
+
+	CU_ASSERT_EQUAL (delete_by_fid(TEST_FID + 6), 0x6A82);
+}
+
+PRIVATE void
+test_select_command(void)
+{
+	struct i7_fcp fcp = {
+		.fid    = TEST_FID + 7,
+		.fdb    = 0x02,
+		.rsize  = 4,
+		.rcount = 3
+	};
+	u8    cmd[] = { 0x00, 0xA4, 0x02, 0x04, 0x02,
+	                (TEST_FID + 7) >> 8, (TEST_FID + 7) & 0xFF };
+	u8    expected[] = {
+		0x62, 0x12,
+		      0x80, 0x02, 0x00, 0x0C,
+		      0x82, 0x05, 0x02, 0x00, 0x00, 0x04, 0x03,
+		      0x83, 0x02, (TEST_FID + 7) >> 8, (TEST_FID + 7) & 0xFF,
+		      0x8A, 0x01, 0x00,
+		0x90, 0x00
+	};
+	Array capdu = CArray(cmd);
+	FILE  fh;
+
+	capdu.length = sizeof(cmd);
+
+	fh = f_create(&fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	expected[19] = inode_lcs_get(fd_lookup(fh)->f_dentry->d_inode);
+	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
+
+	/* the FCP template is encoded straight into the response */
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_EQUAL_FATAL (apdu_response_flatten(), sizeof(expected));
+	CU_ASSERT_EQUAL (memcmp(__rapdu->val, expected, sizeof(expected)), 0);
+	CU_ASSERT_NOT_EQUAL (current->ef, 0);
+	fh = current->ef;
+
+	/* no response data, the former EF is closed */
+	cmd[3] = 0x0C;
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_EQUAL (apdu_response_flatten(), 2);
+	CU_ASSERT_EQUAL (__rapdu->val[0], 0x90);
+	CU_ASSERT_EQUAL (f_close(fh), E_BADFD);
+
+	cmd[6]++;
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_EQUAL (apdu_response_flatten(), 2);
+	CU_ASSERT_EQUAL (__rapdu->val[0], 0x6A);
+	CU_ASSERT_EQUAL (__rapdu->val[1], 0x82);
+	apdu_response_reset();
+
+	CU_ASSERT_EQUAL (f_close(current->ef), E_GOOD);
+	current->ef = 0;
+	CU_ASSERT_EQUAL (delete_by_fid(TEST_FID + 7), 0x9000);
+}
+
+PRIVATE void
+test_get_data_command(void)
+{
+	struct i7_fcp fcp = { .fid = TEST_FID + 8, .fdb = 0x01, .size = 16 };
+	const u8 content[] = {
+		0x5F, 0x20, 0x03, 'a', 'b', 'c',
+		0x00,
+		0x82, 0x01, 0xDD
+	};
+	u8    abc[] = { 'a', 'b', 'c', 0x90, 0x00 };
+	u8    dd[]  = { 0xDD, 0x90, 0x00 };
+	u8    nf[]  = { 0x6A, 0x88 };
+	u8    cmd[] = { 0x00, 0xCA, 0x5F, 0x20 };
+	Array capdu = CArray(cmd);
+	FILE  fh;
+
+	capdu.length = sizeof(cmd);
+
+	fh = f_create(&fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	CU_ASSERT_EQUAL_FATAL (f_write(content, 1, sizeof(content), fh),
+	                       sizeof(content));
+	current->ef = fh;
+
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_EQUAL_FATAL (apdu_response_flatten(), sizeof(abc));
+	CU_ASSERT_EQUAL_BUFFER (__rapdu->val, abc, sizeof(abc));
+
+	cmd[2] = 0x00;
+	cmd[3] = 0x82;
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_EQUAL_FATAL (apdu_response_flatten(), sizeof(dd));
+	CU_ASSERT_EQUAL_BUFFER (__rapdu->val, dd, sizeof(dd));
+
+	cmd[3] = 0x81;
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_EQUAL_FATAL (apdu_response_flatten(), sizeof(nf));
+	CU_ASSERT_EQUAL_BUFFER (__rapdu->val, nf, sizeof(nf));
+	apdu_response_reset();
+
+	CU_ASSERT_EQUAL (delete_by_fid(TEST_FID + 8), 0x9000);
+	CU_ASSERT_EQUAL (current->ef, 0);
+}
+
+PRIVATE err_t
+failing_write(u32 offset, size_t bytes, buff_t src)
+{
+	PARAM_UNUSED(offset);
+	PARAM_UNUSED(bytes);
+	PARAM_UNUSED(src);
+
+	return E_HWW;
+}
+
+/**
+ *  Process a TERMINATE EF command for a FID.
+ *
+ *  @return the status word
+ */
+PRIVATE u16
+terminate_by_fid(fid_t fid)
+{
+	u8    cmd[] = { 0x00, 0xE8, 0x00, 0x00, 0x02, fid >> 8, fid & 0xFF };
+	Array capdu = CArray(cmd);
+	u16   sw;
+
+	capdu.length = sizeof(cmd);
+
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+
+	CU_ASSERT_EQUAL (apdu_response_flatten(), 2);
+	sw = (__rapdu->val[0] << 8) | __rapdu->val[1];
+	apdu_response_reset();
+
+	return sw;
+}
+
+/**
+ *  Process a command without data and keep the response.
+ *
+ *  @return the status word
+ */
+PRIVATE u16
+process_sw(u8 *cmd, u8 length)
+{
+	Array capdu = Array(cmd, length);
+	u32   n;
+
+	capdu.length = length;
+
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	n = apdu_response_flatten();
+	CU_ASSERT_TRUE_FATAL (n >= 2);
+
+	return (__rapdu->val[n - 2] << 8) | __rapdu->val[n - 1];
+}
+
+PRIVATE void
+test_terminate_command(void)
+{
+	struct i7_fcp fcp = { .fid = TEST_FID + 9, .fdb = 0x01, .size = 8 };
+	fid_t  path[] = { TEST_FID + 9, EOP };
+	MemDev *mdev = mnt.super->s_mdev;
+	err_t  (*device_write)(u32, size_t, buff_t) = mdev->write;
+	u8     select[] = { 0x00, 0xA4, 0x02, 0x0C, 0x02,
+	                    (TEST_FID + 9) >> 8, (TEST_FID + 9) & 0xFF };
+	u8     get_data[] = { 0x00, 0xCA, 0x5F, 0x20 };
+	u8     b = 0;
+	FILE   fh;
+
+	fh = f_create(&fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+
+	/* a pending change that can not be written is reported on closing */
+	inode_mark_dirty(fd_lookup(fh)->f_dentry->d_inode);
+	mdev->write = failing_write;
+	CU_ASSERT_NOT_EQUAL (f_close(fh), E_GOOD);
+	CU_ASSERT_EQUAL (f_close(fh), E_BADFD);
+
+	CU_ASSERT_EQUAL (terminate_by_fid(TEST_FID + 9), 0x6581);
+	mdev->write = device_write;
+
+	CU_ASSERT_EQUAL (terminate_by_fid(TEST_FID + 9), 0x9000);
+	CU_ASSERT_EQUAL (terminate_by_fid(TEST_FID + 9), 0x9000);
+
+	/* a terminated file is described, but not opened, read or written */
+	CU_ASSERT_EQUAL (f_open(path), 0);
+	fh = f_info(path, &fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	CU_ASSERT_EQUAL (fcp.lcs, TERMINATION);
+	CU_ASSERT_TRUE (f_is_terminated(fh));
+	CU_ASSERT_EQUAL (f_read(&b, 1, 1, fh), 0);
+	CU_ASSERT_EQUAL (f_write(&b, 1, 1, fh), 0);
+	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
+
+	/* it is selected with a warning, its content is refused */
+	CU_ASSERT_EQUAL (process_sw(select, sizeof(select)), 0x6285);
+	CU_ASSERT_NOT_EQUAL (current->ef, 0);
+	CU_ASSERT_EQUAL (process_sw(get_data, sizeof(get_data)), 0x6985);
+	apdu_response_reset();
+
+	CU_ASSERT_EQUAL (delete_by_fid(TEST_FID + 9), 0x9000);
+	CU_ASSERT_EQUAL (current->ef, 0);
+}
+
+PRIVATE void
+test_activate_command(void)
+{
+	u8    cmd[] = { 0x00, 0x44, 0x00, 0x00, 0x01, 0x00 };
+	Array capdu = CArray(cmd);
+	fid_t path[] = { MF, EOP };
+	SomeSuper *ss = mnt.super->s_ctx;
+	struct i7_fcp fcp;
+	FILE  fh;
+
+	capdu.length = sizeof(cmd);
+
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_EQUAL (apdu_response_flatten(), 2);
+	CU_ASSERT_EQUAL (__rapdu->val[0], 0x67);
+
+	/* the end of personalization summarizes the tree */
+	capdu.length = 4;
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_EQUAL (apdu_response_flatten(), 2);
+	CU_ASSERT_EQUAL (__rapdu->val[0], 0x90);
+	CU_ASSERT_NOT_EQUAL (ss->sb.snapshot, NO_ADDR);
+	CU_ASSERT_PTR_NOT_NULL (ss->snap);
+	CU_ASSERT_FALSE (ss->sb.flags & SOMEFS_SB_OPEN);
+	apdu_response_reset();
+
+	fh = f_info(path, &fcp);
+	CU_ASSERT_NOT_EQUAL_FATAL (fh, 0);
+	CU_ASSERT_EQUAL (fcp.lcs, OP_ACTIVED);
+	CU_ASSERT_EQUAL (f_close(fh), E_GOOD);
+}
+
+PRIVATE void
+test_command_arena(void)
+{
+	u8    cmd[] = { 0x80, 0xC2, 0x00, 0x00, 0x0A,
+	                0x21, 0x08, 0x01, 0x02, 0xAA, 0xBB, 0x02, 0x02, 0x11, 0x22 };
+	Array capdu = CArray(cmd);
+	u32   top;
+
+	capdu.length = sizeof(cmd);
+
+	/* EC2PS START takes its HMAC stream from the arena */
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	top = arena_mark(chan_arena);
+	CU_ASSERT_NOT_EQUAL (top, 0);
+	/* message, MAC and status word */
+	CU_ASSERT_EQUAL (__rvec->length, 2 + 32 + 2);
+
+	/* the objects of the former command are dropped */
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_EQUAL (arena_mark(chan_arena), top);
+	CU_ASSERT_EQUAL (__rvec->length, 2 + 32 + 2);
+
+	apdu_response_reset();
+}
+
+/**
+ *  Process an EC2PS START command of 'lc' data bytes.
+ *
+ *  @return the status word
+ */
+PRIVATE u16
+ec2ps_start(u8 *cmd, u8 lc)
+{
+	Array capdu = Array(cmd, 5 + lc);
+	u16   sw;
+
+	capdu.length = 5 + lc;
+
+	cmd[0] = 0x80;
+	cmd[1] = 0xC2;
+	cmd[2] = 0x00;
+	cmd[3] = 0x00;
+	cmd[4] = lc;
+
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+	CU_ASSERT_NOT_EQUAL_FATAL (apdu_response_flatten(), 0);
+	sw = (__rapdu->val[__rapdu->length - 2] << 8)
+	   |  __rapdu->val[__rapdu->length - 1];
+
+	return sw;
+}
+
+PRIVATE void
+test_command_stream(void)
+{
+	u8 cmd[5 + 4 + 2 + 40 + 4];
+	u8 *data = cmd + 5;
+	u8 k;
+
+	/* a message larger than the reassembly buffer goes to the HMAC */
+	memcpy(data, "\x21\x2E\x01\x28", 4);
+	for (k = 0; k < 40; k++)
+		data[4 + k] = k;
+	memcpy(data + 44, "\x02\x02\x11\x22", 4);
+
+	CU_ASSERT_EQUAL (ec2ps_start(cmd, 48), 0x6A81);
+	/* message, MAC and status word */
+	CU_ASSERT_EQUAL (__rapdu->length, 40 + 32 + 2);
+	CU_ASSERT_EQUAL (memcmp(__rapdu->val, data + 4, 40), 0);
+
+	/* any part of the message already passed on is dropped */
+	data[1] = 0x2A;
+	CU_ASSERT_EQUAL (ec2ps_start(cmd, 44), 0x6A80);
+	CU_ASSERT_EQUAL (__rapdu->length, 2);
+
+	/* a second message */
+	memcpy(data, "\x21\x08\x01\x02\xAA\xBB\x01\x02\xAA\xBB", 10);
+	CU_ASSERT_EQUAL (ec2ps_start(cmd, 10), 0x6A85);
+	CU_ASSERT_EQUAL (__rapdu->length, 2);
+
+	/* a PIN too large to be kept */
+	memcpy(data, "\x21\x17\x01\x02\xAA\xBB\x02\x11", 8);
+	memset(data + 8, 0x33, 17);
+	CU_ASSERT_EQUAL (ec2ps_start(cmd, 25), 0x6A85);
+	CU_ASSERT_EQUAL (__rapdu->length, 2);
+
+	apdu_response_reset();
+}
+
+PRIVATE u32 sb_writes;
+PRIVATE err_t (*counted_write)(u32, size_t, buff_t);
+
+PRIVATE err_t
+counting_write(u32 offset, size_t bytes, buff_t src)
+{
+	if (offset < sizeof(SomeSB))
+		sb_writes++;
+
+	return counted_write(offset, bytes, src);
+}
+
+/**
+ *  Process a CREATE FILE command for a transparent EF of 8 bytes.
+ *
+ *  @return the status word
+ */
+PRIVATE u16
+create_by_fid(fid_t fid)
+{
+	u8    cmd[] = { 0x00, 0xE0, 0x00, 0x00, 0x0C,
+	                0x62, 0x0A, 0x82, 0x04, 0x01, 0x00, 0x00, 0x08,
+	                0x83, 0x02, fid >> 8, fid & 0xFF };
+	Array capdu = CArray(cmd);
+	u16   sw;
+
+	capdu.length = sizeof(cmd);
+
+	apdu_response_reset();
+	flexcos_process(&capdu, apdu_response);
+
+	CU_ASSERT_EQUAL (apdu_response_flatten(), 2);
+	sw = (__rapdu->val[0] << 8) | __rapdu->val[1];
+	apdu_response_reset();
+
+	return sw;
+}
+
+PRIVATE void
+test_command_commit(void)
+{
+	fid_t  path[] = { TEST_FID + 0x10, EOP };
+	MemDev *mdev = mnt.super->s_mdev;
+	SomeSB sb;
+	u8     k;
+
+	CU_ASSERT_EQUAL_FATAL (smartfs_sync(), E_GOOD);
+
+	counted_write = mdev->write;
+	mdev->write   = counting_write;
+	sb_writes     = 0;
+
+	/* the superblock is opened once, commands do not commit it */
+	for (k = 0; k < SOMEFS_COMMIT_FILES - 1; k++)
+		CU_ASSERT_EQUAL (create_by_fid(TEST_FID + 0x10 + k), 0x9000);
+
+	CU_ASSERT_EQUAL (sb_writes, 1);
+	CU_ASSERT_EQUAL_FATAL (some_sb_read(mdev, &sb), E_GOOD);
+	CU_ASSERT_TRUE (sb.flags & SOMEFS_SB_OPEN);
+
+	/* until enough files are created */
+	CU_ASSERT_EQUAL (create_by_fid(TEST_FID + 0x10 + k), 0x9000);
+	CU_ASSERT_EQUAL (sb_writes, 2);
+	CU_ASSERT_EQUAL_FATAL (some_sb_read(mdev, &sb), E_GOOD);
+	CU_ASSERT_FALSE (sb.flags & SOMEFS_SB_OPEN);
+
+	mdev->write = counted_write;
+
+	for (k = 0; k < SOMEFS_COMMIT_FILES; k++)
+		CU_ASSERT_EQUAL (delete_by_fid(TEST_FID + 0x10 + k), 0x9000);
+
+	/* the removals are not committed, the remount recovers them */
+	CU_ASSERT_EQUAL_FATAL (some_sb_read(mdev, &sb), E_GOOD);
+	CU_ASSERT_TRUE (sb.flags & SOMEFS_SB_OPEN);
+
+	CU_ASSERT_EQUAL_FATAL (smartfs_mount_root(mdev, "somefs"), E_GOOD);
+	CU_ASSERT_FALSE (((SomeSuper *) mnt.super->s_ctx)->sb.flags & SOMEFS_SB_OPEN);
+	CU_ASSERT_EQUAL (f_open(path), 0);
+}
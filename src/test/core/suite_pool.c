@@ -0,0 +1,262 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+#include <CUnit/Basic.h>
+#include <const.h>
+#include <types.h>
+#include <string.h>
+
+#include <mm/pool.h>
+
+#include <common/test_macros.h>
+#include <common/test_utils.h>
+
+static int init_suite(void);
+static int clean_suite(void);
+
+/*===========================================================================*
+   Module variables
+ *===========================================================================*/
+#define MEMBERS  40
+
+struct member {
+	u32 a;
+	u8  b[6];
+};
+
+/* more members than fit into a single bitmap word */
+PRIVATE struct member marr[MEMBERS];
+PRIVATE u8            musage[(MEMBERS + 7) / 8];
+PRIVATE u16           mfree[MEMBERS];
+
+PRIVATE struct pool bitmap_pool = {
+	.n     = LENGTH(marr),
+	.msize = sizeof(*marr),
+	.memb  = marr,
+	.usage = musage
+};
+
+PRIVATE struct pool stack_pool = {
+	.n     = LENGTH(marr),
+	.msize = sizeof(*marr),
+	.memb  = marr,
+	.usage = musage,
+	.free  = mfree,
+	.flags = POOL_SANITIZE
+};
+
+/*===========================================================================*
+   Prototype definitions
+ *===========================================================================*/
+PRIVATE void test_pool_bitmap(void);
+PRIVATE void test_pool_free_stack(void);
+PRIVATE void test_pool_sanitize(void);
+PRIVATE void test_pool_stats(void);
+PRIVATE void test_pool_put_foreign(void);
+
+/*===========================================================================*
+   Test case definitions
+ *===========================================================================*/
+static const struct test_case tc_arr[] = {
+	TEST_CASE ( test_pool_bitmap,      "get and put by usage bitmap" ),
+	TEST_CASE ( test_pool_free_stack,  "get and put by free stack" ),
+	TEST_CASE ( test_pool_sanitize,    "sanitize policy" ),
+	TEST_CASE ( test_pool_stats,       "usage statistics" ),
+	TEST_CASE ( test_pool_put_foreign, "put foreign and free members" ),
+};
+
+/*===========================================================================*
+   Public suite initialisation functions
+ *===========================================================================*/
+int build_suite__pool()
+{
+	INIT_BUILD_SUITE();
+	CU_pSuite pSuite = NULL;
+
+	CREATE_SUITE_OR_DIE("memory pool", pSuite);
+	ADD_TEST_CASES_OR_DIE(pSuite, tc_arr);
+
+	return 0;
+}
+
+/* The suite initialization function.
+ * Returns zero on success, non-zero otherwise.
+ */
+static int
+init_suite(void)
+{
+	return 0;
+}
+
+/* The suite cleanup function.
+ * Returns zero on success, non-zero otherwise.
+ */
+static int
+clean_suite(void)
+{
+	return 0;
+}
+
+/*===========================================================================*
+   Local subtest implementations
+ *===========================================================================*/
+/*
+ * Allocate all members. They must be distinct and in order of their index.
+ */
+PRIVATE void
+sub_test_get_all(struct pool *p)
+{
+	struct member *m;
+	u32 i;
+
+	for (i = 0; i < MEMBERS; i++) {
+		m = pool_get(p);
+		CU_ASSERT_PTR_EQUAL_FATAL (m, &marr[i]);
+		CU_ASSERT_EQUAL (pool_id(p, m), i + 1);
+		CU_ASSERT_PTR_EQUAL (pool_lookup(p, i + 1), m);
+	}
+
+	CU_ASSERT_PTR_NULL (pool_get(p));
+}
+
+/*===========================================================================*
+   Test case implementations
+ *===========================================================================*/
+PRIVATE void
+test_pool_bitmap(void)
+{
+	struct pool *p = &bitmap_pool;
+
+	pool_reset(p);
+	sub_test_get_all(p);
+
+	/* free members beyond the first bitmap word */
+	CU_ASSERT_EQUAL (pool_put(p, &marr[35]), E_GOOD);
+	CU_ASSERT_EQUAL (pool_put(p, &marr[33]), E_GOOD);
+	CU_ASSERT_PTR_NULL (pool_lookup(p, 34));
+
+	CU_ASSERT_PTR_EQUAL (pool_get(p), &marr[33]);
+	CU_ASSERT_PTR_EQUAL (pool_get(p), &marr[35]);
+	CU_ASSERT_PTR_NULL  (pool_get(p));
+
+	/* the lowest free member comes first */
+	pool_put(p, &marr[7]);
+	pool_put(p, &marr[2]);
+	CU_ASSERT_PTR_EQUAL (pool_get(p), &marr[2]);
+	CU_ASSERT_PTR_EQUAL (pool_get(p), &marr[7]);
+}
+
+PRIVATE void
+test_pool_free_stack(void)
+{
+	struct pool *p = &stack_pool;
+
+	pool_reset(p);
+	sub_test_get_all(p);
+
+	/* the last freed member comes first */
+	pool_put(p, &marr[2]);
+	pool_put(p, &marr[38]);
+	pool_put(p, &marr[7]);
+	CU_ASSERT_PTR_EQUAL (pool_get(p), &marr[7]);
+	CU_ASSERT_PTR_EQUAL (pool_get(p), &marr[38]);
+	CU_ASSERT_PTR_EQUAL (pool_get(p), &marr[2]);
+	CU_ASSERT_PTR_NULL  (pool_get(p));
+}
+
+PRIVATE void
+test_pool_sanitize(void)
+{
+	struct member *m;
+
+	pool_reset(&bitmap_pool);
+	m = pool_get(&bitmap_pool);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (m);
+	m->a = 0xCAFE;
+	pool_put(&bitmap_pool, m);
+	CU_ASSERT_EQUAL (m->a, 0xCAFE);
+
+	pool_reset(&stack_pool);
+	m = pool_get(&stack_pool);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (m);
+	m->a = 0xCAFE;
+	memset(m->b, 0xFF, sizeof(m->b));
+	pool_put(&stack_pool, m);
+	CU_ASSERT_EQUAL (m->a, 0);
+	CU_ASSERT_EQUAL (m->b[5], 0);
+}
+
+PRIVATE void
+test_pool_stats(void)
+{
+	struct pool *p = &stack_pool;
+	struct member *m[3];
+
+	pool_reset(p);
+	CU_ASSERT_EQUAL (p->stats.used, 0);
+	CU_ASSERT_EQUAL (p->stats.high, 0);
+
+	m[0] = pool_get(p);
+	m[1] = pool_get(p);
+	m[2] = pool_get(p);
+	pool_put(p, m[1]);
+	pool_put(p, m[2]);
+	CU_ASSERT_EQUAL (p->stats.used, 1);
+	CU_ASSERT_EQUAL (p->stats.high, 3);
+	CU_ASSERT_EQUAL (p->stats.fails, 0);
+
+	pool_put(p, m[0]);
+	while (pool_get(p))
+		;
+	CU_ASSERT_EQUAL (p->stats.used, MEMBERS);
+	CU_ASSERT_EQUAL (p->stats.high, MEMBERS);
+	CU_ASSERT_EQUAL (p->stats.fails, 1);
+}
+
+PRIVATE void
+test_pool_put_foreign(void)
+{
+	struct pool *p = &stack_pool;
+	struct member *m;
+	u8 *unaligned;
+
+	pool_reset(p);
+	m = pool_get(p);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (m);
+
+	unaligned = (u8 *) &marr[1] + 1;
+	CU_ASSERT_NOT_EQUAL (pool_put(p, unaligned), E_GOOD);
+	CU_ASSERT_NOT_EQUAL (pool_put(p, &marr[MEMBERS]), E_GOOD);
+
+	/* a second put of the same member does not count */
+	CU_ASSERT_EQUAL (pool_put(p, m), E_GOOD);
+	CU_ASSERT_EQUAL (pool_put(p, m), E_GOOD);
+	CU_ASSERT_EQUAL (p->stats.used, 0);
+
+	/* and it is handed out only once */
+	CU_ASSERT_PTR_EQUAL (pool_get(p), m);
+	CU_ASSERT_PTR_NOT_EQUAL (pool_get(p), m);
+}
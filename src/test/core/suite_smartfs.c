@@ -25,9 +25,18 @@
 */
 
 #include <flxlib.h>
+#include <string.h>
 #include <i7816.h>
 #include <CUnit/Basic.h>
 #include <fs/smartfs.h>
+#include <io/dev.h>
+#include <fs/some/somefs.h>
+#include <fs/some/data.h>
+#include <fs/some/some_io.h>
+#include <fs/some/some_snap.h>
+#include <fs/some/smartfs_impl.h>
+#include <mm/pool.h>
+#include <fs/pools.h>
 
 #include <common/test_macros.h>
 #include <common/test_utils.h>
@@ -54,6 +63,15 @@ PRIVATE void test_path_lookup__subdir(void);
 PRIVATE void test_path_lookup__MF(void);
 PRIVATE void test_path_lookup__EOP(void);
 
+PRIVATE void test_dcache__hit(void);
+PRIVATE void test_dcache__negative(void);
+PRIVATE void test_dcache__reclaim(void);
+PRIVATE void test_path_cache(void);
+PRIVATE void test_icache__hit(void);
+PRIVATE void test_inode_do_lookup__resident_dir(void);
+PRIVATE void test_icache__write_back(void);
+PRIVATE void test_inode_smap__window(void);
+
 // TODO rework:
 PRIVATE void test_super_do_write_and_read_inode(void);
 PRIVATE void test_super_do_delete_inode(void);
@@ -66,6 +84,15 @@ PRIVATE void test_inode_do_rmdir(void);
 PRIVATE void test_file_do_open_and_release(void);
 PRIVATE void test_file_do_write(void);
 PRIVATE void test_file_do_read(void);
+PRIVATE void test_mount(void);
+PRIVATE void test_snapshot(void);
+PRIVATE void test_snapshot_commit(void);
+PRIVATE void test_sb_commit(void);
+PRIVATE void test_remove(void);
+PRIVATE void test_create_failure(void);
+PRIVATE void test_dir_blocks(void);
+PRIVATE void test_umount(void);
+PRIVATE void test_icache__reset(void);
 // XXX end of rework
 
 PRIVATE void sub_test_what_a_file_does(Inode *);
@@ -88,12 +115,29 @@ static const struct test_case tc_arr[] = {
 	TEST_CASE ( test_path_lookup__file, "path - lookup file" ),
 	TEST_CASE ( test_path_lookup__EOP,  "path - lookup empty path" ),
 	TEST_CASE ( test_path_lookup__subdir, "path - lookup subdir" ),
+	TEST_CASE ( test_dcache__hit, "dcache - repeated lookup" ),
+	TEST_CASE ( test_dcache__negative, "dcache - lookup missing file" ),
+	TEST_CASE ( test_dcache__reclaim, "dcache - reclaim unused dentries" ),
+	TEST_CASE ( test_path_cache, "path - repeated lookup after create" ),
+	TEST_CASE ( test_icache__hit, "icache - get a cached inode" ),
+	TEST_CASE ( test_inode_do_lookup__resident_dir, "inode - lookup and create in a resident DF" ),
+	TEST_CASE ( test_icache__write_back, "icache - write back a dirty inode" ),
+	TEST_CASE ( test_inode_smap__window, "inode - load section map on demand" ),
 	TEST_CASE ( test_super_do_write_and_read_inode, "super - write and read inode"),
 	TEST_CASE ( test_inode_do_unlink, "inode - unlink"),
 	TEST_CASE ( test_super_do_delete_inode, "super - delete inode" ),
 	TEST_CASE ( test_inode_do_rmdir, "inode - rmdir" ),
 	TEST_CASE ( test_file_do_write, "file - write" ),
 	TEST_CASE ( test_file_do_read, "file - read" ),
+	TEST_CASE ( test_mount, "mount - second file system under MF" ),
+	TEST_CASE ( test_snapshot, "somefs - mount and lookup from a tree snapshot" ),
+	TEST_CASE ( test_snapshot_commit, "somefs - snapshot follows the commits" ),
+	TEST_CASE ( test_sb_commit, "somefs - commit and recover allocations" ),
+	TEST_CASE ( test_remove, "dentry - remove a file and reuse its space" ),
+	TEST_CASE ( test_create_failure, "somefs - give back the space of a failed create" ),
+	TEST_CASE ( test_dir_blocks, "somefs - DF with more children than a block" ),
+	TEST_CASE ( test_umount, "mount - unmount a file system" ),
+	TEST_CASE ( test_icache__reset, "icache - destroy cached inodes on reset" ),
 };
 
 int build_suite__smartfs()
@@ -125,6 +169,60 @@ clean_suite(void)
 	return stub_fs_free();
 }
 
+/* count device reads to verify cache hits */
+PRIVATE err_t (*device_read)(u32, size_t, buff_t);
+PRIVATE u32   device_reads;
+
+PRIVATE err_t
+counting_read(u32 offset, size_t bytes, buff_t dest)
+{
+	device_reads++;
+	return device_read(offset, bytes, dest);
+}
+
+PRIVATE void
+count_reads(bool on)
+{
+	MemDev *mdev = mnt.super->s_mdev;
+
+	if (on) {
+		device_read  = mdev->read;
+		device_reads = 0;
+		mdev->read   = counting_read;
+	} else {
+		mdev->read   = device_read;
+	}
+}
+
+/* count bytes written into a range of the device */
+PRIVATE err_t (*device_write)(u32, size_t, buff_t);
+PRIVATE u32   range_lo, range_hi, range_written;
+
+PRIVATE err_t
+counting_write(u32 offset, size_t bytes, buff_t src)
+{
+	if (offset < range_hi && offset + bytes > range_lo)
+		range_written += bytes;
+
+	return device_write(offset, bytes, src);
+}
+
+PRIVATE void
+count_writes(bool on, u32 lo, u32 hi)
+{
+	MemDev *mdev = mnt.super->s_mdev;
+
+	if (on) {
+		device_write  = mdev->write;
+		range_lo      = lo;
+		range_hi      = hi;
+		range_written = 0;
+		mdev->write   = counting_write;
+	} else {
+		mdev->write   = device_write;
+	}
+}
+
 /* ===========================================================================*
  *  Local subtest implementations
  * ========================================================================== */
@@ -427,6 +525,316 @@ test_path_lookup__subdir(void)
 	dput(dentry);
 }
 
+/**
+ * A second lookup of the same name must not touch the device.
+ */
+PRIVATE void
+test_dcache__hit(void)
+{
+	Dentry *d1, *d2;
+	fid_t  path[] = { TEST_FILE_FID, EOP };
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(path, &d1);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	dput(d1);
+
+	count_reads(true);
+	err = smartfs_path_lookup(path, &d2);
+	count_reads(false);
+
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	CU_ASSERT_PTR_EQUAL (d1, d2);
+	CU_ASSERT_PTR_NOT_NULL (d2->d_inode);
+	CU_ASSERT_EQUAL (d2->d_count, 1);
+	CU_ASSERT_EQUAL (device_reads, 0);
+
+	dput(d2);
+}
+
+PRIVATE void
+test_dcache__negative(void)
+{
+	Dentry *d;
+	fid_t  path[] = { 0x4711, EOP };
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(path, &d);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+	CU_ASSERT_PTR_NULL (d);
+
+	count_reads(true);
+	err = smartfs_path_lookup(path, &d);
+	count_reads(false);
+
+	CU_ASSERT_EQUAL (err, E_NOENT);
+	CU_ASSERT_EQUAL (device_reads, 0);
+	/* a failed lookup holds no reference */
+	CU_ASSERT_EQUAL (mnt.droot->d_count, 1);
+}
+
+/**
+ * Flood the cache with more names than there are dentries. Unused ones are
+ * reclaimed, referenced ones must survive.
+ */
+PRIVATE void
+test_dcache__reclaim(void)
+{
+	Dentry *d, *tmp;
+	fid_t  path[] = { TEST_FILE_FID, EOP };
+	fid_t  fid;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(path, &d);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+
+	for (fid = 0x5000; fid < 0x5000 + 2 * FS_MAX_ACTIVE_DENTRIES; fid++) {
+		CU_ASSERT_PTR_NULL (dentry_lookup(mnt.droot, fid));
+	}
+
+	CU_ASSERT_EQUAL (d->d_name, TEST_FILE_FID);
+	CU_ASSERT_PTR_NOT_NULL (d->d_inode);
+
+	err = smartfs_path_lookup(path, &tmp);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_PTR_EQUAL (tmp, d);
+	CU_ASSERT_EQUAL (d->d_count, 2);
+
+	dput(tmp);
+	dput(d);
+
+	/* and there is still room for a new name */
+	for (fid = 0x6000; fid < 0x6000 + 2 * FS_MAX_ACTIVE_DENTRIES; fid++) {
+		CU_ASSERT_PTR_NULL (dentry_lookup(mnt.droot, fid));
+	}
+
+	err = smartfs_path_lookup(path, &d);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	CU_ASSERT_PTR_NOT_NULL (d->d_inode);
+	dput(d);
+}
+
+/**
+ * Resolved paths are remembered, but creating a file must not leave a stale
+ * result behind.
+ */
+PRIVATE void
+test_path_cache(void)
+{
+	Dentry *d, *d2, *dnew;
+	fid_t  path[]    = { MF, TEST_FILE_FID, EOP };
+	fid_t  newpath[] = { MF, 0x3302, EOP };
+	Attr   attr      = TEST_FILE_ATTR;
+	u16    gen;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(path, &d);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	dput(d);
+
+	count_reads(true);
+	err = smartfs_path_lookup(path, &d2);
+	count_reads(false);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	CU_ASSERT_PTR_EQUAL (d2, d);
+	CU_ASSERT_EQUAL (d2->d_count, 1);
+	CU_ASSERT_EQUAL (device_reads, 0);
+	dput(d2);
+
+	err = smartfs_path_lookup(newpath, &dnew);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+
+	gen  = mnt.droot->d_gen;
+	dnew = dentry_create(mnt.droot, 0x3302, &attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (dnew);
+	CU_ASSERT_NOT_EQUAL (mnt.droot->d_gen, gen);
+
+	err = smartfs_path_lookup(newpath, &d2);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_PTR_EQUAL (d2, dnew);
+	dput(d2);
+	dput(dnew);
+
+	err = smartfs_path_lookup(path, &d2);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_PTR_EQUAL (d2, d);
+	dput(d2);
+}
+
+/**
+ * Getting an inode, which has been read before, must not touch the device.
+ */
+PRIVATE void
+test_icache__hit(void)
+{
+	Super *const s = mnt.super;
+	Inode *i, *i2;
+	err_t err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+	if (test_ino == 0) {
+		CU_FAIL_FATAL ("depend on test_inode_do_create");
+	}
+
+	i = iget(s, test_ino);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (i);
+	err = inode_pull(i);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+
+	count_reads(true);
+	i2  = iget(s, test_ino);
+	err = inode_pull(i2);
+	count_reads(false);
+
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_PTR_EQUAL (i, i2);
+	CU_ASSERT_FALSE (i2->i_state & I_NEW);
+	CU_ASSERT_EQUAL (device_reads, 0);
+
+	iput(i2);
+	iput(i);
+}
+
+/**
+ * Directory entries are read once. A new file only writes its own slot.
+ */
+PRIVATE void
+test_inode_do_lookup__resident_dir(void)
+{
+	static Dentry d = {0};
+	Inode  *const iroot = mnt.droot->d_inode;
+	Dentry *dnew;
+	Attr   attr = TEST_FILE_ATTR;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	/* any lookup before has read the directory */
+	d.d_name = 0x4243;
+	count_reads(true);
+	err = iroot->i_do->lookup(iroot, &d);
+	count_reads(false);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+	CU_ASSERT_EQUAL (device_reads, 0);
+
+	count_writes(true, iroot->i_data, iroot->i_data + iroot->i_size);
+	dnew = dentry_create(mnt.droot, 0x3303, &attr);
+	count_writes(false, 0, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (dnew);
+	CU_ASSERT_NOT_EQUAL (range_written, 0);
+	CU_ASSERT_TRUE (range_written < iroot->i_size);
+	dput(dnew);
+
+	d.d_name = 0x3303;
+	err = iroot->i_do->lookup(iroot, &d);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_PTR_EQUAL (d.d_inode, dnew->d_inode);
+	iput(dentry_detach(&d));
+}
+
+PRIVATE void
+test_icache__write_back(void)
+{
+	Super *const s = mnt.super;
+	struct section_map smap, *m;
+	Inode *i;
+	u32   length;
+	err_t err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+	if (test_ino == 0) {
+		CU_FAIL_FATAL ("depend on test_inode_do_create");
+	}
+
+	i = iget(s, test_ino);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (i);
+	err = inode_pull(i);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+
+	m = inode_smap(i, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (m);
+
+	length = m->length;
+	m->length = length + 1;
+	inode_mark_dirty(i);
+	inode_smap_mark_dirty(i);
+
+	err = inode_push(i);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_FALSE (i->i_state & (I_DIRTY | I_SMAP_DIRTY));
+
+	mdev_read(i->i_mdev, i->i_smap_loc, sizeof(smap), DEST(&smap));
+	CU_ASSERT_EQUAL (smap.length, length + 1);
+
+	/* restore section map */
+	m->length = length;
+	inode_smap_mark_dirty(i);
+	iput(i);
+}
+
+/**
+ * Opening a file reads its header only. Section map entries are read on first
+ * use, a window at once.
+ */
+PRIVATE void
+test_inode_smap__window(void)
+{
+	Attr   attr = TEST_FILE_ATTR;
+	Dentry *d;
+	Inode  *i;
+	struct section_map *m;
+	laddr_t addr;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	attr.sections = FS_SMAP_WINDOW + 2;
+	d = dentry_create(mnt.droot, 0x3304, &attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (d);
+	i = d->d_inode;
+
+	CU_ASSERT_FALSE (i->i_state & I_NEW);
+	CU_ASSERT_EQUAL (i->i_smap_count, 0);
+
+	count_reads(true);
+	m = inode_smap(i, FS_SMAP_WINDOW + 1);
+	CU_ASSERT_EQUAL (device_reads, 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (m);
+	CU_ASSERT_EQUAL (i->i_smap_first, FS_SMAP_WINDOW);
+	CU_ASSERT_EQUAL (i->i_smap_count, 2);
+	addr = m->addr;
+
+	m->length = 3;
+	inode_smap_mark_dirty(i);
+
+	/* the same window is not read again */
+	CU_ASSERT_PTR_EQUAL (inode_smap(i, FS_SMAP_WINDOW), m - 1);
+	CU_ASSERT_EQUAL (device_reads, 1);
+	count_reads(false);
+
+	CU_ASSERT_PTR_NULL (inode_smap(i, FS_SMAP_WINDOW + 2));
+
+	/* leaving a window writes back its changes */
+	m = inode_smap(i, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (m);
+	CU_ASSERT_EQUAL (i->i_smap_count, FS_SMAP_WINDOW);
+	CU_ASSERT_FALSE (i->i_state & I_SMAP_DIRTY);
+	CU_ASSERT_EQUAL (m->addr + (FS_SMAP_WINDOW + 1) * attr.sec_size, addr);
+
+	m = inode_smap(i, FS_SMAP_WINDOW + 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (m);
+	CU_ASSERT_EQUAL (m->length, 3);
+
+	dput(d);
+}
+
 PRIVATE void
 test_super_do_write_and_read_inode(void)
 {
@@ -451,10 +859,46 @@ test_super_do_write_and_read_inode(void)
 }
 
 
+/**
+ * An evicted inode gives back its header and data, the next file of the same
+ * size takes them again.
+ */
 PRIVATE void
 test_super_do_delete_inode(void)
 {
-	CU_FAIL ( "Not implemented");
+	static Dentry d = {0};
+	Inode  *const iroot = mnt.droot->d_inode;
+	const struct super_does *super_do = iroot->i_super->s_do;
+	Attr   attr = TEST_FILE_ATTR;
+	Inode  *i;
+	u32    ino;
+	laddr_t data;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (super_do->evict_inode);
+
+	d.d_name = 0x3311;
+	err = iroot->i_do->create(iroot, &d, &attr);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	ino  = d.d_inode->i_ino;
+	data = d.d_inode->i_data;
+
+	err = iroot->i_do->unlink(iroot, &d);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+
+	i = dentry_detach(&d);
+	CU_ASSERT_EQUAL (super_do->evict_inode(i), E_GOOD);
+	destroy_inode(i);
+
+	d.d_name = 0x3312;
+	err = iroot->i_do->create(iroot, &d, &attr);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	CU_ASSERT_EQUAL (d.d_inode->i_ino, ino);
+	CU_ASSERT_EQUAL (d.d_inode->i_data, data);
+
+	CU_ASSERT_EQUAL (iroot->i_do->unlink(iroot, &d), E_GOOD);
+	iput(dentry_detach(&d));
 }
 
 PRIVATE void
@@ -472,13 +916,88 @@ test_inode_do_write(void)
 PRIVATE void
 test_inode_do_unlink()
 {
-	CU_FAIL ( "Not implemented" );
+	static Dentry d = {0};
+	static Dentry dl = {0};
+	Inode  *const iroot = mnt.droot->d_inode;
+	Attr   attr = TEST_FILE_ATTR;
+	Inode  *i;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (iroot->i_do->unlink);
+
+	d.d_name = 0x3310;
+	err = iroot->i_do->create(iroot, &d, &attr);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	i = d.d_inode;
+
+	CU_ASSERT_TRUE (iroot->i_do->unlink(iroot, NULL));
+	CU_ASSERT_TRUE (iroot->i_do->unlink(NULL, &d));
+
+	err = iroot->i_do->unlink(iroot, &d);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_EQUAL (i->i_nlink, 0);
+
+	/* the DF does not know it any more */
+	err = iroot->i_do->unlink(iroot, &d);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+
+	dl.d_name = 0x3310;
+	err = iroot->i_do->lookup(iroot, &dl);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+	CU_ASSERT_PTR_NULL (dl.d_inode);
+
+	/* the last reference evicts it */
+	iput(dentry_detach(&d));
 }
 
+/**
+ * Only empty DFs are removed. Since somefs does not implement mkdir, the DF
+ * is created as a file holding a single, empty SomeDF.
+ */
 PRIVATE void
 test_inode_do_rmdir()
 {
-	CU_FAIL ( "Not implemented" );
+	static Dentry d = {0};
+	static Dentry dc = {0};
+	Inode  *const iroot = mnt.droot->d_inode;
+	Attr   dfattr = { .iso7816.fdb = DF, .sections = 1, .sec_size = sizeof(SomeDF) };
+	Attr   attr = TEST_FILE_ATTR;
+	SomeDF empty;
+	Inode  *idf;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (iroot->i_do->rmdir);
+
+	d.d_name = 0x3320;
+	err = iroot->i_do->create(iroot, &d, &dfattr);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	idf = d.d_inode;
+
+	some_df_clean(&empty);
+	err = idf->i_mdev->write(idf->i_data, sizeof(empty), SRC(&empty));
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+
+	dc.d_name = 0x3321;
+	err = idf->i_do->create(idf, &dc, &attr);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+
+	err = iroot->i_do->rmdir(iroot, &d);
+	CU_ASSERT_EQUAL (err, E_FS_BUSY);
+
+	CU_ASSERT_EQUAL (idf->i_do->unlink(idf, &dc), E_GOOD);
+	iput(dentry_detach(&dc));
+
+	err = iroot->i_do->rmdir(iroot, &d);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_EQUAL (idf->i_nlink, 0);
+
+	dc.d_name = 0x3320;
+	err = iroot->i_do->lookup(iroot, &dc);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+
+	iput(dentry_detach(&d));
 }
 
 PRIVATE void __deprecated
@@ -598,3 +1117,572 @@ test_file_do_read(void)
 	}
 }
 
+/*
+ * A second device, that is kept apart from the stub device of the root.
+ */
+PRIVATE u8  volatile_storage[4096];
+PRIVATE u32 volatile_reads;
+PRIVATE u32 volatile_sb_writes;
+/* fail any write but those of the superblock */
+PRIVATE bool volatile_broken;
+
+PRIVATE err_t
+volatile_read(u32 offset, size_t bytes, buff_t dest)
+{
+	if (offset + bytes > sizeof(volatile_storage))
+		return E_BAD_PARAM | E_ADDRESS;
+
+	volatile_reads++;
+	memcpy(dest, volatile_storage + offset, bytes);
+	return E_GOOD;
+}
+
+PRIVATE err_t
+volatile_write(u32 offset, size_t bytes, buff_t src)
+{
+	if (offset + bytes > sizeof(volatile_storage))
+		return E_BAD_PARAM | E_ADDRESS;
+
+	if (offset == 0)
+		volatile_sb_writes++;
+	else if (volatile_broken)
+		return E_HWW;
+
+	if (src)
+		memcpy(volatile_storage + offset, src, bytes);
+	else
+		memset(volatile_storage + offset, 0x00, bytes);
+	return E_GOOD;
+}
+
+PRIVATE MemDev vdev = {
+	.size  = sizeof(volatile_storage),
+	.read  = volatile_read,
+	.write = volatile_write
+};
+
+PRIVATE void
+test_mount(void)
+{
+	fid_t  mpath[] = { MF, 0x7F10, EOP };
+	fid_t  fpath[] = { MF, 0x7F10, 0x3305, EOP };
+	Attr   attr = TEST_FILE_ATTR;
+	Dentry *d, *dnew, *d2;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+	CU_ASSERT_EQUAL_FATAL (somefs_mkfs(&vdev), E_GOOD);
+
+	err = smartfs_mount(mpath, &vdev, "nofs");
+	CU_ASSERT_EQUAL (err, E_NOENT);
+
+	err = smartfs_mount(mpath, &vdev, "somefs");
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+
+	err = smartfs_mount(mpath, &vdev, "somefs");
+	CU_ASSERT_EQUAL (err, E_EXIST);
+
+	err = smartfs_path_lookup(mpath, &d);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	CU_ASSERT_PTR_NOT_EQUAL (d->d_sb, mnt.super);
+	CU_ASSERT_PTR_EQUAL (d->d_sb->s_mdev, &vdev);
+	CU_ASSERT_PTR_EQUAL (d->d_sb->s_type, &somefs_fs_type);
+	CU_ASSERT_PTR_EQUAL (d->d_inode->i_super, d->d_sb);
+
+	/* files of the mounted file system do not touch the root device */
+	count_writes(true, 0, mnt.super->s_mdev->size);
+	dnew = dentry_create(d, 0x3305, &attr);
+	count_writes(false, 0, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (dnew);
+	CU_ASSERT_EQUAL (range_written, 0);
+	CU_ASSERT_PTR_EQUAL (dnew->d_inode->i_mdev, &vdev);
+
+	err = smartfs_path_lookup(fpath, &d2);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_PTR_EQUAL (d2, dnew);
+
+	dput(d2);
+	dput(dnew);
+	dput(d);
+}
+
+/**
+ * Mount the device of test_mount once more, as after a reboot.
+ */
+PRIVATE Dentry *
+remount_volatile(Super *s)
+{
+	static Dentry droot;
+	Mount m = { .droot = &droot, .super = s };
+
+	memset(&droot, 0x00, sizeof(droot));
+
+	if (somefs_mount(&vdev, &m))
+		return NULL;
+
+	return &droot;
+}
+
+/**
+ * Give back what remount_volatile() took: the root, the cached inodes and
+ * the file system context.
+ */
+PRIVATE void
+unmount_volatile(Dentry *droot)
+{
+	Super *s = droot->d_sb;
+
+	iput(dentry_detach(droot));
+	icache_forget(s);
+	somefs_super_do_put(s);
+}
+
+PRIVATE void
+test_snapshot(void)
+{
+	static Super s1, s2;
+	static Dentry d;
+	fid_t  mpath[] = { MF, 0x7F10, EOP };
+	Attr   attr = TEST_FILE_ATTR;
+	Dentry *dm, *dnew, *droot;
+	Inode  *i;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(mpath, &dm);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	CU_ASSERT_EQUAL_FATAL (somefs_snapshot(dm->d_sb), E_GOOD);
+
+	/* superblock and snapshot are all to read */
+	volatile_reads = 0;
+	droot = remount_volatile(&s1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (droot);
+	CU_ASSERT_EQUAL (volatile_reads, 2);
+
+	i = droot->d_inode;
+	volatile_reads = 0;
+	d.d_name = 0x3305;
+	err = i->i_do->lookup(i, &d);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_EQUAL (volatile_reads, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (d.d_inode);
+	CU_ASSERT_EQUAL (d.d_inode->i_sections, attr.sections);
+	CU_ASSERT_EQUAL (d.d_inode->i_size, attr.sec_size);
+	iput(dentry_detach(&d));
+
+	d.d_name = 0x3306;
+	err = i->i_do->lookup(i, &d);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+	CU_ASSERT_EQUAL (volatile_reads, 0);
+	unmount_volatile(droot);
+
+	/* new files are added to the snapshot */
+	dnew = dentry_create(dm, 0x3306, &attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (dnew);
+
+	droot = remount_volatile(&s2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (droot);
+
+	i = droot->d_inode;
+	volatile_reads = 0;
+	err = i->i_do->lookup(i, &d);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_EQUAL (volatile_reads, 0);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (d.d_inode);
+	CU_ASSERT_EQUAL (d.d_inode->i_data, dnew->d_inode->i_data);
+	iput(dentry_detach(&d));
+	unmount_volatile(droot);
+
+	dput(dnew);
+	dput(dm);
+}
+
+PRIVATE void
+test_snapshot_commit(void)
+{
+	static Super s1, s2;
+	static Dentry d;
+	fid_t  mpath[] = { MF, 0x7F10, EOP };
+	Attr   attr = TEST_FILE_ATTR;
+	Dentry *dm, *dnew, *droot;
+	SomeSuper *ss;
+	u8     *magic;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(mpath, &dm);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	ss = dm->d_sb->s_ctx;
+	CU_ASSERT_PTR_NOT_NULL_FATAL (ss->snap);
+
+	CU_ASSERT_EQUAL (smartfs_sync(), E_GOOD);
+	magic = volatile_storage + ss->sb.snapshot;
+	CU_ASSERT_EQUAL (*magic, SOMEFS_SNAP_MAGIC);
+
+	/* the snapshot on the device is invalid before the tree changes */
+	dnew = dentry_create(dm, 0x330C, &attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (dnew);
+	CU_ASSERT_EQUAL (*magic, 0);
+	CU_ASSERT_PTR_NOT_NULL (some_snap_lookup(ss, dm->d_inode->i_ino, 0x330C));
+
+	/* a snapshot lagging behind the tree is built again after an unclean
+	 * session */
+	*magic = SOMEFS_SNAP_MAGIC;
+	droot = remount_volatile(&s1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (droot);
+	CU_ASSERT_PTR_NOT_NULL (((SomeSuper *) s1.s_ctx)->snap);
+	d.d_name = 0x330C;
+	err = droot->d_inode->i_do->lookup(droot->d_inode, &d);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	iput(dentry_detach(&d));
+	unmount_volatile(droot);
+
+	/* the commit writes it back */
+	*magic = 0;
+	CU_ASSERT_EQUAL (smartfs_sync(), E_GOOD);
+	CU_ASSERT_EQUAL (*magic, SOMEFS_SNAP_MAGIC);
+
+	droot = remount_volatile(&s2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (droot);
+	volatile_reads = 0;
+	err = droot->d_inode->i_do->lookup(droot->d_inode, &d);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_EQUAL (volatile_reads, 0);
+	iput(dentry_detach(&d));
+	unmount_volatile(droot);
+
+	dput(dnew);
+	dput(dm);
+}
+
+PRIVATE void
+test_sb_commit(void)
+{
+	static Super s1, s2;
+	fid_t  mpath[] = { MF, 0x7F10, EOP };
+	Attr   attr = TEST_FILE_ATTR;
+	Dentry *dm, *d1, *d2, *droot;
+	SomeSuper *ss, *recovered;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(mpath, &dm);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	ss = dm->d_sb->s_ctx;
+
+	CU_ASSERT_EQUAL (smartfs_sync(), E_GOOD);
+	CU_ASSERT_FALSE (ss->sb.flags & SOMEFS_SB_OPEN);
+
+	/* only the first allocation after a commit writes the superblock */
+	volatile_sb_writes = 0;
+	d1 = dentry_create(dm, 0x3307, &attr);
+	d2 = dentry_create(dm, 0x3308, &attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (d1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (d2);
+	CU_ASSERT_EQUAL (volatile_sb_writes, 1);
+	CU_ASSERT_TRUE (ss->sb.flags & SOMEFS_SB_OPEN);
+
+	/* without a commit, mounting finds the allocations again */
+	droot = remount_volatile(&s1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (droot);
+	recovered = s1.s_ctx;
+	CU_ASSERT_EQUAL (recovered->sb.next_free_addr, ss->sb.next_free_addr);
+	CU_ASSERT_FALSE (recovered->sb.flags & SOMEFS_SB_OPEN);
+	unmount_volatile(droot);
+
+	volatile_sb_writes = 0;
+	CU_ASSERT_EQUAL (smartfs_sync(), E_GOOD);
+	CU_ASSERT_EQUAL (volatile_sb_writes, 1);
+	CU_ASSERT_FALSE (ss->sb.flags & SOMEFS_SB_OPEN);
+
+	/* a clean superblock is not written on mount */
+	volatile_sb_writes = 0;
+	droot = remount_volatile(&s2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (droot);
+	recovered = s2.s_ctx;
+	CU_ASSERT_EQUAL (volatile_sb_writes, 0);
+	CU_ASSERT_EQUAL (recovered->sb.next_free_addr, ss->sb.next_free_addr);
+	unmount_volatile(droot);
+
+	dput(d2);
+	dput(d1);
+	dput(dm);
+}
+
+PRIVATE void
+test_remove(void)
+{
+	static Super s;
+	static Dentry dl;
+	fid_t  mpath[] = { MF, 0x7F10, EOP };
+	fid_t  fpath[] = { MF, 0x7F10, 0x3309, EOP };
+	Attr   attr = TEST_FILE_ATTR;
+	Dentry *dm, *d, *d2, *droot;
+	u32    ino;
+	u16    gen;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(mpath, &dm);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+
+	d = dentry_create(dm, 0x3309, &attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (d);
+	ino = d->d_inode->i_ino;
+	gen = dm->d_gen;
+
+	/* neither the root of a mount nor a dentry in use elsewhere */
+	CU_ASSERT_EQUAL (dentry_unlink(dm), E_BUSY);
+
+	err = smartfs_path_lookup(fpath, &d2);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	CU_ASSERT_EQUAL (dentry_unlink(d), E_BUSY);
+	dput(d2);
+
+	CU_ASSERT_EQUAL (dentry_unlink(d), E_GOOD);
+	CU_ASSERT_PTR_NULL (d->d_inode);
+	CU_ASSERT_NOT_EQUAL (dm->d_gen, gen);
+	dput(d);
+
+	err = smartfs_path_lookup(fpath, &d2);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+
+	/* the DF and the snapshot on the device forgot it */
+	droot = remount_volatile(&s);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (droot);
+	dl.d_name = 0x3309;
+	err = droot->d_inode->i_do->lookup(droot->d_inode, &dl);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+	unmount_volatile(droot);
+
+	/* the next file takes its space */
+	d = dentry_create(dm, 0x330A, &attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (d);
+	CU_ASSERT_EQUAL (d->d_inode->i_ino, ino);
+
+	dput(d);
+	dput(dm);
+}
+
+/** @return whether a block of the device is not allocated */
+PRIVATE bool
+is_free_space(const SomeSB *sb, laddr_t addr)
+{
+	u8 i;
+
+	if (addr >= sb->next_free_addr) return true;
+
+	for (i = 0; i < SOMEFS_FREE_EXTENTS && sb->free[i].bytes; i++) {
+		if (addr >= sb->free[i].addr
+		&&  addr <  sb->free[i].addr + sb->free[i].bytes)
+			return true;
+	}
+
+	return false;
+}
+
+/** @return number of bytes left to be allocated */
+PRIVATE u32
+free_bytes(const SomeSB *sb)
+{
+	u32 bytes = sb->total_bytes - sb->next_free_addr;
+	u8  i;
+
+	for (i = 0; i < SOMEFS_FREE_EXTENTS && sb->free[i].bytes; i++)
+		bytes += sb->free[i].bytes;
+
+	return bytes;
+}
+
+PRIVATE void
+test_create_failure(void)
+{
+	fid_t  mpath[] = { MF, 0x7F10, EOP };
+	Attr   attr = TEST_FILE_ATTR;
+	Dentry *dm, *d;
+	SomeSuper *ss;
+	u32    bytes;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(mpath, &dm);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	ss = dm->d_sb->s_ctx;
+	bytes = free_bytes(&ss->sb);
+
+	/* header and body are allocated, but the file is not written */
+	volatile_broken = true;
+	d = dentry_create(dm, 0x330E, &attr);
+	volatile_broken = false;
+	CU_ASSERT_PTR_NULL (d);
+	CU_ASSERT_EQUAL (free_bytes(&ss->sb), bytes);
+
+	d = dentry_lookup(dm, 0x330E);
+	CU_ASSERT_PTR_NULL (d);
+
+	dput(dm);
+}
+
+PRIVATE void
+test_dir_blocks(void)
+{
+	static Super s;
+	static Dentry dl;
+	fid_t  mpath[] = { MF, 0x7F10, EOP };
+	Attr   attr = TEST_FILE_ATTR;
+	Dentry *dm, *d, *droot;
+	SomeSuper *ss, *recovered;
+	SomeDF df;
+	laddr_t link;
+	fid_t  fid;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(mpath, &dm);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	ss = dm->d_sb->s_ctx;
+
+	/* earlier remounts have committed the superblock behind our back */
+	CU_ASSERT_EQUAL (smartfs_sync(), E_GOOD);
+
+	for (fid = 0x4000; fid < 0x4000 + 2 * SOMEFS_MAX_DIR_ENTRIES; fid++) {
+		d = dentry_create(dm, fid, &attr);
+		CU_ASSERT_PTR_NOT_NULL_FATAL (d);
+		dput(d);
+	}
+
+	err = some_df_read(dm->d_sb->s_mdev, dm->d_inode->i_data, &df);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	CU_ASSERT_EQUAL_FATAL (df.child[SOMEFS_MAX_DIR_ENTRIES - 1].fid,
+	                       SOMEFS_DF_LINK);
+	link = df.child[SOMEFS_MAX_DIR_ENTRIES - 1].addr;
+
+	/* the chained blocks are read and recovered on mount */
+	droot = remount_volatile(&s);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (droot);
+	recovered = s.s_ctx;
+	CU_ASSERT_EQUAL (recovered->sb.next_free_addr, ss->sb.next_free_addr);
+
+	for (fid = 0x4000; fid < 0x4000 + 2 * SOMEFS_MAX_DIR_ENTRIES; fid++) {
+		dl.d_name = fid;
+		err = droot->d_inode->i_do->lookup(droot->d_inode, &dl);
+		CU_ASSERT_EQUAL (err, E_GOOD);
+		iput(dentry_detach(&dl));
+	}
+	unmount_volatile(droot);
+
+	for (fid = 0x4000; fid < 0x4000 + 2 * SOMEFS_MAX_DIR_ENTRIES; fid++) {
+		d = dentry_lookup(dm, fid);
+		CU_ASSERT_PTR_NOT_NULL_FATAL (d);
+		CU_ASSERT_EQUAL (dentry_unlink(d), E_GOOD);
+		dput(d);
+	}
+
+	d = dentry_lookup(dm, 0x4000 + SOMEFS_MAX_DIR_ENTRIES);
+	CU_ASSERT_PTR_NULL (d);
+
+	/* the empty chained block is unlinked and given back */
+	err = some_df_read(dm->d_sb->s_mdev, dm->d_inode->i_data, &df);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	CU_ASSERT_NOT_EQUAL (df.child[SOMEFS_MAX_DIR_ENTRIES - 1].fid,
+	                     SOMEFS_DF_LINK);
+	CU_ASSERT_TRUE (is_free_space(&ss->sb, link));
+
+	dput(dm);
+}
+
+PRIVATE void
+test_umount(void)
+{
+	fid_t  root[]  = { MF, EOP };
+	fid_t  mpath[] = { MF, 0x7F10, EOP };
+	fid_t  fpath[] = { MF, 0x7F10, 0x3305, EOP };
+	fid_t  npath[] = { MF, 0x7F10, 0x330B, EOP };
+	Attr   attr = TEST_FILE_ATTR;
+	Dentry *dm, *d;
+	SomeSB sb;
+	err_t  err;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	err = smartfs_path_lookup(mpath, &dm);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	d = dentry_create(dm, 0x330B, &attr);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (d);
+	dput(d);
+
+	/* neither while the file system is in use nor for the root mount */
+	CU_ASSERT_EQUAL (smartfs_umount(mpath), E_BUSY);
+	CU_ASSERT_EQUAL (smartfs_umount(root), E_BAD_PARAM);
+	dput(dm);
+
+	err = smartfs_path_lookup(npath, &d);
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+	CU_ASSERT_EQUAL (smartfs_umount(mpath), E_BUSY);
+	dput(d);
+
+	CU_ASSERT_EQUAL (smartfs_umount(mpath), E_GOOD);
+
+	/* the name is gone with the mount, the superblock is committed */
+	err = smartfs_path_lookup(mpath, &dm);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+	err = smartfs_path_lookup(fpath, &d);
+	CU_ASSERT_EQUAL (err, E_NOENT);
+
+	CU_ASSERT_EQUAL_FATAL (some_sb_read(&vdev, &sb), E_GOOD);
+	CU_ASSERT_FALSE (sb.flags & SOMEFS_SB_OPEN);
+
+	/* and mounted again, the files are there */
+	err = smartfs_mount(mpath, &vdev, "somefs");
+	CU_ASSERT_EQUAL_FATAL (err, E_GOOD);
+
+	err = smartfs_path_lookup(npath, &d);
+	CU_ASSERT_EQUAL (err, E_GOOD);
+	if (!err) dput(d);
+}
+
+PRIVATE u8 destroyed_inodes;
+
+PRIVATE void
+counting_destroy_inode(Inode *i)
+{
+	destroyed_inodes++;
+	ipool_put(i);
+}
+
+/**
+ * Cached inodes are handed to their file system, when the file system tree is
+ * reset. The suite runs on a fresh file system afterwards.
+ */
+PRIVATE void
+test_icache__reset(void)
+{
+	static const struct super_does counting_does = {
+		.destroy_inode = counting_destroy_inode
+	};
+	static Super s = { .s_do = &counting_does };
+	Inode *i;
+
+	CU_ASSERT_TRUE_FATAL (is_initialized);
+
+	/* one inode in use, one unused but cached */
+	i = iget(&s, 0x11);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (i);
+	i = iget(&s, 0x12);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (i);
+	i->i_state &= ~I_NEW;
+	iput(i);
+
+	destroyed_inodes = 0;
+	CU_ASSERT_EQUAL (stub_fs_free(), E_GOOD);
+	CU_ASSERT_EQUAL (destroyed_inodes, 2);
+	CU_ASSERT_PTR_NULL (inode_find(&s, 0x11));
+
+	CU_ASSERT_EQUAL_FATAL (stub_fs_init(), E_GOOD);
+}
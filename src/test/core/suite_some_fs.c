@@ -54,6 +54,7 @@ PRIVATE void test_df_handle_childs(void);
 PRIVATE void test_df_write_and_read(void);
 PRIVATE void test_fh_write_and_read(void);
 PRIVATE void test_mkfs(void);
+PRIVATE void test_alloc_free(void);
 
 PRIVATE MemDev mdev;
 
@@ -68,6 +69,7 @@ static const struct test_case tc_arr[] = {
 	TEST_CASE( test_fh_clean, "clean SomeFH"),
 	TEST_CASE( test_fh_write_and_read, "write/read SomeFH to/from memory device" ),
 	TEST_CASE( test_mkfs, "mkfs on memory device" ),
+	TEST_CASE( test_alloc_free, "allocate and free memory of objects" ),
 };
 
 int build_suite__somefs()
@@ -354,3 +356,48 @@ test_mkfs(void)
 	CU_ASSERT_EQUAL( err, E_GOOD );
 	sub_test_df_no_entries( &df );
 }
+
+PRIVATE void
+test_alloc_free(void)
+{
+	SomeSB  sb, committed;
+	laddr_t a, b, c, d, top;
+
+	CU_ASSERT_EQUAL_FATAL( some_sb_read(&mdev, &sb), E_GOOD );
+	top = sb.next_free_addr;
+
+	a = somefs_alloc(&mdev, &sb, 48);
+	b = somefs_alloc(&mdev, &sb, 16);
+	c = somefs_alloc(&mdev, &sb, 32);
+	d = somefs_alloc(&mdev, &sb, 16);
+	CU_ASSERT_EQUAL( a, top );
+	CU_ASSERT_EQUAL( b, a + 48 );
+	CU_ASSERT_EQUAL( d, c + 32 );
+
+	/* the smallest hole, that fits, is taken */
+	CU_ASSERT_EQUAL( somefs_free(&mdev, &sb, a, 48), E_GOOD );
+	CU_ASSERT_EQUAL( somefs_free(&mdev, &sb, c, 32), E_GOOD );
+	CU_ASSERT_EQUAL( somefs_alloc(&mdev, &sb, 24), c );
+	CU_ASSERT_EQUAL( somefs_alloc(&mdev, &sb, 40), a );
+	CU_ASSERT_EQUAL( sb.next_free_addr, d + 16 );
+
+	/* neighbours are merged into a single extent */
+	CU_ASSERT_EQUAL( somefs_free(&mdev, &sb, a, 40), E_GOOD );
+	CU_ASSERT_EQUAL( somefs_free(&mdev, &sb, b, 16), E_GOOD );
+	CU_ASSERT_EQUAL( somefs_free(&mdev, &sb, c, 24), E_GOOD );
+	CU_ASSERT_EQUAL( sb.free[0].addr, a );
+	CU_ASSERT_EQUAL( sb.free[0].bytes, d - a );
+	CU_ASSERT_EQUAL( sb.free[1].bytes, 0 );
+
+	/* and given back with the last object */
+	CU_ASSERT_EQUAL( somefs_free(&mdev, &sb, d, 16), E_GOOD );
+	CU_ASSERT_EQUAL( sb.next_free_addr, top );
+	CU_ASSERT_EQUAL( sb.free[0].bytes, 0 );
+
+	CU_ASSERT_TRUE( somefs_free(&mdev, &sb, top, 16) );
+
+	CU_ASSERT_EQUAL( some_sb_commit(&mdev, &sb), E_GOOD );
+	CU_ASSERT_EQUAL_FATAL( some_sb_read(&mdev, &committed), E_GOOD );
+	CU_ASSERT_EQUAL( committed.next_free_addr, top );
+	CU_ASSERT_EQUAL( committed.flags, 0 );
+}
@@ -29,7 +29,10 @@
 #include <types.h>
 
 #include <common/list.h>
+#include <array.h>
+#include <io/stream.h>
 #include <tlv.h>
+#include <string.h>
 
 #include <common/test_macros.h>
 #include <common/test_utils.h>
@@ -43,6 +46,18 @@ static void test_invalid_tag_field(void);
 static void test_invalid_length_field(void);
 static void test_ber_nesting_simple(void);
 static void test_ber_nesting_complex(void);
+static void test_ber_nesting_depth(void);
+static void test_ber_truncated(void);
+static void test_schema_decode(void);
+static void test_schema_violations(void);
+static void test_ber_builder(void);
+static void test_ber_builder_errors(void);
+static void test_ber_write_stream(void);
+static void test_ber_stream_parser(void);
+static void test_ber_stream_parser_errors(void);
+static void test_ber_index(void);
+static void test_simple_tlv(void);
+static void test_compact_tlv(void);
 
 
 static const struct test_case tc_arr[] = {
@@ -51,7 +66,19 @@ static const struct test_case tc_arr[] = {
 	TEST_CASE( test_invalid_tag_field,    "catch invalid tag fields" ),
 	TEST_CASE( test_invalid_length_field, "catch invalid length fields" ),
 	TEST_CASE( test_ber_nesting_simple,   "one time tlv nesting" ),
-	TEST_CASE( test_ber_nesting_complex,  "complex nested tlv structure" )
+	TEST_CASE( test_ber_nesting_complex,  "complex nested tlv structure" ),
+	TEST_CASE( test_ber_nesting_depth,    "bounded nesting depth" ),
+	TEST_CASE( test_ber_truncated,        "catch truncated tlv data" ),
+	TEST_CASE( test_schema_decode,        "decode tlv data by schema" ),
+	TEST_CASE( test_schema_violations,    "catch schema violations" ),
+	TEST_CASE( test_ber_builder,          "encode tlv data with back-patching" ),
+	TEST_CASE( test_ber_builder_errors,   "catch tlv encoding errors" ),
+	TEST_CASE( test_ber_write_stream,     "encode tlv data into a stream" ),
+	TEST_CASE( test_ber_stream_parser,    "parse tlv data fed in chunks" ),
+	TEST_CASE( test_ber_stream_parser_errors, "catch errors in chunked tlv data" ),
+	TEST_CASE( test_ber_index,            "index tlv objects by tag path" ),
+	TEST_CASE( test_simple_tlv,           "encode and decode SIMPLE-TLV" ),
+	TEST_CASE( test_compact_tlv,          "encode and decode COMPACT-TLV" )
 };
 
 
@@ -431,3 +458,643 @@ test_ber_nesting_complex(void)
 	err = tlv_parse_ber(data, 21, __nesting_complex__visit, NULL);
 	CU_ASSERT_EQUAL( err, E_GOOD );
 }
+
+static enum Tlv_Parse_Cmd
+__step_into__visit(const struct tlv_parse_ctx *tlv, void *count)
+{
+	PARAM_UNUSED(tlv);
+
+	if (count) (*(u8 *) count)++;
+	return STEP_INTO;
+}
+
+static void
+test_ber_nesting_depth(void)
+{
+	err_t err;
+	u8    *data = _ubuff_1.u8;
+	u8    count = 0;
+	struct tlv_parse_scope stack[2];
+
+	/* three nested constructed objects, the innermost one empty */
+	data[0] = 0x61;
+	data[1] = 0x04;
+		data[2] = 0xA1;
+		data[3] = 0x02;
+			data[4] = 0xA2;
+			data[5] = 0x00;
+	data[6] = 0xC1;
+	data[7] = 0x00;
+
+	err = tlv_parse_ber(data, 8, __step_into__visit, &count);
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( count, 4 );
+
+	err = tlv_parse_ber_scoped(data, 8, __step_into__visit, NULL,
+	                           stack, LENGTH(stack));
+	CU_ASSERT_EQUAL( err, E_TLV_DEPTH );
+
+	err = tlv_parse_ber_scoped(data, 6, __step_into__visit, NULL,
+	                           stack, LENGTH(stack) - 1);
+	CU_ASSERT_EQUAL( err, E_TLV_DEPTH );
+
+	/* flat data does not need any scope */
+	err = tlv_parse_ber_scoped(data + 6, 2, __step_into__visit, NULL,
+	                           NULL, 0);
+	CU_ASSERT_EQUAL( err, E_GOOD );
+}
+
+static void
+test_ber_truncated(void)
+{
+	err_t err;
+	u8    *data = _ubuff_1.u8;
+
+	data[0] = 0x9F; /* tag field continues behind the end */
+	err = tlv_parse_ber(data, 1, __never_visit, NULL);
+	CU_ASSERT_EQUAL( err, E_TLV );
+
+	data[0] = 0x81;
+	data[1] = 0x82; /* length field continues behind the end */
+	data[2] = 0x01;
+	err = tlv_parse_ber(data, 3, __never_visit, NULL);
+	CU_ASSERT_EQUAL( err, E_TLV );
+
+	data[1] = 0x03; /* value exceeds the data */
+	err = tlv_parse_ber(data, 4, __never_visit, NULL);
+	CU_ASSERT_EQUAL( err, E_TLV_VAL );
+
+	data[0] = 0x61;
+	data[1] = 0x02;
+	data[2] = 0x81; /* child exceeds its parent object */
+	data[3] = 0x01;
+	data[4] = 0xD1;
+	err = tlv_parse_ber(data, 5, __step_into__visit, NULL);
+	CU_ASSERT_EQUAL( err, E_TLV_FIT );
+}
+
+struct schema_obj {
+	u8           a;
+	u16          b;
+	u32          c;
+	char         name[4];
+	struct array ref;
+	u8           sum;
+};
+
+PRIVATE err_t
+__schema_sum(const u8 *val, u32 length, void *dest)
+{
+	u8 *sum = dest;
+
+	for (*sum = 0; length; length--)
+		*sum += *val++;
+
+	return E_GOOD;
+}
+
+PRIVATE const struct tlv_field schema_fields[] = {
+	TLV_NESTED(0x00, 0x61, TLV_MANDATORY),
+	TLV_FIELD(0x61, 0x81, TLV_FIELD_U8,  struct schema_obj, a, 1, 1,
+	          TLV_MANDATORY),
+	TLV_FIELD(0x61, 0x82, TLV_FIELD_U16, struct schema_obj, b, 1, 2, 0),
+	TLV_NESTED(0x61, 0xA3, 0),
+	TLV_FIELD(0xA3, 0x84, TLV_FIELD_U32,   struct schema_obj, c,    0, 4, 0),
+	TLV_FIELD(0xA3, 0x85, TLV_FIELD_BYTES, struct schema_obj, name, 0, 4, 0),
+	TLV_FIELD(0x00, 0xC6, TLV_FIELD_ARRAY, struct schema_obj, ref,  0, 8, 0),
+	TLV_FIELD_FN(0x00, 0xC7, __schema_sum, struct schema_obj, sum,  0, 8, 0)
+};
+
+PRIVATE const struct tlv_schema schema = TLV_SCHEMA(schema_fields);
+
+static void
+test_schema_decode(void)
+{
+	err_t err;
+	struct schema_obj obj = {0};
+	const u8 data[] = {
+		0x61, 0x13,
+			0x81, 0x01, 0x11,
+			0x82, 0x01, 0x22,
+			0xA3, 0x0B,
+				0x84, 0x03, 0x01, 0x02, 0x03,
+				0x85, 0x04, 'n', 'a', 'm', 'e',
+		0xC6, 0x02, 0xD1, 0xD2,
+		0xC7, 0x03, 0x01, 0x02, 0x03
+	};
+
+	err = tlv_decode_schema(data, sizeof(data), &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( obj.a, 0x11 );
+	CU_ASSERT_EQUAL( obj.b, 0x22 );
+	CU_ASSERT_EQUAL( obj.c, 0x010203 );
+	CU_ASSERT_EQUAL_BUFFER( SRC(obj.name), SRC("name"), 4 );
+	CU_ASSERT_PTR_EQUAL( obj.ref.val, data + 23 );
+	CU_ASSERT_EQUAL( obj.ref.len, 2 );
+	CU_ASSERT_EQUAL( obj.sum, 6 );
+
+	/* the constructed object exceeds the data */
+	err = tlv_decode_schema(data, 5, &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_TLV_VAL );
+
+	/* optional fields may be omitted */
+	{
+		const u8 min[] = { 0x61, 0x03, 0x81, 0x01, 0x33 };
+
+		err = tlv_decode_schema(min, sizeof(min), &schema, &obj);
+		CU_ASSERT_EQUAL( err, E_GOOD );
+		CU_ASSERT_EQUAL( obj.a, 0x33 );
+	}
+}
+
+static void
+test_schema_violations(void)
+{
+	err_t err;
+	struct schema_obj obj = {0};
+	const u8 dup[]     = { 0x61, 0x06, 0x81, 0x01, 0x01, 0x81, 0x01, 0x02 };
+	const u8 missing[] = { 0x61, 0x03, 0x82, 0x01, 0x01 };
+	const u8 unknown[] = { 0x61, 0x03, 0x83, 0x01, 0x01 };
+	const u8 parent[]  = { 0x61, 0x03, 0x81, 0x01, 0x01, 0x84, 0x00 };
+	const u8 toolong[] = { 0x61, 0x04, 0x81, 0x02, 0x01, 0x02 };
+	const u8 overrun[] = { 0x61, 0x02, 0x81, 0x01, 0x01 };
+
+	err = tlv_decode_schema(dup, sizeof(dup), &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_TLV );
+
+	err = tlv_decode_schema(missing, sizeof(missing), &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_NOENT );
+
+	err = tlv_decode_schema(NULL, 0, &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_NOENT );
+
+	err = tlv_decode_schema(unknown, sizeof(unknown), &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_TLV_TAG );
+
+	err = tlv_decode_schema(parent, sizeof(parent), &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_TLV_TAG );
+
+	err = tlv_decode_schema(toolong, sizeof(toolong), &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_TLV_LEN );
+
+	err = tlv_decode_schema(overrun, sizeof(overrun), &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_TLV_FIT );
+}
+
+static void
+test_ber_builder(void)
+{
+	err_t err;
+	u8    buff[300];
+	u8    big[200];
+	struct schema_obj obj = {0};
+	struct tlv_builder b = TLV_BUILDER(buff);
+	const u8 expect[] = {
+		0x61, 0x0D,
+			0x81, 0x01, 0x11,
+			0x82, 0x02, 0x01, 0x22,
+			0xA3, 0x04,
+				0x85, 0x02, 'n', 'o',
+		0xC6, 0x00
+	};
+
+	tlv_begin(&b, 0x61);
+	tlv_put_uint(&b, 0x81, 0x11, 1);
+	tlv_put_uint(&b, 0x82, 0x0122, 2);
+	tlv_begin(&b, 0xA3);
+	tlv_put(&b, 0x85, (const u8 *) "no", 2);
+	tlv_end(&b);
+	tlv_end(&b);
+	err = tlv_put(&b, 0xC6, NULL, 0);
+
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( b.pos, sizeof(expect) );
+	CU_ASSERT_EQUAL_BUFFER( buff, SRC(expect), sizeof(expect) );
+
+	err = tlv_decode_schema(buff, b.pos, &schema, &obj);
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( obj.b, 0x0122 );
+	CU_ASSERT_EQUAL_BUFFER( SRC(obj.name), SRC("no"), 2 );
+
+	/* constructed object exceeding the short length form */
+	memset(big, 0xB1, sizeof(big));
+	tlv_builder_init(&b, buff, sizeof(buff));
+	tlv_begin(&b, 0x7F21);
+	tlv_put(&b, 0x9F1F, big, sizeof(big));
+	err = tlv_end(&b);
+
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( b.pos, tlv_size_ber(0x7F21, tlv_size_ber(0x9F1F, 200)) );
+	CU_ASSERT_EQUAL( buff[2], 0x81 );
+	CU_ASSERT_EQUAL( buff[3], 0xCC );
+	CU_ASSERT_EQUAL( buff[4], 0x9F );
+	CU_ASSERT_EQUAL( buff[6], 0x81 );
+	CU_ASSERT_EQUAL( buff[7], 200 );
+	CU_ASSERT_EQUAL_BUFFER( buff + 8, big, sizeof(big) );
+}
+
+static void
+test_ber_builder_errors(void)
+{
+	u8  buff[8];
+	u8  i;
+	struct tlv_builder b = TLV_BUILDER(buff);
+
+	CU_ASSERT_EQUAL( tlv_end(&b), E_TLV );
+	/* errors are sticky */
+	CU_ASSERT_EQUAL( tlv_begin(&b, 0x61), E_TLV );
+	CU_ASSERT_EQUAL( tlv_builder_flush(&b, NULL), 0 );
+
+	tlv_builder_init(&b, buff, sizeof(buff));
+	CU_ASSERT_EQUAL( tlv_put(&b, 0x81, buff, 7), E_NOMEM );
+	CU_ASSERT_EQUAL( tlv_put(&b, 0x81, buff, 0), E_NOMEM );
+
+	/* widening the length field must fit too */
+	{
+		u8 big[0x90];
+		u8 val[0x80];
+		struct tlv_builder bb = TLV_BUILDER(big);
+
+		memset(val, 0x5A, sizeof(val));
+
+		tlv_begin(&bb, 0x61);
+		tlv_put(&bb, 0x81, val, sizeof(val));
+		CU_ASSERT_EQUAL( bb.err, E_GOOD );
+		CU_ASSERT_EQUAL( tlv_end(&bb), E_GOOD );
+
+		tlv_builder_init(&bb, big, 0x80 + 5);
+		tlv_begin(&bb, 0x61);
+		tlv_put(&bb, 0x81, val, sizeof(val));
+		CU_ASSERT_EQUAL( tlv_end(&bb), E_NOMEM );
+	}
+
+	tlv_builder_init(&b, buff, sizeof(buff));
+	for (i = 0; i < TLV_MAX_NESTING; i++)
+		CU_ASSERT_EQUAL( tlv_begin(&b, 0x21), i < 4 ? E_GOOD : E_NOMEM );
+
+	CU_ASSERT_EQUAL( tlv_put_uint(&b, 0x81, 0, 5), E_NOMEM );
+}
+
+PRIVATE struct {
+	struct stream_out impl;
+	u8  data[32];
+	u32 len;
+} sink;
+
+PRIVATE u32
+sink_write(struct stream_out *os, u8 *data, u32 bytes)
+{
+	u32 cpy = MIN(bytes, sizeof(sink.data) - sink.len);
+
+	PARAM_UNUSED(os);
+
+	memcpy(sink.data + sink.len, data, cpy);
+	sink.len += cpy;
+
+	return cpy;
+}
+
+PRIVATE const struct stream_out_ops sink_ops = {
+	.write = sink_write
+};
+
+static void
+test_ber_write_stream(void)
+{
+	u32 n;
+	const u8 fid[]    = { 0x3F, 0x00 };
+	const u8 expect[] = { 0x62, 0x07, 0x83, 0x02, 0x3F, 0x00, 0x8A, 0x01,
+	                      0x05 };
+
+	sink.impl.ops = &sink_ops;
+	sink.len      = 0;
+
+	/* size pass over a fixed template */
+	n  = tlv_write_ber(&sink.impl, 0x62,
+	                   tlv_size_ber(0x83, 2) + tlv_size_ber(0x8A, 1), NULL);
+	n += tlv_write_ber(&sink.impl, 0x83, sizeof(fid), fid);
+	n += tlv_write_ber(&sink.impl, 0x8A, 1, (const u8 *) "\x05");
+
+	CU_ASSERT_EQUAL( n, sizeof(expect) );
+	CU_ASSERT_EQUAL( sink.len, sizeof(expect) );
+	CU_ASSERT_EQUAL_BUFFER( sink.data, SRC(expect), sizeof(expect) );
+
+	CU_ASSERT_EQUAL( tlv_size_ber(0x81, 0x7F),    0x7F + 2 );
+	CU_ASSERT_EQUAL( tlv_size_ber(0x81, 0x80),    0x80 + 3 );
+	CU_ASSERT_EQUAL( tlv_size_ber(0xDF1F, 0x100), 0x100 + 5 );
+}
+
+struct sp_record {
+	u8  count;
+	u32 tag[8];
+	u8  sum;
+	u8  sunk;
+};
+
+static enum Tlv_Parse_Cmd
+__sp_record__visit(const struct tlv_parse_ctx *tlv, void *opaque)
+{
+	struct sp_record *r = opaque;
+	u32 i;
+
+	if (r->count < LENGTH(r->tag))
+		r->tag[r->count++] = tlv->tag;
+
+	if (tlv->tag == 0xC3) {
+		r->sunk += (tlv->value == NULL);
+		return NEXT;
+	}
+
+	for (i = 0; tlv->value && i < tlv->length; i++)
+		r->sum += tlv->value[i];
+
+	return tlv->tag == 0xA4 ? NEXT : STEP_INTO;
+}
+
+static struct stream_out *
+__sp_sink(const struct tlv_parse_ctx *tlv, void *opaque)
+{
+	PARAM_UNUSED(tlv);
+	PARAM_UNUSED(opaque);
+
+	sink.impl.ops = &sink_ops;
+	sink.len      = 0;
+
+	return &sink.impl;
+}
+
+static void
+test_ber_stream_parser(void)
+{
+	err_t err;
+	u32   chunk;
+	u32   i;
+	u8    vbuf[4];
+	struct tlv_parse_scope   stack[2];
+	struct tlv_stream_parser p;
+	struct sp_record         r;
+	u8 data[] = {
+		0x61, 0x0C,
+			0x81, 0x03, 0x01, 0x02, 0x03,
+			0xA2, 0x05,
+				0x9F, 0x22, 0x02, 0x04, 0x05,
+		0xA4, 0x03, 0x81, 0x01, 0xFF,       /* skipped */
+		0xA5, 0x00,
+		0xC3, 0x14,
+			0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9,
+			0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF, 0xC0, 0xC1, 0xC2, 0xC3
+	};
+	const u32 tags[] = { 0x61, 0x81, 0xA2, 0x9F22, 0xA4, 0xA5, 0xC3 };
+
+	for (chunk = 1; chunk <= sizeof(data); chunk++) {
+		memset(&r, 0, sizeof(r));
+		sink.len = 0;
+
+		tlv_stream_parser_init(&p, __sp_record__visit, &r,
+		                       stack, LENGTH(stack),
+		                       vbuf, sizeof(vbuf), __sp_sink);
+
+		for (i = 0, err = E_GOOD; i < sizeof(data) && !err; i += chunk)
+			err = tlv_stream_parser_feed(&p, data + i,
+			                             MIN(chunk, sizeof(data) - i));
+
+		CU_ASSERT_EQUAL( err, E_GOOD );
+		CU_ASSERT_EQUAL( tlv_stream_parser_finish(&p), E_GOOD );
+		CU_ASSERT_EQUAL( r.count, LENGTH(tags) );
+		CU_ASSERT_EQUAL_BUFFER( SRC(r.tag), SRC(tags), sizeof(tags) );
+		CU_ASSERT_EQUAL( r.sum, 1 + 2 + 3 + 4 + 5 );
+		CU_ASSERT_EQUAL( r.sunk, 1 );
+		CU_ASSERT_EQUAL( sink.len, 0x14 );
+		CU_ASSERT_EQUAL_BUFFER( sink.data, data + 23, 0x14 );
+		CU_ASSERT_EQUAL( p.pos, sizeof(data) );
+	}
+}
+
+static void
+test_ber_stream_parser_errors(void)
+{
+	u8    vbuf[2];
+	struct tlv_parse_scope   stack[1];
+	struct tlv_stream_parser p;
+	struct sp_record         r;
+	const u8 nested[]  = { 0x61, 0x04, 0xA2, 0x02, 0x81, 0x00 };
+	const u8 large[]   = { 0x81, 0x03, 0x01, 0x02, 0x03 };
+	const u8 overrun[] = { 0x61, 0x02, 0x81, 0x01, 0x01 };
+
+	memset(&r, 0, sizeof(r));
+
+	/* truncated header and value */
+	tlv_stream_parser_init(&p, __sp_record__visit, &r, stack, 1,
+	                       vbuf, sizeof(vbuf), NULL);
+	CU_ASSERT_EQUAL( tlv_stream_parser_feed(&p, large, 1), E_GOOD );
+	CU_ASSERT_EQUAL( tlv_stream_parser_finish(&p), E_TLV );
+
+	tlv_stream_parser_init(&p, __sp_record__visit, &r, stack, 1,
+	                       vbuf, sizeof(vbuf), NULL);
+	CU_ASSERT_EQUAL( tlv_stream_parser_feed(&p, nested, 2), E_GOOD );
+	CU_ASSERT_EQUAL( tlv_stream_parser_finish(&p), E_TLV );
+
+	/* nesting deeper than the scope stack */
+	tlv_stream_parser_init(&p, __sp_record__visit, &r, stack, 1,
+	                       vbuf, sizeof(vbuf), NULL);
+	CU_ASSERT_EQUAL( tlv_stream_parser_feed(&p, nested, sizeof(nested)),
+	                 E_TLV_DEPTH );
+	/* errors are sticky */
+	CU_ASSERT_EQUAL( tlv_stream_parser_feed(&p, large, 2), E_TLV_DEPTH );
+
+	/* split value exceeds the reassembly buffer and no sink is given */
+	tlv_stream_parser_init(&p, __sp_record__visit, &r, stack, 1,
+	                       vbuf, sizeof(vbuf), NULL);
+	CU_ASSERT_EQUAL( tlv_stream_parser_feed(&p, large, 3), E_NOMEM );
+
+	/* ... but a value in one chunk needs no buffer */
+	tlv_stream_parser_init(&p, __sp_record__visit, &r, stack, 1,
+	                       NULL, 0, NULL);
+	CU_ASSERT_EQUAL( tlv_stream_parser_feed(&p, large, sizeof(large)), E_GOOD );
+	CU_ASSERT_EQUAL( tlv_stream_parser_finish(&p), E_GOOD );
+
+	tlv_stream_parser_init(&p, __sp_record__visit, &r, stack, 1,
+	                       vbuf, sizeof(vbuf), NULL);
+	CU_ASSERT_EQUAL( tlv_stream_parser_feed(&p, overrun, sizeof(overrun)),
+	                 E_TLV_FIT );
+}
+
+PRIVATE u32 index_reads;
+
+PRIVATE u32
+__index_read(void *src, u32 offset, u8 *buff, u32 n)
+{
+	index_reads++;
+	memcpy(buff, (const u8 *) src + offset, n);
+	return n;
+}
+
+static void
+test_ber_index(void)
+{
+	err_t err;
+	struct tlv_index_entry entry[6];
+	struct tlv_index       idx = { .entry = entry, .max = LENGTH(entry) };
+	const struct tlv_index_entry *e;
+	u8 data[] = {
+		0x00,                                     /* padding */
+		0x7F, 0x21, 0x0E,
+			0x7F, 0x4E, 0x06,
+				0x5F, 0x29, 0x01, 0x00,
+				0x42, 0x00,
+			0x5F, 0x37, 0x02, 0xE1, 0xE2,
+		0xFF, 0xFF,                               /* padding */
+		0x42, 0x01, 0xD1
+	};
+	const u32 p_car[]  = { 0x7F21, 0x7F4E, 0x42 };
+	const u32 p_sig[]  = { 0x7F21, 0x5F37 };
+	const u32 p_top[]  = { 0x42 };
+	const u32 p_none[] = { 0x7F21, 0x42 };
+
+	index_reads = 0;
+	err = tlv_index_build(&idx, __index_read, data, sizeof(data));
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( idx.count, 6 );
+	/* one read for each header and padding byte */
+	CU_ASSERT_EQUAL( index_reads, 6 + 3 );
+
+	e = tlv_index_find(&idx, p_car, LENGTH(p_car));
+	CU_ASSERT_PTR_NOT_NULL_FATAL( e );
+	CU_ASSERT_EQUAL( e->offset, 13 );
+	CU_ASSERT_EQUAL( e->length, 0 );
+
+	e = tlv_index_find(&idx, p_sig, LENGTH(p_sig));
+	CU_ASSERT_PTR_NOT_NULL_FATAL( e );
+	CU_ASSERT_EQUAL( e->offset, 16 );
+	CU_ASSERT_EQUAL( e->length, 2 );
+
+	e = tlv_index_find(&idx, p_top, LENGTH(p_top));
+	CU_ASSERT_PTR_NOT_NULL_FATAL( e );
+	CU_ASSERT_EQUAL( data[e->offset], 0xD1 );
+
+	CU_ASSERT_PTR_NULL( tlv_index_find(&idx, p_none, LENGTH(p_none)) );
+	CU_ASSERT_PTR_NULL( tlv_index_find(&idx, p_top, 0) );
+
+	/* too many objects */
+	idx.max = 5;
+	CU_ASSERT_EQUAL( tlv_index_build(&idx, __index_read, data, sizeof(data)),
+	                 E_NOMEM );
+	CU_ASSERT_EQUAL( idx.count, 0 );
+
+	/* object exceeds the data */
+	idx.max = LENGTH(entry);
+	CU_ASSERT_EQUAL( tlv_index_build(&idx, __index_read, data, 22),
+	                 E_TLV_VAL );
+}
+
+struct flat_record {
+	u8  count;
+	u32 tag[4];
+	u32 length[4];
+	u32 sum;
+};
+
+static enum Tlv_Parse_Cmd
+__flat_record__visit(const struct tlv_parse_ctx *tlv, void *opaque)
+{
+	struct flat_record *r = opaque;
+	u32 i;
+
+	CU_ASSERT_TRUE( list_empty(&tlv->nesting) );
+
+	if (r->count < LENGTH(r->tag)) {
+		r->tag[r->count]    = tlv->tag;
+		r->length[r->count] = tlv->length;
+		r->count++;
+	}
+
+	for (i = 0; i < tlv->length; i++)
+		r->sum += tlv->value[i];
+
+	return STEP_INTO;
+}
+
+static void
+test_simple_tlv(void)
+{
+	err_t err;
+	u8    buff[320];
+	u8    value[300];
+	struct tlv_builder b = TLV_BUILDER(buff);
+	struct flat_record r = {0};
+
+	memset(value, 0x01, sizeof(value));
+
+	tlv_put_simple(&b, 0x01, value, 3);
+	tlv_put_simple(&b, 0xFE, value, 300);
+	err = tlv_put_simple(&b, 0x80, NULL, 0);
+
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( b.pos, 2 + 3 + 4 + 300 + 2 );
+	CU_ASSERT_EQUAL( buff[5], 0xFE );
+	CU_ASSERT_EQUAL( buff[6], 0xFF );
+	CU_ASSERT_EQUAL( buff[7], 0x01 );
+	CU_ASSERT_EQUAL( buff[8], 0x2C );
+
+	err = tlv_parse_simple(buff, b.pos, __flat_record__visit, &r);
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( r.count, 3 );
+	CU_ASSERT_EQUAL( r.tag[1], 0xFE );
+	CU_ASSERT_EQUAL( r.length[1], 300 );
+	CU_ASSERT_EQUAL( r.tag[2], 0x80 );
+	CU_ASSERT_EQUAL( r.sum, 303 );
+
+	/* truncated or bad data */
+	CU_ASSERT_EQUAL( tlv_parse_simple(buff, 1, __never_visit, NULL), E_TLV );
+	CU_ASSERT_EQUAL( tlv_parse_simple(buff + 5, 3, __never_visit, NULL),
+	                 E_TLV );
+	CU_ASSERT_EQUAL( tlv_parse_simple(buff, 4, __never_visit, NULL),
+	                 E_TLV_VAL );
+	buff[0] = 0xFF;
+	CU_ASSERT_EQUAL( tlv_parse_simple(buff, 5, __never_visit, NULL),
+	                 E_TLV_TAG );
+
+	CU_ASSERT_EQUAL( tlv_put_simple(&b, 0x00, value, 1), E_TLV_TAG );
+}
+
+static void
+test_compact_tlv(void)
+{
+	err_t err;
+	u8    buff[8];
+	struct tlv_builder b = TLV_BUILDER(buff);
+	struct flat_record r = {0};
+	/* historical bytes: card service data and card capabilities */
+	const u8 caps[] = { 0x80, 0x01, 0xC0 };
+
+	tlv_put_compact(&b, 0x3, caps, 1);
+	err = tlv_put_compact(&b, 0x7, caps, 3);
+
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( b.pos, 6 );
+	CU_ASSERT_EQUAL( buff[0], 0x31 );
+	CU_ASSERT_EQUAL( buff[2], 0x73 );
+
+	err = tlv_parse_compact(buff, b.pos, __flat_record__visit, &r);
+	CU_ASSERT_EQUAL( err, E_GOOD );
+	CU_ASSERT_EQUAL( r.count, 2 );
+	CU_ASSERT_EQUAL( r.tag[0], 0x3 );
+	CU_ASSERT_EQUAL( r.tag[1], 0x7 );
+	CU_ASSERT_EQUAL( r.length[1], 3 );
+
+	CU_ASSERT_EQUAL( tlv_parse_compact(buff + 2, 3, __never_visit, NULL),
+	                 E_TLV_VAL );
+
+	CU_ASSERT_EQUAL( tlv_put_compact(&b, 0x10, caps, 1), E_TLV_TAG );
+	tlv_builder_init(&b, buff, sizeof(buff));
+	CU_ASSERT_EQUAL( tlv_put_compact(&b, 0x1, caps, 16), E_TLV_LEN );
+
+	sink.impl.ops = &sink_ops;
+	sink.len      = 0;
+	CU_ASSERT_EQUAL( tlv_write_compact(&sink.impl, 0x3, 1, caps), 2 );
+	CU_ASSERT_EQUAL( tlv_write_simple(&sink.impl, 0x01, 1, caps), 3 );
+	CU_ASSERT_EQUAL( tlv_write_simple(&sink.impl, 0xFF, 1, caps), 0 );
+	CU_ASSERT_EQUAL( sink.len, 5 );
+	CU_ASSERT_EQUAL( sink.data[0], 0x31 );
+	CU_ASSERT_EQUAL( sink.data[2], 0x01 );
+}
@@ -40,5 +40,8 @@ int build_suite__flexcos();
 int build_suite__flash_layout();
 int build_suite__flash_dev_simple();
 int build_suite__tlv_parser();
+int build_suite__stream();
+int build_suite__arena();
+int build_suite__pool();
 
 #endif /* ----- end of macro protection ----- */
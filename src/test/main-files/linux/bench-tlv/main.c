@@ -0,0 +1,187 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+/*
+ * Compare BER-TLV, SIMPLE-TLV and COMPACT-TLV encoding and decoding for
+ * object sizes typical to FlexCOS: FCP fields, short data objects, records
+ * and certificate parts.
+ *
+ * Usage: bench-tlv [rounds]
+ */
+
+#include <flxlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <common/list.h>
+#include <tlv.h>
+
+#define BENCH_BUFF     4096
+#define BENCH_ROUNDS   20000
+
+enum Encoding {
+	BER = 0,
+	SIMPLE,
+	COMPACT
+};
+
+PRIVATE const char *const enc_name[] = { "BER", "SIMPLE", "COMPACT" };
+
+/* value sizes of typical objects */
+PRIVATE const u16 obj_size[] = { 1, 2, 8, 15, 32, 128, 300 };
+
+PRIVATE u8 buff[BENCH_BUFF];
+PRIVATE u8 value[512];
+
+PRIVATE volatile u32 visited;
+
+PRIVATE enum Tlv_Parse_Cmd
+count__visit(const struct tlv_parse_ctx *tlv, void *opaque)
+{
+	PARAM_UNUSED(opaque);
+
+	visited += tlv->length;
+	return NEXT;
+}
+
+PRIVATE double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ *  Fill the buffer with as many objects of 'size' value bytes as possible.
+ *
+ *  @return number of objects, zero if the encoding does not support 'size'
+ */
+PRIVATE u32
+encode(enum Encoding enc, u16 size, struct tlv_builder *b)
+{
+	u32   n = 0;
+	err_t err;
+
+	tlv_builder_init(b, buff, sizeof(buff));
+
+	loop {
+		switch (enc) {
+		case BER:
+			err = tlv_put(b, 0x5F20, value, size);
+			break;
+		case SIMPLE:
+			err = tlv_put_simple(b, 0x01, value, size);
+			break;
+		default:
+			err = tlv_put_compact(b, 0x4, value, size);
+		}
+
+		if (err) break;
+		n++;
+	}
+
+	/* the failing put left a sticky error */
+	b->err = E_GOOD;
+
+	return n;
+}
+
+PRIVATE err_t
+decode(enum Encoding enc, u32 length)
+{
+	switch (enc) {
+	case BER:
+		return tlv_parse_ber(buff, length, count__visit, NULL);
+	case SIMPLE:
+		return tlv_parse_simple(buff, length, count__visit, NULL);
+	default:
+		return tlv_parse_compact(buff, length, count__visit, NULL);
+	}
+}
+
+PRIVATE void
+bench(enum Encoding enc, u16 size, u32 rounds)
+{
+	struct tlv_builder b;
+	double t_enc;
+	double t_dec;
+	double mb;
+	u32    objs;
+	u32    i;
+
+	objs = encode(enc, size, &b);
+	if (!objs) {
+		printf("%-8s %5u %8s\n", enc_name[enc], size, "n/a");
+		return;
+	}
+
+	t_enc = now();
+	for (i = 0; i < rounds; i++)
+		encode(enc, size, &b);
+	t_enc = now() - t_enc;
+
+	t_dec = now();
+	for (i = 0; i < rounds; i++) {
+		if (decode(enc, b.pos)) {
+			printf("%-8s %5u decoding failed\n", enc_name[enc], size);
+			return;
+		}
+	}
+	t_dec = now() - t_dec;
+
+	mb = (double) b.pos * rounds / (1024 * 1024);
+
+	printf("%-8s %5u %8.1f %10.1f %10.1f %12.0f\n",
+	       enc_name[enc], size,
+	       100.0 * (b.pos - objs * size) / b.pos,
+	       mb / t_enc, mb / t_dec,
+	       objs * rounds / t_dec);
+}
+
+int
+main(int argc, char **argv)
+{
+	u32 rounds = argc > 1 ? (u32) atoi(argv[1]) : BENCH_ROUNDS;
+	const u16 *size;
+	u8  enc;
+
+	memset(value, 0xA5, sizeof(value));
+
+	printf("%-8s %5s %8s %10s %10s %12s\n",
+	       "encoding", "size", "ovhd[%]", "enc[MB/s]", "dec[MB/s]",
+	       "dec[obj/s]");
+
+	for_each(size, obj_size, LENGTH(obj_size)) {
+		for (enc = BER; enc <= COMPACT; enc++)
+			bench(enc, *size, rounds);
+	}
+
+	return 0;
+}
@@ -0,0 +1,413 @@
+/*
+    FlexCOS - Copyright (C) 2013 AGSI, Department of Computer Science, FU-Berlin
+
+    FOR MORE INFORMATION AND INSTRUCTION PLEASE VISIT
+    http://www.inf.fu-berlin.de/groups/ag-si/smart.html
+
+
+    This file is part of the FlexCOS project.
+
+    FlexCOS is free software; you can redistribute it and/or modify it under
+    the terms of the GNU General Public License (version 3) as published by the
+    Free Software Foundation.
+
+    Some parts of this software are from different projects. These files carry
+    a different license in their header.
+
+    FlexCOS is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details. You should have received a copy of the GNU General Public License
+    along with FlexCOS; if not it can be viewed here:
+    http://www.gnu.org/licenses/gpl-3.0.txt and also obtained by writing to
+    AGSI, contact details for whom are available on the FlexCOS WEB site.
+
+*/
+
+/*
+ * Fuzzing and throughput harness for the input exposed parsers:
+ * tlv_parse_ber, tlv_stream_parser_feed, apdu_validate_cmd and
+ * apdu_get_cmd_handler.
+ *
+ * The first input byte selects the target, the remaining bytes are its
+ * input. Build it with the firmware sources of the linux target, e.g.
+ *
+ *   libFuzzer:  clang -DFUZZ_LIBFUZZER -fsanitize=fuzzer,address ...
+ *   AFL:        afl-gcc -fsanitize=address ...
+ *               afl-fuzz -i seeds -o findings -- ./fuzz-parsers @@
+ *
+ * Without libFuzzer the program understands:
+ *
+ *   fuzz-parsers [FILE...]   run each file (or stdin) once
+ *   fuzz-parsers -s DIR      write the seed corpus to DIR
+ *   fuzz-parsers -r N        run N random inputs
+ *   fuzz-parsers -b [N]      benchmark N rounds over the seed corpus
+ */
+
+#include <flxlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <common/list.h>
+#include <apdu.h>
+#include <tlv.h>
+
+#define FUZZ_MAX_INPUT   4096
+#define BENCH_ROUNDS     200000
+
+enum Fuzz_Target {
+	T_TLV_BER = 0x00,
+	T_TLV_STREAM,
+	T_APDU,
+	T_COUNT
+};
+
+struct seed {
+	u8       target;
+	u16      length;
+	const u8 *data;
+};
+
+#define SEED(t, arr) { .target = (t), .length = sizeof(arr), .data = (arr) }
+
+/*
+ * Seed vectors taken from suite_tlv_parser.c and suite_apdu.c.
+ */
+PRIVATE const u8 s_ber_prim[] = {
+	0x81, 0x02, 0xD1, 0xD2, 0x82, 0x81, 0x03, 0xE1, 0xE2, 0xE3 };
+PRIVATE const u8 s_ber_tags[] = {
+	0x9F, 0x1F, 0x00, 0x9F, 0x81, 0x0F, 0x00 };
+PRIVATE const u8 s_ber_nested[] = {
+	0x61, 0x10, 0x88, 0x01, 0xD8, 0xA1, 0x0B, 0xB1, 0x07, 0xDF, 0x1F,
+	0x01, 0xDD, 0xDF, 0x2F, 0x00, 0xC1, 0x00, 0xC2, 0x01, 0x00 };
+PRIVATE const u8 s_ber_fcp[] = {
+	0x62, 0x0B, 0x82, 0x01, 0x01, 0x83, 0x02, 0x22, 0x11, 0x80, 0x02,
+	0x00, 0x04 };
+PRIVATE const u8 s_ber_bad_len[] = {
+	0x81, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 };
+PRIVATE const u8 s_apdu_case1[] = { 0x80, 0x22, 0x00, 0x00 };
+PRIVATE const u8 s_apdu_case2[] = { 0x80, 0x22, 0x00, 0x00, 0x04 };
+PRIVATE const u8 s_apdu_case2e[] = { 0x80, 0x22, 0x00, 0x00, 0x00, 0x01, 0x04 };
+PRIVATE const u8 s_apdu_case3[] = {
+	0x80, 0x22, 0x00, 0x00, 0x04, 0x01, 0x02, 0x03, 0x04 };
+PRIVATE const u8 s_apdu_case4[] = {
+	0x80, 0x22, 0x00, 0x00, 0x04, 0x01, 0x02, 0x03, 0x04, 0xFF, 0x01 };
+PRIVATE const u8 s_apdu_case4e[] = {
+	0x80, 0x22, 0x00, 0x00, 0x00, 0x00, 0x04, 0x01, 0x02, 0x03, 0x04,
+	0xFF, 0x01 };
+PRIVATE const u8 s_apdu_select[] = {
+	0x00, 0xA4, 0x00, 0x00, 0x02, 0x3F, 0x00 };
+PRIVATE const u8 s_apdu_read[] = { 0x00, 0xB0, 0x00, 0x00, 0x10 };
+
+PRIVATE const struct seed seeds[] = {
+	SEED(T_TLV_BER,    s_ber_prim),
+	SEED(T_TLV_BER,    s_ber_tags),
+	SEED(T_TLV_BER,    s_ber_nested),
+	SEED(T_TLV_BER,    s_ber_fcp),
+	SEED(T_TLV_BER,    s_ber_bad_len),
+	SEED(T_TLV_STREAM, s_ber_nested),
+	SEED(T_TLV_STREAM, s_ber_fcp),
+	SEED(T_APDU,       s_apdu_case1),
+	SEED(T_APDU,       s_apdu_case2),
+	SEED(T_APDU,       s_apdu_case2e),
+	SEED(T_APDU,       s_apdu_case3),
+	SEED(T_APDU,       s_apdu_case4),
+	SEED(T_APDU,       s_apdu_case4e),
+	SEED(T_APDU,       s_apdu_select),
+	SEED(T_APDU,       s_apdu_read)
+};
+
+PRIVATE volatile u32 sink;
+
+/* Touch every value byte, so sanitizers see any out of bounds value. */
+PRIVATE enum Tlv_Parse_Cmd
+touch__visit(const struct tlv_parse_ctx *tlv, void *opaque)
+{
+	u32 i;
+
+	PARAM_UNUSED(opaque);
+
+	for (i = 0; tlv->value && i < tlv->length; i++)
+		sink += tlv->value[i];
+
+	return STEP_INTO;
+}
+
+PRIVATE void
+run_tlv_ber(const u8 *data, u32 size)
+{
+	tlv_parse_ber(data, size, touch__visit, NULL);
+}
+
+/* The first byte gives the chunk size to split the remaining input. */
+PRIVATE void
+run_tlv_stream(const u8 *data, u32 size)
+{
+	struct tlv_parse_scope   stack[TLV_MAX_NESTING];
+	struct tlv_stream_parser p;
+	u8  vbuf[16];
+	u32 chunk;
+	u32 n;
+
+	if (!size) return;
+
+	chunk = data[0] ? data[0] : 1;
+	data++;
+	size--;
+
+	tlv_stream_parser_init(&p, touch__visit, NULL, stack, LENGTH(stack),
+	                       vbuf, sizeof(vbuf), NULL);
+
+	while (size) {
+		n = MIN(chunk, size);
+		if (tlv_stream_parser_feed(&p, data, n)) return;
+		data += n;
+		size -= n;
+	}
+
+	tlv_stream_parser_finish(&p);
+}
+
+PRIVATE void
+run_apdu(u8 *data, u32 size)
+{
+	CmdAPDU capdu = { .msg = data, .length = size };
+	u32 i;
+
+	if (size > 0xFFFF) return;
+
+	if (apdu_validate_cmd(&capdu)) return;
+
+	for (i = 0; i < capdu.Lc; i++)
+		sink += capdu.data[i];
+
+	sink += (u32) (size_t) apdu_get_cmd_handler(&capdu);
+}
+
+/**
+ *  Run one input. The target gets a private copy of exactly its input size,
+ *  so any over-read hits the end of the allocation.
+ */
+PRIVATE int
+run_one(const u8 *data, size_t size)
+{
+	u8 *copy;
+
+	if (size < 1 || size > FUZZ_MAX_INPUT) return 0;
+
+	copy = malloc(size - 1 ? size - 1 : 1);
+	if (!copy) return 0;
+
+	memcpy(copy, data + 1, size - 1);
+
+	switch (data[0] % T_COUNT) {
+	case T_TLV_BER:
+		run_tlv_ber(copy, size - 1);
+		break;
+	case T_TLV_STREAM:
+		run_tlv_stream(copy, size - 1);
+		break;
+	default:
+		run_apdu(copy, size - 1);
+	}
+
+	free(copy);
+
+	return 0;
+}
+
+#ifdef FUZZ_LIBFUZZER
+
+int
+LLVMFuzzerTestOneInput(const u8 *data, size_t size)
+{
+	return run_one(data, size);
+}
+
+#else
+
+/* chunked parsing is seeded with chunks of three bytes */
+#define SEED_CHUNK 3
+
+PRIVATE u8 input[FUZZ_MAX_INPUT];
+
+/**
+ *  Put the target selector of a seed and any target options in front of
+ *  its input.
+ *
+ *  @return Number of header bytes.
+ */
+PRIVATE u32
+seed_header(const struct seed *s, u8 *hdr)
+{
+	u32 n = 0;
+
+	hdr[n++] = s->target;
+
+	if (s->target == T_TLV_STREAM)
+		hdr[n++] = SEED_CHUNK;
+
+	return n;
+}
+
+PRIVATE int
+run_file(FILE *fh)
+{
+	size_t n = fread(input, 1, sizeof(input), fh);
+
+	return run_one(input, n);
+}
+
+PRIVATE int
+write_seeds(const char *dir)
+{
+	const struct seed *s;
+	char  name[256];
+	FILE  *fh;
+	u8    hdr[2];
+
+	for_each(s, seeds, LENGTH(seeds)) {
+		snprintf(name, sizeof(name), "%s/seed-%02u",
+		         dir, (unsigned) (s - seeds));
+
+		fh = fopen(name, "wb");
+		if (!fh) {
+			perror(name);
+			return 1;
+		}
+
+		fwrite(hdr, 1, seed_header(s, hdr), fh);
+		fwrite(s->data, 1, s->length, fh);
+		fclose(fh);
+	}
+
+	return 0;
+}
+
+/**
+ *  Mutate seeds at random. This is no replacement for a coverage guided
+ *  fuzzer, but catches regressions without one.
+ */
+PRIVATE int
+run_random(u32 rounds)
+{
+	const struct seed *s;
+	u32 n;
+	u32 h;
+	u32 i;
+	u32 flips;
+
+	srand(rounds);
+
+	while (rounds--) {
+		s = &seeds[rand() % LENGTH(seeds)];
+
+		h = seed_header(s, input);
+		n = h + s->length;
+		memcpy(input + h, s->data, s->length);
+
+		/* flip bytes (the chunk size of stream inputs too), then
+		 * truncate or extend */
+		for (flips = rand() % 4 + 1; flips; flips--)
+			input[1 + rand() % (n - 1)] = rand();
+
+		if (rand() & 1) {
+			n = 1 + rand() % n;
+		} else {
+			for (i = rand() % 8; i && n < sizeof(input); i--)
+				input[n++] = rand();
+		}
+
+		run_one(input, n);
+	}
+
+	return 0;
+}
+
+PRIVATE double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+PRIVATE int
+benchmark(u32 rounds)
+{
+	const struct seed *s;
+	CmdAPDU capdu;
+	double  t;
+	u32     bytes = 0;
+	u32     apdus = 0;
+	u32     i;
+	u8      msg[64];
+
+	/* tlv_parse_ber over all TLV seeds */
+	t = now();
+	for (i = 0; i < rounds; i++) {
+		for_each(s, seeds, LENGTH(seeds)) {
+			if (s->target != T_TLV_BER) continue;
+			tlv_parse_ber(s->data, s->length, touch__visit, NULL);
+			bytes += s->length;
+		}
+	}
+	t = now() - t;
+	printf("tlv_parse_ber          %12.1f MB/s\n", bytes / t / (1024 * 1024));
+
+	/* validate and resolve all APDU seeds */
+	t = now();
+	for (i = 0; i < rounds; i++) {
+		for_each(s, seeds, LENGTH(seeds)) {
+			if (s->target != T_APDU) continue;
+
+			memcpy(msg, s->data, s->length);
+			*(u8 **) &capdu.msg = msg;
+			capdu.length = s->length;
+
+			if (!apdu_validate_cmd(&capdu))
+				sink += (u32) (size_t) apdu_get_cmd_handler(&capdu);
+			apdus++;
+		}
+	}
+	t = now() - t;
+	printf("apdu validate+resolve  %12.0f APDU/s\n", apdus / t);
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	FILE *fh;
+	int  i;
+
+	if (argc > 2 && !strcmp(argv[1], "-s"))
+		return write_seeds(argv[2]);
+
+	if (argc > 2 && !strcmp(argv[1], "-r"))
+		return run_random(atoi(argv[2]));
+
+	if (argc > 1 && !strcmp(argv[1], "-b"))
+		return benchmark(argc > 2 ? (u32) atoi(argv[2]) : BENCH_ROUNDS);
+
+	if (argc < 2)
+		return run_file(stdin);
+
+	for (i = 1; i < argc; i++) {
+		fh = fopen(argv[i], "rb");
+		if (!fh) {
+			perror(argv[i]);
+			return 1;
+		}
+		run_file(fh);
+		fclose(fh);
+	}
+
+	return 0;
+}
+
+#endif /* FUZZ_LIBFUZZER */
@@ -54,11 +54,15 @@ int main()
 
 	/* create suites, order is important */
 	if ( (err_code = build_suite__types())       ||
+	     (err_code = build_suite__tlv_parser())  ||
 	     (err_code = build_suite__stub_memdev()) ||
 	     (err_code = build_suite__somefs())      ||
 	     (err_code = build_suite__smartfs())     ||
 	     (err_code = build_suite__flxio())       ||
-	     (err_code = build_suite__apdu()))
+	     (err_code = build_suite__apdu())        ||
+	     (err_code = build_suite__stream())      ||
+	     (err_code = build_suite__arena())       ||
+	     (err_code = build_suite__pool()))
 	{
 		return err_code;
 	}